@@ -0,0 +1,338 @@
+#include "BisectorPool.hpp"
+
+#include <etna/PipelineManager.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/BlockingTransferHelper.hpp>
+#include <etna/Profiling.hpp>
+#include <etna/Etna.hpp>
+#include <etna/Assert.hpp>
+
+
+BisectorPool::BisectorPool(std::uint32_t pool_capacity, std::int32_t max_depth)
+  : capacity(pool_capacity)
+  , maxDepth(max_depth)
+{
+  ETNA_VERIFYF(pool_capacity >= 2, "Bisector pool needs at least 2 slots for the root triangles");
+  ETNA_VERIFYF(
+    max_depth >= 1 && max_depth <= bisector_pool_reference::kMaxDepth,
+    "Bisector pool depth should be from 1 to {}",
+    bisector_pool_reference::kMaxDepth);
+  // null slot is the largest 32 bit value
+  ETNA_VERIFYF(
+    pool_capacity < bisector_pool_reference::kNullSlot / 2,
+    "Capacity of {} is too large",
+    pool_capacity);
+}
+
+void BisectorPool::allocateResources()
+{
+  auto& ctx = etna::get_context();
+
+  auto storageBuffer = [&ctx](vk::DeviceSize size, const char* name) {
+    return ctx.createBuffer(
+      etna::Buffer::CreateInfo{
+        .size = size,
+        .bufferUsage =
+          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        .name = name});
+  };
+
+  stateBuffer = storageBuffer(sizeof(PoolState), "bisectorPoolState");
+  bisectorBuffer =
+    storageBuffer(sizeof(bisector_pool_reference::Bisector) * capacity, "bisectorPoolBisectors");
+  commandBuffer =
+    storageBuffer(sizeof(bisector_pool_reference::Command) * capacity, "bisectorPoolCommands");
+  // current and next active lists
+  activeBuffer = storageBuffer(sizeof(std::uint32_t) * capacity * 2, "bisectorPoolActive");
+  freeBuffer = storageBuffer(sizeof(std::uint32_t) * capacity, "bisectorPoolFree");
+
+  drawIndirectBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(vk::DrawIndirectCommand),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "bisectorPoolDrawIndirect"});
+
+  dispatchIndirectBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(vk::DispatchIndirectCommand),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "bisectorPoolDispatchIndirect"});
+
+  oneShotCommands = ctx.createOneShotCmdMgr();
+}
+
+void BisectorPool::loadShaders()
+{
+  etna::create_program(
+    "bisector_pool_allocate",
+    {BISECTOR_POOL_MODULE_SHADERS_ROOT "bisector_pool_allocate.comp.spv"});
+  etna::create_program(
+    "bisector_pool_commit", {BISECTOR_POOL_MODULE_SHADERS_ROOT "bisector_pool_commit.comp.spv"});
+  etna::create_program(
+    "bisector_pool_write", {BISECTOR_POOL_MODULE_SHADERS_ROOT "bisector_pool_write.comp.spv"});
+  etna::create_program(
+    "bisector_pool_finalize",
+    {BISECTOR_POOL_MODULE_SHADERS_ROOT "bisector_pool_finalize.comp.spv"});
+}
+
+void BisectorPool::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  allocatePipeline = pipelineManager.createComputePipeline("bisector_pool_allocate", {});
+  commitPipeline = pipelineManager.createComputePipeline("bisector_pool_commit", {});
+  writePipeline = pipelineManager.createComputePipeline("bisector_pool_write", {});
+  finalizePipeline = pipelineManager.createComputePipeline("bisector_pool_finalize", {});
+}
+
+void BisectorPool::load()
+{
+  std::unique_ptr<etna::BlockingTransferHelper> transferHelper =
+    std::make_unique<etna::BlockingTransferHelper>(etna::BlockingTransferHelper::CreateInfo{
+      .stagingSize = sizeof(bisector_pool_reference::Bisector) * capacity});
+
+  bisector_pool_reference::Pool pool(capacity, maxDepth);
+
+  std::vector<bisector_pool_reference::Bisector> bisectors(capacity);
+  std::vector<bisector_pool_reference::Command> commands(capacity);
+  for (std::uint32_t slot = 0; slot < capacity; slot++)
+  {
+    bisectors[slot] = pool.getBisector(slot);
+    commands[slot] = pool.getCommand(slot);
+  }
+
+  PoolState state = {
+    .capacity = capacity,
+    .maxDepth = maxDepth,
+    .activeCount = pool.getActiveCount(),
+    .freeCount = pool.getFreeCount(),
+    .currentList = 0,
+    .allocated = 0,
+    .straddleBase = bisector_pool_reference::kNullSlot,
+    .freedCount = 0,
+    .nextActiveCount = 0};
+
+  transferHelper->uploadBuffer(
+    *oneShotCommands, stateBuffer, 0, std::as_bytes(std::span(&state, 1)));
+  transferHelper->uploadBuffer(
+    *oneShotCommands, bisectorBuffer, 0, std::as_bytes(std::span(bisectors)));
+  transferHelper->uploadBuffer(
+    *oneShotCommands, commandBuffer, 0, std::as_bytes(std::span(commands)));
+  // the first list is current, the other one is written by the first update
+  transferHelper->uploadBuffer(*oneShotCommands, activeBuffer, 0, std::as_bytes(pool.getActive()));
+  transferHelper->uploadBuffer(
+    *oneShotCommands, freeBuffer, 0, std::as_bytes(pool.getFreeSlots()));
+
+  vk::DrawIndirectCommand drawCommand = {
+    .vertexCount = pool.getActiveCount(), .instanceCount = 1, .firstVertex = 0, .firstInstance = 0};
+  transferHelper->uploadBuffer(
+    *oneShotCommands, drawIndirectBuffer, 0, std::as_bytes(std::span(&drawCommand, 1)));
+
+  vk::DispatchIndirectCommand dispatchCommand = {.x = 1, .y = 1, .z = 1};
+  transferHelper->uploadBuffer(
+    *oneShotCommands, dispatchIndirectBuffer, 0, std::as_bytes(std::span(&dispatchCommand, 1)));
+}
+
+std::vector<etna::Binding> BisectorPool::genBindings() const
+{
+  return {
+    etna::Binding{0 /*check bisector_pool.glsl*/, stateBuffer.genBinding()},
+    etna::Binding{1, bisectorBuffer.genBinding()},
+    etna::Binding{2, commandBuffer.genBinding()},
+    etna::Binding{3, activeBuffer.genBinding()},
+    etna::Binding{4, freeBuffer.genBinding()}};
+}
+
+void BisectorPool::beginUpdate(vk::CommandBuffer cmd_buf)
+{
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTessellationControlShader,
+    vk::AccessFlagBits2::eShaderStorageRead,
+    vk::PipelineStageFlagBits2::eComputeShader);
+}
+
+void BisectorPool::endUpdatePass(vk::CommandBuffer cmd_buf, bool merge)
+{
+  ZoneScoped;
+
+  // requests of the classification pass
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader);
+
+  passDispatch(cmd_buf, allocatePipeline, "bisector_pool_allocate", merge);
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader);
+
+  commit(cmd_buf, false);
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader);
+
+  passDispatch(cmd_buf, writePipeline, "bisector_pool_write", merge);
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader);
+
+  passDispatch(cmd_buf, finalizePipeline, "bisector_pool_finalize", merge);
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader);
+
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = drawIndirectBuffer.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = dispatchIndirectBuffer.get(),
+        .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  commit(cmd_buf, true);
+
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .buffer = drawIndirectBuffer.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .buffer = dispatchIndirectBuffer.get(),
+        .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  // next classification pass or the draw
+  poolBarrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader |
+      vk::PipelineStageFlagBits2::eTessellationControlShader);
+}
+
+void BisectorPool::poolBarrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stages,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stages)
+{
+  std::array<vk::BufferMemoryBarrier2, 5> bufferBarriers;
+  std::array buffers = {&stateBuffer, &bisectorBuffer, &commandBuffer, &activeBuffer, &freeBuffer};
+  for (std::size_t i = 0; i < buffers.size(); i++)
+  {
+    bufferBarriers[i] = vk::BufferMemoryBarrier2{
+      .srcStageMask = src_stages,
+      .srcAccessMask = src_access,
+      .dstStageMask = dst_stages,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+      .buffer = buffers[i]->get(),
+      .size = vk::WholeSize};
+  }
+
+  vk::DependencyInfo dependencyInfo = {
+    .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+    .pBufferMemoryBarriers = bufferBarriers.data()};
+
+  cmd_buf.pipelineBarrier2(dependencyInfo);
+}
+
+void BisectorPool::passDispatch(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program_name,
+  bool merge)
+{
+  ZoneScoped;
+
+  auto shaderInfo = etna::get_shader_program(program_name);
+  auto set = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(0 /*check bisector_pool.glsl*/), cmd_buf, genBindings());
+
+  auto vkSet = set.getVkSet();
+  auto pipelineLayout = pipeline.getVkPipelineLayout();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, {vkSet}, {});
+
+  cmd_buf.pushConstants<PassPushConstants>(
+    pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, {{.value = merge ? 1u : 0u}});
+
+  // a thread per active bisector, the count changes in the last commit only
+  cmd_buf.dispatchIndirect(dispatchIndirectBuffer.get(), 0);
+}
+
+void BisectorPool::commit(vk::CommandBuffer cmd_buf, bool finalize_update)
+{
+  ZoneScoped;
+
+  std::vector<etna::Binding> bindings = genBindings();
+  bindings.push_back(etna::Binding{5, drawIndirectBuffer.genBinding()});
+  bindings.push_back(etna::Binding{6, dispatchIndirectBuffer.genBinding()});
+
+  auto shaderInfo = etna::get_shader_program("bisector_pool_commit");
+  auto set = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(0 /*check bisector_pool.glsl*/), cmd_buf, bindings);
+
+  auto vkSet = set.getVkSet();
+  auto pipelineLayout = commitPipeline.getVkPipelineLayout();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, commitPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, {vkSet}, {});
+
+  cmd_buf.pushConstants<PassPushConstants>(
+    pipelineLayout,
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    {{.value = finalize_update ? 1u : 0u}});
+
+  cmd_buf.dispatch(1, 1, 1);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+#include "BisectorPoolReference.hpp"
+
+
+// Square LEB subdivision with leaves in a fixed pool of slots, see bisector_pool.glsl. Depth goes
+// up to 63 and memory follows the capacity, bytes per slot are a few dozen instead of a heap
+// over every node of the max depth. Bisectors that do not fit are not split until slots free up
+class BisectorPool
+{
+public:
+  BisectorPool(std::uint32_t pool_capacity, std::int32_t max_depth);
+
+  void allocateResources();
+  void loadShaders();
+  void setupPipelines();
+  void load();
+
+  // Classification passes dispatch indirectly over active bisectors, see
+  // getDispatchIndirectBuffer, and request splits or merges. Pool is released from the previous
+  // frame draw before the first pass
+  void beginUpdate(vk::CommandBuffer cmd_buf);
+  // Allocates, writes and relinks requested bisectors, then rebuilds the active list and the
+  // indirect commands, so the next pass and the draw see the updated pool. Requests of the other
+  // kind are dropped, split and merge never run in the same pass
+  void endUpdatePass(vk::CommandBuffer cmd_buf, bool merge);
+
+  // Set 0 bindings 0 to 4 of bisector_pool.glsl
+  std::vector<etna::Binding> genBindings() const;
+
+  const etna::Buffer& getBisectorBuffer() const { return bisectorBuffer; }
+  const etna::Buffer& getDrawIndirectBuffer() const { return drawIndirectBuffer; }
+  const etna::Buffer& getDispatchIndirectBuffer() const { return dispatchIndirectBuffer; }
+  std::uint32_t getCapacity() const { return capacity; }
+  std::int32_t getMaxDepth() const { return maxDepth; }
+
+private:
+  void passDispatch(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const char* program_name,
+    bool merge);
+  void commit(vk::CommandBuffer cmd_buf, bool finalize_update);
+  // every pool buffer is used by every pass
+  void poolBarrier(
+    vk::CommandBuffer cmd_buf,
+    vk::PipelineStageFlags2 src_stages,
+    vk::AccessFlags2 src_access,
+    vk::PipelineStageFlags2 dst_stages);
+
+private:
+  // mirror of BisectorPoolState of bisector_pool.glsl
+  struct PoolState
+  {
+    std::uint32_t capacity;
+    std::int32_t maxDepth;
+    std::uint32_t activeCount;
+    std::uint32_t freeCount;
+    std::uint32_t currentList;
+    std::uint32_t allocated;
+    std::uint32_t straddleBase;
+    std::uint32_t freedCount;
+    std::uint32_t nextActiveCount;
+  };
+
+  struct PassPushConstants
+  {
+    std::uint32_t value;
+  };
+
+private:
+  std::uint32_t capacity;
+  std::int32_t maxDepth;
+
+  etna::Buffer stateBuffer;
+  etna::Buffer bisectorBuffer;
+  etna::Buffer commandBuffer;
+  etna::Buffer activeBuffer;
+  etna::Buffer freeBuffer;
+  etna::Buffer drawIndirectBuffer;
+  etna::Buffer dispatchIndirectBuffer;
+
+  etna::ComputePipeline allocatePipeline;
+  etna::ComputePipeline commitPipeline;
+  etna::ComputePipeline writePipeline;
+  etna::ComputePipeline finalizePipeline;
+
+  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
+};
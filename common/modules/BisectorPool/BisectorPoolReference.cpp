@@ -0,0 +1,495 @@
+#include "BisectorPoolReference.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+#include "CBT/CBTReference.hpp"
+
+
+namespace bisector_pool_reference
+{
+
+std::int32_t heap_id_depth(std::uint64_t heap_id)
+{
+  return static_cast<std::int32_t>(std::bit_width(heap_id)) - 1;
+}
+
+Pool::Pool(std::uint32_t capacity, std::int32_t max_depth)
+  : maxDepth(max_depth)
+{
+  if (capacity < 2u || max_depth < 1 || max_depth > kMaxDepth)
+  {
+    throw std::invalid_argument("Bisector pool needs at least 2 slots and depth from 1 to 63");
+  }
+
+  bisectors.resize(capacity, {.heapId = 0u, .neighbours = {kNullSlot, kNullSlot, kNullSlot}});
+  commands.resize(capacity, {.flags = 0u, .slots = {kNullSlot, kNullSlot}});
+
+  // root triangles share the diagonal of the square
+  bisectors[0] = {.heapId = 2u, .neighbours = {kNullSlot, kNullSlot, 1u}};
+  bisectors[1] = {.heapId = 3u, .neighbours = {kNullSlot, kNullSlot, 0u}};
+  active = {0u, 1u};
+
+  // lowest slots are on top of the stack
+  for (std::uint32_t slot = capacity; slot > 2u; slot--)
+  {
+    freeSlots.push_back(slot - 1u);
+  }
+}
+
+glm::vec3 Pool::decodeAttribute(std::uint32_t slot, glm::vec3 data) const
+{
+  std::uint64_t heapId = bisectors[slot].heapId;
+  return cbt_reference::leb_square_decode_transformation_table(heapId, heap_id_depth(heapId)) *
+    data;
+}
+
+void Pool::requestSplit(std::uint32_t slot)
+{
+  if (getDepth(slot) >= maxDepth)
+  {
+    return;
+  }
+
+  // a bisector can be split together with a same depth twin only, longest edge neighbours of
+  // a chain get coarser until there is one
+  std::uint32_t current = slot;
+  for (std::int32_t hop = 0; hop <= kMaxDepth; hop++)
+  {
+    std::uint32_t twin = neighbour(current, Neighbour::eEdge);
+    if (twin == kNullSlot)
+    {
+      commands[current].flags |= kSplitRequested;
+      return;
+    }
+    if (neighbour(twin, Neighbour::eEdge) == current)
+    {
+      commands[current].flags |= kSplitRequested;
+      commands[twin].flags |= kSplitRequested;
+      return;
+    }
+    current = twin;
+  }
+}
+
+void Pool::requestMerge(std::uint32_t slot)
+{
+  commands[slot].flags |= kMergeRequested;
+}
+
+void Pool::update(bool merge)
+{
+  // allocation
+  for (std::uint32_t slot : active)
+  {
+    if (merge)
+    {
+      allocateMerge(slot);
+    }
+    else
+    {
+      allocateSplit(slot);
+    }
+  }
+
+  commitAllocation();
+
+  // write
+  for (std::uint32_t slot : active)
+  {
+    if (merge)
+    {
+      writeMerge(slot);
+    }
+    else
+    {
+      writeSplit(slot);
+    }
+  }
+
+  // finalize
+  for (std::uint32_t slot : active)
+  {
+    finalize(slot, merge);
+  }
+
+  commitUpdate();
+}
+
+bool Pool::reserve(std::uint32_t count, std::uint32_t& base)
+{
+  // atomicAdd on the GPU, only the reservation crossing the end of free slots is recorded
+  base = allocated;
+  allocated += count;
+
+  std::uint32_t freeCount = getFreeCount();
+  if (base + count > freeCount)
+  {
+    if (base < freeCount)
+    {
+      straddleBase = std::min(straddleBase, base);
+    }
+    return false;
+  }
+
+  return true;
+}
+
+void Pool::allocateSplit(std::uint32_t slot)
+{
+  if ((commands[slot].flags & kSplitRequested) == 0u)
+  {
+    return;
+  }
+
+  std::uint32_t twin = neighbour(slot, Neighbour::eEdge);
+  // the lower slot of a diamond allocates for both
+  if (twin != kNullSlot && twin < slot)
+  {
+    return;
+  }
+
+  std::uint32_t members = twin == kNullSlot ? 1u : 2u;
+  std::uint32_t base = 0u;
+  if (!reserve(2u * members, base))
+  {
+    return;
+  }
+
+  std::uint32_t freeCount = getFreeCount();
+  std::array diamond = {slot, twin};
+  for (std::uint32_t member = 0; member < members; member++)
+  {
+    Command& command = commands[diamond[member]];
+    command.flags |= kAllocated;
+    command.slots[0] = freeSlots[freeCount - 1u - (base + 2u * member)];
+    command.slots[1] = freeSlots[freeCount - 1u - (base + 2u * member + 1u)];
+  }
+}
+
+bool Pool::mergeDiamond(std::uint32_t slot, Diamond& diamond) const
+{
+  std::uint64_t heapId = bisectors[slot].heapId;
+  if (heap_id_depth(heapId) <= 1)
+  {
+    return false;
+  }
+
+  // siblings are linked through their shared edge, right of the first and left of the second
+  bool isFirstChild = (heapId & 1u) == 0u;
+  std::uint32_t bottom0 = isFirstChild ? slot : neighbour(slot, Neighbour::eLeft);
+  std::uint32_t bottom1 = isFirstChild ? neighbour(slot, Neighbour::eRight) : slot;
+  if (
+    bottom0 == kNullSlot || bottom1 == kNullSlot ||
+    bisectors[bottom1].heapId != (bisectors[bottom0].heapId | 1u) ||
+    neighbour(bottom0, Neighbour::eRight) != bottom1 ||
+    neighbour(bottom1, Neighbour::eLeft) != bottom0)
+  {
+    return false;
+  }
+
+  std::uint32_t top1 = neighbour(bottom0, Neighbour::eLeft);
+  std::uint32_t top0 = neighbour(bottom1, Neighbour::eRight);
+  if ((top0 == kNullSlot) != (top1 == kNullSlot))
+  {
+    return false;
+  }
+  if (
+    top0 != kNullSlot &&
+    ((bisectors[top0].heapId & 1u) != 0u ||
+     bisectors[top1].heapId != (bisectors[top0].heapId | 1u) ||
+     heap_id_depth(bisectors[top0].heapId) != heap_id_depth(heapId) ||
+     neighbour(top0, Neighbour::eRight) != top1 || neighbour(top1, Neighbour::eLeft) != top0))
+  {
+    return false;
+  }
+
+  diamond.slots = {bottom0, bottom1, top0, top1};
+  diamond.owner = kNullSlot;
+  for (std::uint32_t member : diamond.slots)
+  {
+    if (member == kNullSlot)
+    {
+      continue;
+    }
+    if ((commands[member].flags & kMergeRequested) == 0u)
+    {
+      return false;
+    }
+    diamond.owner = std::min(diamond.owner, member);
+  }
+
+  return true;
+}
+
+void Pool::allocateMerge(std::uint32_t slot)
+{
+  Diamond diamond;
+  if ((commands[slot].flags & kMergeRequested) == 0u || !mergeDiamond(slot, diamond))
+  {
+    return;
+  }
+  // the lowest slot of a diamond allocates for all of it
+  if (diamond.owner != slot)
+  {
+    return;
+  }
+
+  std::uint32_t parents = diamond.slots[2] == kNullSlot ? 1u : 2u;
+  std::uint32_t base = 0u;
+  if (!reserve(parents, base))
+  {
+    return;
+  }
+
+  std::uint32_t freeCount = getFreeCount();
+  for (std::uint32_t member = 0; member < 2u * parents; member++)
+  {
+    Command& command = commands[diamond.slots[member]];
+    command.flags |= kAllocated;
+    command.slots[0] = freeSlots[freeCount - 1u - (base + member / 2u)];
+  }
+}
+
+void Pool::commitAllocation()
+{
+  // every reservation before the straddling one fits
+  std::uint32_t consumed = std::min({allocated, getFreeCount(), straddleBase});
+  freeSlots.resize(getFreeCount() - consumed);
+
+  allocated = 0u;
+  straddleBase = kNullSlot;
+}
+
+void Pool::replaceNeighbour(std::uint32_t slot, std::uint32_t from, std::uint32_t to)
+{
+  for (std::uint32_t& link : bisectors[slot].neighbours)
+  {
+    if (link == from)
+    {
+      link = to;
+      return;
+    }
+  }
+}
+
+void Pool::writeSplit(std::uint32_t slot)
+{
+  const Command& command = commands[slot];
+  if ((command.flags & kAllocated) == 0u)
+  {
+    return;
+  }
+
+  Bisector parent = bisectors[slot];
+  std::array<std::uint32_t, 2> children = command.slots;
+
+  // a split neighbour links its child that got the shared edge, left edge goes to the first
+  // child and right edge to the second one, others are relinked to the new child
+  auto childNeighbour = [&](std::uint32_t link, std::uint32_t child) {
+    if (link == kNullSlot)
+    {
+      return kNullSlot;
+    }
+    if ((commands[link].flags & kAllocated) != 0u)
+    {
+      bool left = neighbour(link, Neighbour::eLeft) == slot;
+      return commands[link].slots[left ? 0 : 1];
+    }
+    replaceNeighbour(link, slot, child);
+    return link;
+  };
+
+  std::uint32_t twin = parent.neighbours[static_cast<std::uint32_t>(Neighbour::eEdge)];
+  std::uint32_t twinChild0 = twin == kNullSlot ? kNullSlot : commands[twin].slots[0];
+  std::uint32_t twinChild1 = twin == kNullSlot ? kNullSlot : commands[twin].slots[1];
+
+  bisectors[children[0]] = {
+    .heapId = parent.heapId << 1u,
+    .neighbours = {
+      twinChild1,
+      children[1],
+      childNeighbour(parent.neighbours[static_cast<std::uint32_t>(Neighbour::eLeft)], children[0]),
+    }};
+  bisectors[children[1]] = {
+    .heapId = (parent.heapId << 1u) | 1u,
+    .neighbours = {
+      children[0],
+      twinChild0,
+      childNeighbour(parent.neighbours[static_cast<std::uint32_t>(Neighbour::eRight)], children[1]),
+    }};
+}
+
+void Pool::writeMerge(std::uint32_t slot)
+{
+  const Command& command = commands[slot];
+  // first children write their parent
+  if ((command.flags & kAllocated) == 0u || (bisectors[slot].heapId & 1u) != 0u)
+  {
+    return;
+  }
+
+  std::uint32_t child0 = slot;
+  std::uint32_t child1 = neighbour(slot, Neighbour::eRight);
+  std::uint32_t parent = command.slots[0];
+
+  // a merged neighbour links its parent, others are relinked to the new parent
+  auto parentNeighbour = [&](std::uint32_t link, std::uint32_t child) {
+    if (link == kNullSlot)
+    {
+      return kNullSlot;
+    }
+    if ((commands[link].flags & kAllocated) != 0u)
+    {
+      return commands[link].slots[0];
+    }
+    replaceNeighbour(link, child, parent);
+    return link;
+  };
+
+  std::uint32_t top1 = neighbour(child0, Neighbour::eLeft);
+
+  bisectors[parent] = {
+    .heapId = bisectors[child0].heapId >> 1u,
+    .neighbours = {
+      parentNeighbour(neighbour(child0, Neighbour::eEdge), child0),
+      parentNeighbour(neighbour(child1, Neighbour::eEdge), child1),
+      top1 == kNullSlot ? kNullSlot : commands[top1].slots[0],
+    }};
+}
+
+void Pool::finalize(std::uint32_t slot, bool merge)
+{
+  Command& command = commands[slot];
+  if ((command.flags & kAllocated) == 0u)
+  {
+    nextActive.push_back(slot);
+  }
+  else if (!merge)
+  {
+    nextActive.push_back(command.slots[0]);
+    nextActive.push_back(command.slots[1]);
+    freedSlots.push_back(slot);
+  }
+  else
+  {
+    // first children bring the parent in
+    if ((bisectors[slot].heapId & 1u) == 0u)
+    {
+      nextActive.push_back(command.slots[0]);
+    }
+    freedSlots.push_back(slot);
+  }
+
+  command = {.flags = 0u, .slots = {kNullSlot, kNullSlot}};
+}
+
+void Pool::commitUpdate()
+{
+  freeSlots.insert(freeSlots.end(), freedSlots.begin(), freedSlots.end());
+  freedSlots.clear();
+
+  std::swap(active, nextActive);
+  nextActive.clear();
+}
+
+std::array<glm::vec3, 3> Pool::unmirroredVertices(std::uint32_t slot) const
+{
+  glm::vec3 x = decodeAttribute(slot, glm::vec3(0.0f, 0.0f, 1.0f));
+  glm::vec3 z = decodeAttribute(slot, glm::vec3(1.0f, 0.0f, 0.0f));
+
+  std::array<glm::vec3, 3> vertices;
+  for (std::int32_t i = 0; i < 3; i++)
+  {
+    vertices[i] = glm::vec3(x[i], 0.0f, z[i]);
+  }
+
+  // decoding mirrors every other depth for winding
+  if (((getDepth(slot) ^ 1) & 1) != 0)
+  {
+    std::swap(vertices[0], vertices[2]);
+  }
+
+  return vertices;
+}
+
+bool Pool::validate() const
+{
+  std::vector<std::uint32_t> slots(active.begin(), active.end());
+  slots.insert(slots.end(), freeSlots.begin(), freeSlots.end());
+  std::ranges::sort(slots);
+  if (slots.size() != getCapacity())
+  {
+    return false;
+  }
+  for (std::uint32_t i = 0; i < slots.size(); i++)
+  {
+    if (slots[i] != i)
+    {
+      return false;
+    }
+  }
+
+  std::vector<bool> isActive(getCapacity(), false);
+  for (std::uint32_t slot : active)
+  {
+    isActive[slot] = true;
+  }
+
+  static constexpr std::array<std::array<std::int32_t, 2>, 3> kEdges = {{{0, 1}, {1, 2}, {0, 2}}};
+  auto onBorder = [](float a, float b) {
+    return a == b && (a == 0.0f || a == 1.0f);
+  };
+
+  // in root triangles, exact while depths stay within double precision
+  double area = 0.0;
+  for (std::uint32_t slot : active)
+  {
+    area += std::ldexp(1.0, 1 - getDepth(slot));
+
+    std::array<glm::vec3, 3> vertices = unmirroredVertices(slot);
+    for (std::uint32_t edge = 0; edge < 3; edge++)
+    {
+      glm::vec3 a = vertices[kEdges[edge][0]];
+      glm::vec3 b = vertices[kEdges[edge][1]];
+
+      std::uint32_t link = bisectors[slot].neighbours[edge];
+      if (link == kNullSlot)
+      {
+        if (!onBorder(a.x, b.x) && !onBorder(a.z, b.z))
+        {
+          return false;
+        }
+        continue;
+      }
+
+      if (!isActive[link])
+      {
+        return false;
+      }
+
+      std::array<glm::vec3, 3> linkVertices = unmirroredVertices(link);
+      bool mutual = false;
+      for (std::uint32_t linkEdge = 0; linkEdge < 3; linkEdge++)
+      {
+        if (bisectors[link].neighbours[linkEdge] != slot)
+        {
+          continue;
+        }
+        glm::vec3 c = linkVertices[kEdges[linkEdge][0]];
+        glm::vec3 d = linkVertices[kEdges[linkEdge][1]];
+        mutual = (a == c && b == d) || (a == d && b == c);
+      }
+      if (!mutual)
+      {
+        return false;
+      }
+    }
+  }
+
+  return area == 2.0;
+}
+
+} // namespace bisector_pool_reference
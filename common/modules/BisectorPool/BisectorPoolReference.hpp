@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// CPU mirror of subdivision/bisector_pool.glsl and the passes of BisectorPool. Leaves of a square
+// LEB subdivision are kept in a fixed pool of slots with explicit neighbour links instead of a
+// heap over every possible node, so memory follows the bisector budget and not the max depth.
+// Buffers have the same layout as the GPU ones
+namespace bisector_pool_reference
+{
+
+inline constexpr std::uint32_t kNullSlot = 0xFFFFFFFFu;
+// heap ids are 64 bit, depth is the index of their most significant bit
+inline constexpr std::int32_t kMaxDepth = 63;
+
+// command flags
+inline constexpr std::uint32_t kSplitRequested = 1u;
+inline constexpr std::uint32_t kMergeRequested = 2u;
+// slots of the command are valid, split children or merge parent
+inline constexpr std::uint32_t kAllocated = 4u;
+
+enum class Neighbour : std::uint32_t
+{
+  // edges of unmirrored vertices, left is u0 u1, right is u1 u2 and edge is the longest one u0 u2
+  eLeft = 0,
+  eRight = 1,
+  eEdge = 2,
+};
+
+struct Bisector
+{
+  std::uint64_t heapId;
+  std::array<std::uint32_t, 3> neighbours;
+};
+
+struct Command
+{
+  std::uint32_t flags;
+  std::array<std::uint32_t, 2> slots;
+};
+
+std::int32_t heap_id_depth(std::uint64_t heap_id);
+
+class Pool
+{
+public:
+  // Two root triangles of the square, heap ids 2 and 3, in the first two slots
+  Pool(std::uint32_t capacity, std::int32_t max_depth);
+
+  std::uint32_t getCapacity() const { return static_cast<std::uint32_t>(bisectors.size()); }
+  std::int32_t getMaxDepth() const { return maxDepth; }
+  std::uint32_t getActiveCount() const { return static_cast<std::uint32_t>(active.size()); }
+  std::uint32_t getFreeCount() const { return static_cast<std::uint32_t>(freeSlots.size()); }
+  std::span<const std::uint32_t> getActive() const { return active; }
+  std::span<const std::uint32_t> getFreeSlots() const { return freeSlots; }
+  const Bisector& getBisector(std::uint32_t slot) const { return bisectors[slot]; }
+  const Command& getCommand(std::uint32_t slot) const { return commands[slot]; }
+  std::int32_t getDepth(std::uint32_t slot) const
+  {
+    return heap_id_depth(bisectors[slot].heapId);
+  }
+
+  glm::vec3 decodeAttribute(std::uint32_t slot, glm::vec3 data) const;
+
+  // Classification, as bisectorPoolRequestSplit and bisectorPoolRequestMerge. A split request
+  // walks longest edge neighbours to the diamond or boundary that can be split right away, so a
+  // coarser neighbour is split first and the bisector itself in one of the next passes
+  void requestSplit(std::uint32_t slot);
+  // Merge happens only when all bisectors of the diamond request it
+  void requestMerge(std::uint32_t slot);
+
+  // Allocation, commit, write, finalize and commit dispatches of BisectorPool::endUpdatePass in
+  // order, every one of them over every active bisector. Requests that did not fit into free
+  // slots are dropped, requests of the other kind are ignored
+  void update(bool merge);
+
+  // Every link is mutual and crosses the same edge of both bisectors, missing links are on the
+  // square border, active and free slots cover the pool and areas sum up to the square
+  bool validate() const;
+
+private:
+  struct Diamond
+  {
+    std::array<std::uint32_t, 4> slots; // bottom pair, then top pair or null
+    std::uint32_t owner;
+  };
+
+private:
+  std::uint32_t neighbour(std::uint32_t slot, Neighbour which) const
+  {
+    return bisectors[slot].neighbours[static_cast<std::uint32_t>(which)];
+  }
+  std::array<glm::vec3, 3> unmirroredVertices(std::uint32_t slot) const;
+
+  bool reserve(std::uint32_t count, std::uint32_t& base);
+  bool mergeDiamond(std::uint32_t slot, Diamond& diamond) const;
+  void replaceNeighbour(std::uint32_t slot, std::uint32_t from, std::uint32_t to);
+
+  void allocateSplit(std::uint32_t slot);
+  void allocateMerge(std::uint32_t slot);
+  void commitAllocation();
+  void writeSplit(std::uint32_t slot);
+  void writeMerge(std::uint32_t slot);
+  void finalize(std::uint32_t slot, bool merge);
+  void commitUpdate();
+
+private:
+  std::int32_t maxDepth;
+
+  std::vector<Bisector> bisectors;
+  std::vector<Command> commands;
+  std::vector<std::uint32_t> active;
+  std::vector<std::uint32_t> nextActive;
+  // stack, allocation takes slots from the top
+  std::vector<std::uint32_t> freeSlots;
+  std::vector<std::uint32_t> freedSlots;
+
+  std::uint32_t allocated = 0;
+  std::uint32_t straddleBase = kNullSlot;
+};
+
+} // namespace bisector_pool_reference
@@ -0,0 +1,183 @@
+#include "BisectorPatchMesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/BlockingTransferHelper.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/Assert.hpp>
+
+
+BisectorPatchMesh::BisectorPatchMesh(std::uint32_t max_level)
+  : maxLevel(max_level)
+{
+  // vertices of a level are indexed with 16 bits
+  ETNA_VERIFYF(max_level <= 7, "Maximum patch mesh level is 7");
+
+  for (std::uint32_t level = 0; level <= maxLevel; level++)
+  {
+    std::uint32_t segments = 1u << level;
+    levels.push_back(
+      {.firstIndex = static_cast<std::uint32_t>(indices.size()),
+       .indexCount = 3 * segments * segments,
+       .vertexOffset = static_cast<std::int32_t>(vertices.size() / 2)});
+
+    // rows of constant second weight, the first weight grows along a row
+    auto vertexIndex = [segments](std::uint32_t first, std::uint32_t second) {
+      std::uint32_t rowStart = second * (segments + 1) - second * (second - 1) / 2;
+      return static_cast<std::uint16_t>(rowStart + first);
+    };
+
+    for (std::uint32_t second = 0; second <= segments; second++)
+    {
+      for (std::uint32_t first = 0; first + second <= segments; first++)
+      {
+        vertices.push_back(static_cast<float>(first) / static_cast<float>(segments));
+        vertices.push_back(static_cast<float>(second) / static_cast<float>(segments));
+      }
+    }
+
+    // counterclockwise in the domain, as the tessellator makes them with ccw
+    for (std::uint32_t second = 0; second < segments; second++)
+    {
+      for (std::uint32_t first = 0; first + second < segments; first++)
+      {
+        indices.push_back(vertexIndex(first, second));
+        indices.push_back(vertexIndex(first + 1, second));
+        indices.push_back(vertexIndex(first, second + 1));
+
+        if (first + second + 1 < segments)
+        {
+          indices.push_back(vertexIndex(first + 1, second));
+          indices.push_back(vertexIndex(first + 1, second + 1));
+          indices.push_back(vertexIndex(first, second + 1));
+        }
+      }
+    }
+  }
+}
+
+void BisectorPatchMesh::allocateResources()
+{
+  auto& ctx = etna::get_context();
+
+  vertexBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(float) * vertices.size(),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "bisectorPatchVertices"});
+
+  indexBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(std::uint16_t) * indices.size(),
+      .bufferUsage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "bisectorPatchIndices"});
+
+  drawIndirectBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(vk::DrawIndexedIndirectCommand),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "bisectorPatchDrawIndirect"});
+}
+
+void BisectorPatchMesh::load()
+{
+  auto oneShotCommands = etna::get_context().createOneShotCmdMgr();
+  etna::BlockingTransferHelper transferHelper(
+    etna::BlockingTransferHelper::CreateInfo{
+      .stagingSize =
+        std::max(sizeof(float) * vertices.size(), sizeof(std::uint16_t) * indices.size())});
+
+  transferHelper.uploadBuffer(
+    *oneShotCommands, vertexBuffer, 0, std::as_bytes(std::span(vertices)));
+  transferHelper.uploadBuffer(*oneShotCommands, indexBuffer, 0, std::as_bytes(std::span(indices)));
+}
+
+void BisectorPatchMesh::prepareDraw(
+  vk::CommandBuffer cmd_buf, const CBTree& cbt, std::uint32_t level)
+{
+  const Level& current = levels[std::min(level, maxLevel)];
+
+  // previous frame draw may still read the command, the tree command is written by the last
+  // update pass
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .buffer = drawIndirectBuffer.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+        .buffer = cbt.getDrawIndirectBuffer().get(),
+        .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  // leaf count of the tree command becomes the instance count, the rest comes from the level
+  std::array<std::uint32_t, 3> levelCommand = {
+    current.firstIndex, static_cast<std::uint32_t>(current.vertexOffset), 0u};
+  cmd_buf.updateBuffer(
+    drawIndirectBuffer.get(),
+    offsetof(vk::DrawIndexedIndirectCommand, indexCount),
+    sizeof(std::uint32_t),
+    &current.indexCount);
+  cmd_buf.updateBuffer(
+    drawIndirectBuffer.get(),
+    offsetof(vk::DrawIndexedIndirectCommand, firstIndex),
+    sizeof(levelCommand),
+    levelCommand.data());
+
+  vk::BufferCopy instanceCopy = {
+    .srcOffset = cbt.getDrawIndirectOffset(0) + offsetof(vk::DrawIndirectCommand, vertexCount),
+    .dstOffset = offsetof(vk::DrawIndexedIndirectCommand, instanceCount),
+    .size = sizeof(std::uint32_t)};
+  cmd_buf.copyBuffer(cbt.getDrawIndirectBuffer().get(), drawIndirectBuffer.get(), 1, &instanceCopy);
+
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+      .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+      .buffer = drawIndirectBuffer.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+}
+
+void BisectorPatchMesh::draw(vk::CommandBuffer cmd_buf)
+{
+  cmd_buf.bindIndexBuffer(indexBuffer.get(), 0, vk::IndexType::eUint16);
+  cmd_buf.drawIndexedIndirect(drawIndirectBuffer.get(), 0, 1, 0);
+}
+
+etna::Binding BisectorPatchMesh::genVerticesBinding(std::uint32_t binding) const
+{
+  return etna::Binding{binding, vertexBuffer.genBinding()};
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/DescriptorSet.hpp>
+
+#include "CBTree.hpp"
+
+
+// Triangle of the unit barycentric domain split into 2^level segments per edge for every level up
+// to the max one, as tessellation with equal spacing and a uniform factor splits a patch. Leaves
+// are drawn as instances of one level, see subdivision/bisector_patch.glsl, so the draw does
+// not need tessellation shaders
+class BisectorPatchMesh
+{
+public:
+  explicit BisectorPatchMesh(std::uint32_t max_level);
+
+  void allocateResources();
+  void load();
+
+  // Writes the indexed draw command of the level with an instance per leaf of the tree, should
+  // be recorded after the last update pass and outside of rendering
+  void prepareDraw(vk::CommandBuffer cmd_buf, const CBTree& cbt, std::uint32_t level);
+  void draw(vk::CommandBuffer cmd_buf);
+
+  // Barycentric weights of vertices of every level, vertex offset of the level is included
+  // into gl_VertexIndex
+  etna::Binding genVerticesBinding(std::uint32_t binding) const;
+
+  std::uint32_t getMaxLevel() const { return maxLevel; }
+
+private:
+  struct Level
+  {
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+    std::int32_t vertexOffset;
+  };
+
+private:
+  std::uint32_t maxLevel;
+  std::vector<Level> levels;
+  std::vector<float> vertices;
+  std::vector<std::uint16_t> indices;
+
+  etna::Buffer vertexBuffer;
+  etna::Buffer indexBuffer;
+  etna::Buffer drawIndirectBuffer;
+};
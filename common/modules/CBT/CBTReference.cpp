@@ -0,0 +1,616 @@
+#include "CBTReference.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+
+namespace cbt_reference
+{
+
+static constexpr std::uint32_t kFullBitField = 0xFFFFFFFFu;
+
+static std::uint32_t get_bit_range(
+  std::uint32_t bit_field, std::uint32_t first_bit_index, std::uint32_t bit_count)
+{
+  std::uint32_t bitMask = ~(kFullBitField << bit_count);
+  return (bit_field >> first_bit_index) & bitMask;
+}
+
+static void set_bit_range(
+  std::uint32_t& bit_field,
+  std::uint32_t first_bit_index,
+  std::uint32_t bit_count,
+  std::uint32_t bit_data)
+{
+  std::uint32_t bitMask = ~(~(kFullBitField << bit_count) << first_bit_index);
+
+  bit_field &= bitMask;
+  bit_field |= bit_data << first_bit_index;
+}
+
+static std::uint32_t get_bit(std::uint32_t bit_field, std::int32_t bit_index)
+{
+  return (bit_field >> bit_index) & 1u;
+}
+
+Node node_get(std::uint32_t heap_index)
+{
+  // findMSB
+  return {.index = heap_index, .depth = static_cast<std::int32_t>(std::bit_width(heap_index)) - 1};
+}
+
+bool node_is_null(Node node)
+{
+  return node.index == 0u;
+}
+
+bool node_is_root(Node node)
+{
+  return node.index == 1u;
+}
+
+Node node_parent(Node node)
+{
+  return node_is_null(node) ? node : Node{.index = node.index >> 1, .depth = node.depth - 1};
+}
+
+Node node_sibling(Node node)
+{
+  return node_is_null(node) ? node : Node{.index = node.index ^ 1u, .depth = node.depth};
+}
+
+Node node_left_sibling(Node node)
+{
+  return node_is_null(node) ? node : Node{.index = node.index & (~1u), .depth = node.depth};
+}
+
+Node node_right_sibling(Node node)
+{
+  return node_is_null(node) ? node : Node{.index = node.index | 1u, .depth = node.depth};
+}
+
+Node node_left_child(Node node)
+{
+  return node_is_null(node) ? node : Node{.index = node.index << 1, .depth = node.depth + 1};
+}
+
+Node node_right_child(Node node)
+{
+  return node_is_null(node) ? node
+                            : Node{.index = (node.index << 1) | 1u, .depth = node.depth + 1};
+}
+
+std::vector<ReductionDispatch> reduction_dispatches(std::int32_t max_depth)
+{
+  // see cbt_reduction_prepass.comp and cbt_sum_reduction.comp
+  constexpr std::int32_t wordLevels = 5;
+  constexpr std::int32_t sharedLevels = 8;
+  constexpr std::int32_t maxLevels = 12;
+
+  std::int32_t prepassSharedLevels = std::min(sharedLevels, max_depth - wordLevels);
+  std::int32_t depth = max_depth - wordLevels - prepassSharedLevels;
+
+  std::vector<ReductionDispatch> dispatches = {
+    {.sourceDepth = max_depth,
+     .levels = wordLevels + prepassSharedLevels,
+     .groupCount = 1u << depth}};
+
+  while (depth > 0)
+  {
+    std::int32_t levels = std::min(maxLevels, depth);
+    dispatches.push_back(
+      {.sourceDepth = depth, .levels = levels, .groupCount = 1u << (depth - levels)});
+    depth -= levels;
+  }
+
+  return dispatches;
+}
+
+Heap::Heap(std::int32_t max_depth)
+  : maxDepth(max_depth)
+{
+  // same limits as CBTree
+  if (max_depth < 5 || max_depth > 29)
+  {
+    throw std::invalid_argument("CBT depth should be from 5 to 29");
+  }
+
+  // 1 << (max_depth - 1) bytes
+  words.assign(std::size_t{1} << (max_depth - 3), 0u);
+  words[0] = 1u << max_depth; // max_depth = findLSB(heap[0]);
+}
+
+std::uint32_t Heap::bitIndex(Node node) const
+{
+  std::uint32_t bitsAmount = static_cast<std::uint32_t>(bitSize(node));
+  std::uint32_t level = 2u << node.depth;
+  return level + node.index * bitsAmount;
+}
+
+Node Heap::deepestLeaf(Node node) const
+{
+  return node_is_null(node)
+    ? node
+    : Node{.index = node.index << (maxDepth - node.depth), .depth = maxDepth};
+}
+
+// needed when bit range is overlapping two words
+Heap::QueryArgs Heap::queryArgs(Node node, std::int32_t bit_count) const
+{
+  std::uint32_t nodeIndexLSB = bitIndex(node);
+  std::uint32_t maxWordIndex = static_cast<std::uint32_t>(words.size()) - 1u;
+  std::uint32_t wordIndexLeft = nodeIndexLSB >> 5u;
+  std::uint32_t wordIndexRight = std::min(wordIndexLeft + 1u, maxWordIndex);
+
+  std::uint32_t bitOffsetLeft = nodeIndexLSB & 31u;
+  std::uint32_t bitCountLeft = std::min(32u - bitOffsetLeft, static_cast<std::uint32_t>(bit_count));
+  std::uint32_t bitCountRight = static_cast<std::uint32_t>(bit_count) - bitCountLeft;
+
+  return {
+    .wordIndexLeft = wordIndexLeft,
+    .wordIndexRight = wordIndexRight,
+    .bitOffsetLeft = bitOffsetLeft,
+    .bitCountLeft = bitCountLeft,
+    .bitCountRight = bitCountRight};
+}
+
+std::uint32_t Heap::readDirect(Node node, std::int32_t bit_count) const
+{
+  QueryArgs args = queryArgs(node, bit_count);
+
+  std::uint32_t leftSideBits =
+    get_bit_range(words[args.wordIndexLeft], args.bitOffsetLeft, args.bitCountLeft);
+  std::uint32_t rightSideBits = get_bit_range(words[args.wordIndexRight], 0u, args.bitCountRight);
+
+  return leftSideBits | (rightSideBits << args.bitCountLeft);
+}
+
+void Heap::writeDirect(Node node, std::int32_t bit_count, std::uint32_t bit_data)
+{
+  QueryArgs args = queryArgs(node, bit_count);
+
+  set_bit_range(words[args.wordIndexLeft], args.bitOffsetLeft, args.bitCountLeft, bit_data);
+  set_bit_range(
+    words[args.wordIndexRight], 0u, args.bitCountRight, bit_data >> args.bitCountLeft);
+}
+
+std::uint32_t Heap::read(Node node) const
+{
+  return readDirect(node, bitSize(node));
+}
+
+void Heap::write(Node node, std::uint32_t value)
+{
+  writeDirect(node, bitSize(node), value);
+}
+
+std::uint32_t Heap::readBitfield(Node node) const
+{
+  std::uint32_t index = bitIndex(deepestLeaf(node));
+  return get_bit(words[index >> 5u], static_cast<std::int32_t>(index & 31u));
+}
+
+void Heap::writeBitfield(Node node, std::uint32_t bit_value)
+{
+  std::uint32_t index = bitIndex(deepestLeaf(node));
+  if (get_bit(words[index >> 5u], static_cast<std::int32_t>(index & 31u)) != bit_value)
+  {
+    set_bit_range(words[index >> 5u], index & 31u, 1u, bit_value);
+    words[0] |= dirtyMask();
+  }
+}
+
+void Heap::split(Node node)
+{
+  if (!isDeepestLeaf(node))
+  {
+    writeBitfield(node_right_child(node), 1u);
+  }
+}
+
+void Heap::merge(Node node)
+{
+  if (!node_is_root(node))
+  {
+    writeBitfield(node_right_sibling(node), 0u);
+  }
+}
+
+std::uint32_t Heap::encode(Node node) const
+{
+  std::uint32_t nodeCode = 0u;
+  Node nodeIter = node;
+  while (nodeIter.index > 1u)
+  {
+    std::uint32_t nodeCount = read(node_left_sibling(nodeIter));
+
+    nodeCode += (nodeIter.index & 1u) * nodeCount;
+    nodeIter = node_parent(nodeIter);
+  }
+
+  return nodeCode;
+}
+
+Node Heap::decode(std::uint32_t node_code) const
+{
+  Node node = {.index = 1u, .depth = 0};
+
+  while (read(node) > 1u)
+  {
+    Node leftChild = node_left_child(node);
+    std::uint32_t leftChildCount = read(leftChild);
+    std::uint32_t goingRightBit = node_code < leftChildCount ? 0u : 1u;
+
+    node = leftChild;
+    node.index |= goingRightBit;
+    node_code -= leftChildCount * goingRightBit;
+  }
+
+  return node;
+}
+
+void Heap::reductionStep(std::int32_t depth)
+{
+  std::uint32_t amount = 1u << depth;
+
+  for (std::uint32_t index = 0; index < amount; index++)
+  {
+    std::uint32_t nodeIndex = index + amount;
+    std::uint32_t left = read({.index = nodeIndex << 1u, .depth = depth + 1});
+    std::uint32_t right = read({.index = (nodeIndex << 1u) | 1u, .depth = depth + 1});
+
+    write({.index = nodeIndex, .depth = depth}, left + right);
+  }
+}
+
+void Heap::prepassWord(std::uint32_t leaf_index, bool write_word_sum)
+{
+  constexpr std::uint32_t twoBitMask = 0x55555555u;
+  constexpr std::uint32_t threeBitMask = 0x33333333u;
+  constexpr std::uint32_t fourBitMask = 0x0F0F0F0Fu;
+  constexpr std::uint32_t fiveBitMask = 0x00FF00FFu;
+  constexpr std::uint32_t sixBitMask = 0x0000FFFFu;
+
+  std::uint32_t amount = 1u << maxDepth;
+  std::uint32_t nodeIndex = leaf_index + amount;
+  std::uint32_t firstIndex = bitIndex({.index = nodeIndex, .depth = maxDepth});
+  std::uint32_t bitField = words[firstIndex >> 5u];
+  std::uint32_t bitData = 0u;
+
+  // 2 bits
+  bitField = (bitField & twoBitMask) + ((bitField >> 1u) & twoBitMask);
+  bitData = bitField;
+  words[(firstIndex - amount) >> 5u] = bitData;
+
+  // 3 bits
+  bitField = (bitField & threeBitMask) + ((bitField >> 2u) & threeBitMask);
+  bitData = ((bitField >> 0u) & (7u << 0u)) | ((bitField >> 1u) & (7u << 3u)) |
+    ((bitField >> 2u) & (7u << 6u)) | ((bitField >> 3u) & (7u << 9u)) |
+    ((bitField >> 4u) & (7u << 12u)) | ((bitField >> 5u) & (7u << 15u)) |
+    ((bitField >> 6u) & (7u << 18u)) | ((bitField >> 7u) & (7u << 21u));
+
+  writeDirect({.index = nodeIndex >> 2u, .depth = maxDepth - 2}, 24, bitData);
+
+  // 4 bits
+  bitField = (bitField & fourBitMask) + ((bitField >> 4u) & fourBitMask);
+  bitData = ((bitField >> 0u) & (15u << 0u)) | ((bitField >> 4u) & (15u << 4u)) |
+    ((bitField >> 8u) & (15u << 8u)) | ((bitField >> 12u) & (15u << 12u));
+
+  writeDirect({.index = nodeIndex >> 3u, .depth = maxDepth - 3}, 16, bitData);
+
+  // 5 bits
+  bitField = (bitField & fiveBitMask) + ((bitField >> 8u) & fiveBitMask);
+  bitData = ((bitField >> 0u) & (31u << 0u)) | ((bitField >> 11u) & (31u << 5u));
+
+  writeDirect({.index = nodeIndex >> 4u, .depth = maxDepth - 4}, 10, bitData);
+
+  if (write_word_sum)
+  {
+    // 6 bits
+    bitField = (bitField & sixBitMask) + ((bitField >> 16u) & sixBitMask);
+    bitData = bitField;
+
+    writeDirect({.index = nodeIndex >> 5u, .depth = maxDepth - 5}, 6, bitData);
+  }
+}
+
+void Heap::reductNaive()
+{
+  for (std::int32_t depth = maxDepth - 1; depth >= 0; depth--)
+  {
+    reductionStep(depth);
+  }
+
+  words[0] &= ~dirtyMask();
+}
+
+void Heap::reduct()
+{
+  for (const ReductionDispatch& dispatch : reduction_dispatches(maxDepth))
+  {
+    std::int32_t firstStepDepth = dispatch.sourceDepth - 1;
+    if (dispatch.sourceDepth == maxDepth)
+    {
+      std::uint32_t amount = 1u << maxDepth;
+      for (std::uint32_t index = 0; index < amount; index += 32u)
+      {
+        prepassWord(index, true);
+      }
+      firstStepDepth = maxDepth - 6;
+    }
+
+    // order inside of a group does not change sums
+    for (std::int32_t depth = firstStepDepth; depth >= dispatch.sourceDepth - dispatch.levels;
+         depth--)
+    {
+      reductionStep(depth);
+    }
+  }
+
+  words[0] &= ~dirtyMask();
+}
+
+void Heap::reductPopcount()
+{
+  std::uint32_t amount = 1u << maxDepth;
+  std::uint32_t wordsAmount = amount >> 5u;
+  std::uint32_t firstLeafWord = bitIndex({.index = amount, .depth = maxDepth}) >> 5u;
+
+  // leaves of a node 5 levels up fill exactly one word
+  std::vector<std::uint32_t> sums(wordsAmount);
+  std::transform(
+    words.begin() + firstLeafWord,
+    words.begin() + firstLeafWord + wordsAmount,
+    sums.begin(),
+    [](std::uint32_t word) { return static_cast<std::uint32_t>(std::popcount(word)); });
+
+  for (std::uint32_t index = 0; index < amount; index += 32u)
+  {
+    prepassWord(index, false);
+  }
+
+  std::uint32_t nodesAmount = wordsAmount;
+  for (std::int32_t depth = maxDepth - 5; depth >= 0; depth--)
+  {
+    for (std::uint32_t i = 0; i < nodesAmount; i++)
+    {
+      write({.index = nodesAmount + i, .depth = depth}, sums[i]);
+    }
+
+    nodesAmount >>= 1u;
+    for (std::uint32_t i = 0; i < nodesAmount; i++)
+    {
+      sums[i] = sums[2 * i] + sums[2 * i + 1];
+    }
+  }
+
+  words[0] &= ~dirtyMask();
+}
+
+// ----- LEB square -----
+
+static SameDepthNeighbours split_indices(SameDepthNeighbours node_indices, std::uint32_t path_bit)
+{
+  std::uint32_t siblingPathBit = path_bit ^ 1u;
+  bool siblingPathTaken = siblingPathBit != 0u;
+  std::array<std::uint32_t, 4> indices = {
+    node_indices.left, node_indices.right, node_indices.longestEdge, node_indices.node};
+
+  auto child = [&](std::uint32_t index) {
+    return (index << 1u) | static_cast<std::uint32_t>(siblingPathTaken && index != 0u);
+  };
+
+  return {
+    .left = child(indices[2 + path_bit]),
+    .right = child(indices[2 + siblingPathBit]),
+    .longestEdge = child(indices[path_bit]),
+    .node = (indices[3] << 1u) | path_bit};
+}
+
+SameDepthNeighbours leb_square_decode_same_depth_neighbours(Node node)
+{
+  std::uint32_t isSecondTriangle = get_bit(node.index, std::max(0, node.depth - 1));
+  SameDepthNeighbours indices = {
+    .left = 0u,
+    .right = 0u,
+    .longestEdge = 3u - isSecondTriangle,
+    .node = 2u + isSecondTriangle};
+
+  for (std::int32_t bitIndex = node.depth - 2; bitIndex >= 0; bitIndex--)
+  {
+    // traversing path from root to node
+    indices = split_indices(indices, get_bit(node.index, bitIndex));
+  }
+
+  return indices;
+}
+
+static Node square_edge_neighbour(Node node)
+{
+  std::uint32_t nodeIndex = leb_square_decode_same_depth_neighbours(node).longestEdge;
+
+  return {.index = nodeIndex, .depth = (nodeIndex == 0u) ? 0 : node.depth};
+}
+
+DiamondParent leb_square_diamond_parent_decode(Node node)
+{
+  Node parent = {.index = node.index >> 1, .depth = node.depth - 1};
+  std::uint32_t longestEdgeNeighbourIndex =
+    leb_square_decode_same_depth_neighbours(parent).longestEdge;
+  Node longestEdgeNeighbourNode = {
+    .index = longestEdgeNeighbourIndex > 0u ? longestEdgeNeighbourIndex : parent.index,
+    .depth = parent.depth};
+
+  return {.bottom = parent, .top = longestEdgeNeighbourNode};
+}
+
+void leb_square_split(Heap& heap, Node node)
+{
+  if (heap.isDeepestLeaf(node))
+  {
+    return;
+  }
+
+  Node nodeIterator = node;
+  heap.split(nodeIterator);
+  nodeIterator = square_edge_neighbour(nodeIterator);
+
+  while (nodeIterator.index > 1u)
+  {
+    heap.split(nodeIterator);
+    nodeIterator = {.index = nodeIterator.index >> 1, .depth = nodeIterator.depth - 1};
+    if (nodeIterator.index > 1u)
+    {
+      heap.split(nodeIterator);
+      nodeIterator = square_edge_neighbour(nodeIterator);
+    }
+  }
+}
+
+std::uint32_t leb_square_split_cost(const Heap& heap, Node node)
+{
+  if (heap.isDeepestLeaf(node))
+  {
+    return 0u;
+  }
+
+  // a split adds a leaf when the bit it sets is still clear
+  auto splitCost = [&heap](Node split_node) {
+    return heap.isDeepestLeaf(split_node) ? 0u
+                                          : 1u - heap.readBitfield(node_right_child(split_node));
+  };
+
+  Node nodeIterator = node;
+  std::uint32_t cost = splitCost(nodeIterator);
+  nodeIterator = square_edge_neighbour(nodeIterator);
+
+  while (nodeIterator.index > 1u)
+  {
+    cost += splitCost(nodeIterator);
+    nodeIterator = {.index = nodeIterator.index >> 1, .depth = nodeIterator.depth - 1};
+    if (nodeIterator.index > 1u)
+    {
+      cost += splitCost(nodeIterator);
+      nodeIterator = square_edge_neighbour(nodeIterator);
+    }
+  }
+
+  return cost;
+}
+
+void leb_square_merge(Heap& heap, Node node, DiamondParent diamond_parent)
+{
+  bool canMergeTop = heap.read(diamond_parent.top) <= 2u;
+  bool canMergeBottom = heap.read(diamond_parent.bottom) <= 2u;
+
+  if ((node.depth > 1) && canMergeTop && canMergeBottom)
+  {
+    heap.merge(node);
+  }
+}
+
+// same constructors as leb.glsl, glm matrices are column major as GLSL ones
+static glm::mat3 split_matrix(std::uint32_t split_bit)
+{
+  float bit = static_cast<float>(split_bit);
+  float oppositeBit = 1.0f - bit;
+  return glm::transpose(
+    glm::mat3(oppositeBit, bit, 0.0f, 0.5f, 0.0f, 0.5f, 0.0f, oppositeBit, bit));
+}
+
+static glm::mat3 square_matrix(std::uint32_t quad_bit)
+{
+  float bit = static_cast<float>(quad_bit);
+  float oppositeBit = 1.0f - bit;
+
+  return glm::transpose(
+    glm::mat3(oppositeBit, 0.0f, bit, bit, oppositeBit, bit, bit, 0.0f, oppositeBit));
+}
+
+static glm::mat3 mirror_matrix(std::uint32_t mirror_bit)
+{
+  float bit = static_cast<float>(mirror_bit);
+  float oppositeBit = 1.0f - bit;
+
+  return glm::mat3(oppositeBit, 0.0f, bit, 0.0f, 1.0f, 0.0f, bit, 0.0f, oppositeBit);
+}
+
+glm::mat3 leb_square_decode_transformation(Node node)
+{
+  std::uint32_t isSecondTriangle = get_bit(node.index, std::max(0, node.depth - 1));
+
+  glm::mat3 transform = square_matrix(isSecondTriangle);
+
+  for (std::int32_t bitIndex = node.depth - 2; bitIndex >= 0; bitIndex--)
+  {
+    transform = split_matrix(get_bit(node.index, bitIndex)) * transform;
+  }
+
+  return mirror_matrix(static_cast<std::uint32_t>((node.depth ^ 1) & 1)) * transform;
+}
+
+const std::array<glm::mat3, 1u << kLebSplitTableBits>& leb_split_table()
+{
+  static const std::array<glm::mat3, 1u << kLebSplitTableBits> table = []() {
+    std::array<glm::mat3, 1u << kLebSplitTableBits> result;
+    for (std::uint32_t entry = 0; entry < result.size(); entry++)
+    {
+      result[entry] = glm::mat3(1.0f);
+      for (std::int32_t bitIndex = kLebSplitTableBits - 1; bitIndex >= 0; bitIndex--)
+      {
+        result[entry] = split_matrix(get_bit(entry, bitIndex)) * result[entry];
+      }
+    }
+    return result;
+  }();
+
+  return table;
+}
+
+glm::mat3 leb_square_decode_transformation_table(std::uint64_t heap_index, std::int32_t depth)
+{
+  auto getBit = [heap_index](std::int32_t bit_index) {
+    return static_cast<std::uint32_t>((heap_index >> bit_index) & 1u);
+  };
+
+  std::uint32_t isSecondTriangle = getBit(std::max(0, depth - 1));
+
+  glm::mat3 transform = square_matrix(isSecondTriangle);
+
+  // bits that do not fill a whole table entry go first, one at a time
+  std::int32_t splitBits = std::max(0, depth - 1);
+  std::int32_t tableBitIndex = splitBits - splitBits % kLebSplitTableBits;
+  for (std::int32_t bitIndex = splitBits - 1; bitIndex >= tableBitIndex; bitIndex--)
+  {
+    transform = split_matrix(getBit(bitIndex)) * transform;
+  }
+
+  const auto& table = leb_split_table();
+  constexpr std::uint64_t kTableEntryMask = (1u << kLebSplitTableBits) - 1u;
+  for (tableBitIndex -= kLebSplitTableBits; tableBitIndex >= 0;
+       tableBitIndex -= kLebSplitTableBits)
+  {
+    transform = table[(heap_index >> tableBitIndex) & kTableEntryMask] * transform;
+  }
+
+  return mirror_matrix(static_cast<std::uint32_t>((depth ^ 1) & 1)) * transform;
+}
+
+glm::mat3 leb_square_decode_transformation_table(Node node)
+{
+  return leb_square_decode_transformation_table(node.index, node.depth);
+}
+
+glm::vec3 leb_square_decode_attribute(Node node, glm::vec3 data)
+{
+  return leb_square_decode_transformation_table(node) * data;
+}
+
+glm::mat2x3 leb_square_decode_attribute(Node node, glm::mat2x3 data)
+{
+  return leb_square_decode_transformation_table(node) * data;
+}
+
+} // namespace cbt_reference
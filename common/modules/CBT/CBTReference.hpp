@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// CPU mirror of subdivision/cbt.glsl and subdivision/leb.glsl. Heap has the same bit layout as
+// the GPU buffer, so it can be uploaded as is or compared against a read back one bit for bit.
+// Nothing here needs a device, so it also works for offline subdivision and profiling
+namespace cbt_reference
+{
+
+struct Node
+{
+  std::uint32_t index; // heap index
+  std::int32_t depth;  // aka most significant bit in heap index
+
+  bool operator==(const Node&) const = default;
+};
+
+Node node_get(std::uint32_t heap_index);
+bool node_is_null(Node node);
+bool node_is_root(Node node);
+
+Node node_parent(Node node);
+Node node_sibling(Node node);
+Node node_left_sibling(Node node);
+Node node_right_sibling(Node node);
+Node node_left_child(Node node);
+Node node_right_child(Node node);
+
+// One dispatch of the fused reduction, sums levels from source depth up. The first one is
+// cbt_reduction_prepass.comp with source depth equal to max depth, the rest are
+// cbt_sum_reduction.comp, every group of them sums a whole subtree. CBTree records every
+// dispatch once for all of its trees, with a row of group count groups per tree
+struct ReductionDispatch
+{
+  std::int32_t sourceDepth;
+  std::int32_t levels;
+  std::uint32_t groupCount;
+};
+
+// Two dispatches up to depth 25, three for deeper trees
+std::vector<ReductionDispatch> reduction_dispatches(std::int32_t max_depth);
+
+class Heap
+{
+public:
+  // Empty heap, only the max depth bit of the first word is set
+  explicit Heap(std::int32_t max_depth);
+
+  std::int32_t getMaxDepth() const { return maxDepth; }
+  std::span<const std::uint32_t> getWords() const { return words; }
+  std::size_t getByteSize() const { return words.size() * sizeof(std::uint32_t); }
+
+  std::uint32_t read(Node node) const;
+  void write(Node node, std::uint32_t value);
+  // Bit of the deepest leaf under node, the only data split and merge write
+  std::uint32_t readBitfield(Node node) const;
+  void writeBitfield(Node node, std::uint32_t bit_value);
+
+  std::uint32_t nodeCount() const { return read({.index = 1u, .depth = 0}); }
+  // Set when split or merge change the tree, cleared by the reductions
+  bool isDirty() const { return (words[0] & dirtyMask()) != 0u; }
+  bool isLeaf(Node node) const { return read(node) == 1u; }
+  bool isDeepestLeaf(Node node) const { return node.depth == maxDepth; }
+
+  // Counts are stale after these until one of the reductions
+  void split(Node node);
+  void merge(Node node);
+
+  // Node code is the index of a leaf among all leaves, O(depth)
+  std::uint32_t encode(Node node) const;
+  Node decode(std::uint32_t node_code) const;
+
+  // cbt_sum_reduction.comp for every depth, one node at a time
+  void reductNaive();
+  // Dispatches of reduction_dispatches in order, as CBTree::reduct records them
+  void reduct();
+  // Popcounts of leaf words summed in a plain array, every depth is written into the heap once
+  void reductPopcount();
+
+private:
+  struct QueryArgs
+  {
+    std::uint32_t wordIndexLeft;
+    std::uint32_t wordIndexRight;
+    std::uint32_t bitOffsetLeft;
+    std::uint32_t bitCountLeft;
+    std::uint32_t bitCountRight;
+  };
+
+private:
+  std::uint32_t dirtyMask() const { return 2u << maxDepth; }
+  std::uint32_t bitIndex(Node node) const;
+  std::int32_t bitSize(Node node) const { return maxDepth - node.depth + 1; }
+  Node deepestLeaf(Node node) const;
+
+  QueryArgs queryArgs(Node node, std::int32_t bit_count) const;
+  std::uint32_t readDirect(Node node, std::int32_t bit_count) const;
+  void writeDirect(Node node, std::int32_t bit_count, std::uint32_t bit_data);
+
+  // packs sums of 2, 4, 8, 16 and optionally 32 leaves of one leaf word
+  void prepassWord(std::uint32_t leaf_index, bool write_word_sum);
+  void reductionStep(std::int32_t depth);
+
+private:
+  std::int32_t maxDepth;
+  std::vector<std::uint32_t> words;
+};
+
+struct SameDepthNeighbours
+{
+  std::uint32_t left;
+  std::uint32_t right;
+  std::uint32_t longestEdge;
+  std::uint32_t node;
+};
+
+struct DiamondParent
+{
+  Node bottom;
+  Node top;
+};
+
+// Square domain made of two root triangles, nodes 2 and 3 at depth 1, as CBT terrain uses it
+SameDepthNeighbours leb_square_decode_same_depth_neighbours(Node node);
+DiamondParent leb_square_diamond_parent_decode(Node node);
+
+// Conforming split and merge, counts are stale after these until one of the reductions
+void leb_square_split(Heap& heap, Node node);
+void leb_square_merge(Heap& heap, Node node, DiamondParent diamond_parent);
+// Leaves leb_square_split would add, a leaf per split bit it sets
+std::uint32_t leb_square_split_cost(const Heap& heap, Node node);
+
+// Split matrices of this many consecutive heap index bits multiplied together, entry i consumes
+// the bits of i from the highest one. leb.glsl has the same table as constants
+inline constexpr std::int32_t kLebSplitTableBits = 4;
+const std::array<glm::mat3, 1u << kLebSplitTableBits>& leb_split_table();
+
+// Maps attributes of the base triangle vertices to the ones of node vertices, a matrix product
+// per heap index bit
+glm::mat3 leb_square_decode_transformation(Node node);
+// Same as above with a table entry per kLebSplitTableBits bits, as leb.glsl decodes. Entries are
+// dyadic, so both match exactly for any depth a heap can have
+glm::mat3 leb_square_decode_transformation_table(Node node);
+// Heap index of up to 64 bits, for subdivisions without a heap, see BisectorPool
+glm::mat3 leb_square_decode_transformation_table(std::uint64_t heap_index, std::int32_t depth);
+glm::vec3 leb_square_decode_attribute(Node node, glm::vec3 data);
+glm::mat2x3 leb_square_decode_attribute(Node node, glm::mat2x3 data);
+
+} // namespace cbt_reference
@@ -13,41 +13,20 @@ std::int32_t CBTree::heapByteSize(std::int32_t max_depth)
   return 1 << (max_depth - 1);
 }
 
-CBTree::Node CBTree::getDeepestLeaf(Node node)
-{
-  Node leaf = {
-    .index = static_cast<uint32_t>(node.index << (maxDepth - node.depth)),
-    .depth = maxDepth,
-  };
-  return (node.index == 0) ? node : leaf;
-}
-
-void CBTree::setBit(std::uint32_t* bit_field, std::uint32_t bit_index, std::uint32_t bit_value)
-{
-  std::uint32_t bitMask = ~(1u << bit_index);
-
-  (*bit_field) &= bitMask;
-  (*bit_field) |= (bit_value << bit_index);
-}
-
-void CBTree::heapWriteBitfield(std::uint32_t* heap, CBTree::Node node, std::uint32_t bit_value)
-{
-  Node leaf = getDeepestLeaf(node);
-
-  // getBitIndexLeaf
-  std::int32_t level = 2 << leaf.depth;
-  std::int32_t bitsAmount = maxDepth - leaf.depth + 1;
-  std::int32_t bitIndex = level + leaf.index * bitsAmount;
-
-  // SetBit
-  setBit(&heap[bitIndex >> 5], bitIndex & 31, bit_value);
-}
-
-CBTree::CBTree(std::int32_t max_depth)
+CBTree::CBTree(std::int32_t max_depth, std::uint32_t tree_count)
   : maxDepth(max_depth)
+  , treeCount(tree_count)
 {
   ETNA_VERIFYF(max_depth >= 5, "Minimum depth is 5");
   ETNA_VERIFYF(max_depth <= 29, "Maximum depth is 29");
+  // heaps are uploaded with 32 bit offsets
+  ETNA_VERIFYF(
+    tree_count > 0 && (static_cast<std::uint64_t>(tree_count) << (max_depth - 1)) <= (1ull << 32),
+    "Tree count {} does not fit into a buffer of depth {} trees",
+    tree_count,
+    max_depth);
+
+  reductionDispatches = cbt_reference::reduction_dispatches(maxDepth);
 }
 
 void CBTree::allocateResources()
@@ -57,7 +36,7 @@ void CBTree::allocateResources()
 
   cbtBuffer = ctx.createBuffer(
     etna::Buffer::CreateInfo{
-      .size = static_cast<vk::DeviceSize>(heapByteSize(maxDepth)),
+      .size = static_cast<vk::DeviceSize>(heapByteSize(maxDepth)) * treeCount,
       .bufferUsage =
         vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
       .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
@@ -65,12 +44,21 @@ void CBTree::allocateResources()
 
   cbtDrawIndirectBuffer = ctx.createBuffer(
     etna::Buffer::CreateInfo{
-      .size = sizeof(vk::DrawIndirectCommand),
+      .size = sizeof(vk::DrawIndirectCommand) * treeCount,
       .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
-        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst |
+        vk::BufferUsageFlagBits::eTransferSrc,
       .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
       .name = "cbtDrawIndirectBuffer"});
 
+  cbtDispatchIndirectBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(vk::DispatchIndirectCommand) * treeCount,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "cbtDispatchIndirectBuffer"});
+
   oneShotCommands = ctx.createOneShotCmdMgr();
 }
 
@@ -99,29 +87,39 @@ void CBTree::load()
       .stagingSize = static_cast<vk::DeviceSize>(heapByteSize(maxDepth))});
 
   {
-    std::uint32_t* data = reinterpret_cast<std::uint32_t*>(
-      std::calloc(heapByteSize(maxDepth) >> 2, sizeof(std::uint32_t)));
-
-    data[0] = 1u << maxDepth; // max_depth = findLSB(heap[0]);
+    cbt_reference::Heap heap(maxDepth);
 
     std::uint32_t firstTriangle = 2u;
     std::uint32_t secondTriangle = 3u;
 
-    heapWriteBitfield(data, {.index = firstTriangle, .depth = 1}, 1u);
-    heapWriteBitfield(data, {.index = secondTriangle, .depth = 1}, 1u);
+    heap.writeBitfield({.index = firstTriangle, .depth = 1}, 1u);
+    heap.writeBitfield({.index = secondTriangle, .depth = 1}, 1u);
 
-    transferHelper->uploadBuffer(
-      *oneShotCommands, cbtBuffer, 0, std::as_bytes(std::span(data, heapByteSize(maxDepth) >> 2)));
-
-    std::free(data);
+    // every tree starts from the same two triangles
+    for (std::uint32_t tree = 0; tree < treeCount; tree++)
+    {
+      transferHelper->uploadBuffer(
+        *oneShotCommands,
+        cbtBuffer,
+        static_cast<std::uint32_t>(tree * heap.getByteSize()),
+        std::as_bytes(heap.getWords()));
+    }
   }
 
-  std::vector<vk::DrawIndirectCommand> command = {
-    {.vertexCount = 2, .instanceCount = 1, .firstVertex = 0, .firstInstance = 0}};
+  std::vector<vk::DrawIndirectCommand> command(treeCount);
+  for (std::uint32_t tree = 0; tree < treeCount; tree++)
+  {
+    command[tree] = {.vertexCount = 2, .instanceCount = 1, .firstVertex = 0, .firstInstance = tree};
+  }
 
   transferHelper->uploadBuffer(
     *oneShotCommands, cbtDrawIndirectBuffer, 0, std::as_bytes(std::span(command)));
 
+  std::vector<vk::DispatchIndirectCommand> dispatchCommand(treeCount, {.x = 1, .y = 1, .z = 1});
+
+  transferHelper->uploadBuffer(
+    *oneShotCommands, cbtDispatchIndirectBuffer, 0, std::as_bytes(std::span(dispatchCommand)));
+
 
   auto commandBuffer = oneShotCommands->start();
   ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
@@ -141,7 +139,8 @@ void CBTree::prepareIndirect(vk::CommandBuffer cmd_buf)
     shaderInfo.getDescriptorLayoutId(0 /*check cbt.glsl*/),
     cmd_buf,
     {etna::Binding{0 /*check cbt.glsl*/, cbtBuffer.genBinding()},
-     etna::Binding{1, cbtDrawIndirectBuffer.genBinding()}});
+     etna::Binding{1, cbtDrawIndirectBuffer.genBinding()},
+     etna::Binding{2, cbtDispatchIndirectBuffer.genBinding()}});
 
   auto vkSet = set.getVkSet();
 
@@ -154,26 +153,79 @@ void CBTree::prepareIndirect(vk::CommandBuffer cmd_buf)
     {vkSet},
     {});
 
-  cmd_buf.dispatch(1, 1, 1);
+  // see cbt_prepare_indirect.comp
+  cmd_buf.dispatch((treeCount + 63) / 64, 1, 1);
 }
 
 void CBTree::reduct(vk::CommandBuffer cmd_buf)
 {
   ZoneScoped;
 
+  for (std::size_t i = 0; i < reductionDispatches.size(); i++)
   {
-    ETNA_PROFILE_GPU(cmd_buf, reductionPrepass)
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eCompute, cbtReductionPrepassPipeline.getVkPipeline());
-    reductionPrepass(cmd_buf, cbtReductionPrepassPipeline.getVkPipelineLayout());
+    bool last = i + 1 == reductionDispatches.size();
+    if (i == 0)
+    {
+      reductionDispatch(
+        cmd_buf, cbtReductionPrepassPipeline, "reduction_prepass", reductionDispatches[i], last);
+    }
+    else
+    {
+      reductionDispatch(
+        cmd_buf, cbtReductionPipeline, "reduction_step", reductionDispatches[i], last);
+    }
+
+    {
+      std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask =
+          vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+        .buffer = cbtBuffer.get(),
+        .size = vk::WholeSize}};
+
+      vk::DependencyInfo dependencyInfo = {
+        .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+        .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+        .pBufferMemoryBarriers = bufferBarriers.data()};
+
+      cmd_buf.pipelineBarrier2(dependencyInfo);
+    }
   }
+}
+
+void CBTree::beginUpdate(vk::CommandBuffer cmd_buf)
+{
+  std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+    .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader |
+      vk::PipelineStageFlagBits2::eTessellationControlShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask =
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    .buffer = cbtBuffer.get(),
+    .size = vk::WholeSize}};
+
+  vk::DependencyInfo dependencyInfo = {
+    .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+    .pBufferMemoryBarriers = bufferBarriers.data()};
+
+  cmd_buf.pipelineBarrier2(dependencyInfo);
+}
+
+void CBTree::endUpdatePass(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
 
   {
     std::array bufferBarriers = {vk::BufferMemoryBarrier2{
       .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
       .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
       .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
       .buffer = cbtBuffer.get(),
       .size = vk::WholeSize}};
 
@@ -185,73 +237,103 @@ void CBTree::reduct(vk::CommandBuffer cmd_buf)
     cmd_buf.pipelineBarrier2(dependencyInfo);
   }
 
-  for (std::int32_t i = (maxDepth - 5) - 1; i >= 0; i--)
-  {
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cbtReductionPipeline.getVkPipeline());
-    reductionStep(cmd_buf, cbtReductionPipeline.getVkPipelineLayout(), i);
+  reduct(cmd_buf);
 
-    {
-      std::array bufferBarriers = {vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
         .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-        .buffer = cbtBuffer.get(),
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = cbtDrawIndirectBuffer.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = cbtDispatchIndirectBuffer.get(),
         .size = vk::WholeSize}};
 
-      vk::DependencyInfo dependencyInfo = {
-        .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-        .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-        .pBufferMemoryBarriers = bufferBarriers.data()};
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
 
-      cmd_buf.pipelineBarrier2(dependencyInfo);
-    }
+    cmd_buf.pipelineBarrier2(dependencyInfo);
   }
-}
 
-void CBTree::reductionPrepass(vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout)
-{
-  ZoneScoped;
-
-  std::int32_t amount = ((1 << maxDepth) >> 5);
-  std::int32_t groupCount = (amount >= 256) ? (amount >> 8) : 1;
-
-  auto shaderInfo = etna::get_shader_program("reduction_prepass");
-  auto set = etna::create_descriptor_set(
-    shaderInfo.getDescriptorLayoutId(0 /*check cbt.glsl*/),
-    cmd_buf,
-    {etna::Binding{0 /*check cbt.glsl*/, cbtBuffer.genBinding()}});
-
-  auto vkSet = set.getVkSet();
+  prepareIndirect(cmd_buf);
 
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline_layout, 0, {vkSet}, {});
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .buffer = cbtDrawIndirectBuffer.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .buffer = cbtDispatchIndirectBuffer.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask =
+          vk::PipelineStageFlagBits2::eComputeShader |
+          vk::PipelineStageFlagBits2::eVertexShader |
+          vk::PipelineStageFlagBits2::eTessellationControlShader,
+        .dstAccessMask =
+          vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+        .buffer = cbtBuffer.get(),
+        .size = vk::WholeSize}};
 
-  cmd_buf.pushConstants<std::int32_t>(
-    pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, {maxDepth});
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
 
-  cmd_buf.dispatch(static_cast<uint32_t>(groupCount), 1, 1);
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
 }
 
-void CBTree::reductionStep(
-  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, std::int32_t depth)
+void CBTree::reductionDispatch(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program_name,
+  const cbt_reference::ReductionDispatch& dispatch,
+  bool last)
 {
   ZoneScoped;
 
-  std::int32_t amount = 1 << depth;
-  std::int32_t groupCount = (amount >= 256) ? (amount >> 8) : 1;
-
-  auto shaderInfo = etna::get_shader_program("reduction_step");
+  auto shaderInfo = etna::get_shader_program(program_name);
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0 /*check cbt.glsl*/),
     cmd_buf,
     {etna::Binding{0 /*check cbt.glsl*/, cbtBuffer.genBinding()}});
 
   auto vkSet = set.getVkSet();
+  auto pipelineLayout = pipeline.getVkPipelineLayout();
 
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline_layout, 0, {vkSet}, {});
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, {vkSet}, {});
 
-  cmd_buf.pushConstants<std::int32_t>(
-    pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, {depth});
+  // prepass takes levels above word sums only
+  bool prepass = dispatch.sourceDepth == maxDepth;
+  cmd_buf.pushConstants<ReductionPushConstants>(
+    pipelineLayout,
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    {{.depth = dispatch.sourceDepth,
+      .levels = prepass ? dispatch.levels - 5 : dispatch.levels,
+      .clearDirty = last ? 1u : 0u}});
 
-  cmd_buf.dispatch(static_cast<uint32_t>(groupCount), 1, 1);
+  // a row of groups per tree
+  cmd_buf.dispatch(dispatch.groupCount, treeCount, 1);
 }
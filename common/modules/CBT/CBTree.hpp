@@ -4,47 +4,74 @@
 #include <etna/ComputePipeline.hpp>
 #include <etna/OneShotCmdMgr.hpp>
 
+#include "CBTReference.hpp"
 
+
+// One or more trees of the same max depth in one buffer, see cbt.glsl. Every tree has its own
+// indirect commands, reduction and indirect preparation are recorded once for all of them
 class CBTree
 {
 public:
-  explicit CBTree(std::int32_t max_depth);
+  explicit CBTree(std::int32_t max_depth, std::uint32_t tree_count = 1);
 
   void allocateResources();
   void loadShaders();
   void setupPipelines();
   void load();
 
+  // Writes draw command with a patch per leaf and dispatch command with a thread per leaf,
+  // a pair per tree
   void prepareIndirect(vk::CommandBuffer cmd_buf);
+  // Every dispatch returns right away when nothing was split or merged since the last reduction
   void reduct(vk::CommandBuffer cmd_buf);
 
+  // Compute update passes dispatch indirectly over leaves, see getDispatchIndirectBuffer.
+  // Tree is released from the previous frame draw before the first pass
+  void beginUpdate(vk::CommandBuffer cmd_buf);
+  // Reduces the tree and prepares indirect commands after a split or merge pass, so the next
+  // pass and the draw see the updated tree. Split and merge never run in the same pass
+  void endUpdatePass(vk::CommandBuffer cmd_buf);
+
   const etna::Buffer& getCBTBuffer() const { return cbtBuffer; }
   const etna::Buffer& getDrawIndirectBuffer() const { return cbtDrawIndirectBuffer; }
+  const etna::Buffer& getDispatchIndirectBuffer() const { return cbtDispatchIndirectBuffer; }
+  vk::DeviceSize getDrawIndirectOffset(std::uint32_t tree) const
+  {
+    return tree * sizeof(vk::DrawIndirectCommand);
+  }
+  vk::DeviceSize getDispatchIndirectOffset(std::uint32_t tree) const
+  {
+    return tree * sizeof(vk::DispatchIndirectCommand);
+  }
   std::int32_t getMaxDepth() const { return maxDepth; }
+  std::uint32_t getTreeCount() const { return treeCount; }
+
+private:
+  std::int32_t heapByteSize(std::int32_t max_depth);
+
+  void reductionDispatch(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const char* program_name,
+    const cbt_reference::ReductionDispatch& dispatch,
+    bool last);
 
 private:
-  struct Node
+  struct ReductionPushConstants
   {
-    std::uint32_t index;
     std::int32_t depth;
+    std::int32_t levels;
+    std::uint32_t clearDirty;
   };
 
-private:
-  std::int32_t heapByteSize(std::int32_t max_depth);
-  Node getDeepestLeaf(Node node);
-  void setBit(std::uint32_t* bit_field, std::uint32_t bit_index, std::uint32_t bit_value);
-  void heapWriteBitfield(std::uint32_t* heap, Node node, std::uint32_t bit_value);
-
-  void reductionPrepass(
-    vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void reductionStep(
-    vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, std::int32_t depth);
-
 private:
   std::int32_t maxDepth;
+  std::uint32_t treeCount;
+  std::vector<cbt_reference::ReductionDispatch> reductionDispatches;
 
   etna::Buffer cbtBuffer;
   etna::Buffer cbtDrawIndirectBuffer;
+  etna::Buffer cbtDispatchIndirectBuffer;
 
   etna::ComputePipeline cbtReductionPrepassPipeline;
   etna::ComputePipeline cbtReductionPipeline;
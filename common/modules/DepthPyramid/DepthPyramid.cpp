@@ -0,0 +1,193 @@
+#include "DepthPyramid.hpp"
+
+#include <bit>
+#include <cstddef>
+
+#include <tracy/Tracy.hpp>
+#include <imgui.h>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+
+
+// clipmap culling reads the pyramid in compute, CBT subdivision in tessellation control
+static constexpr vk::PipelineStageFlags2 CONSUMER_STAGES =
+  vk::PipelineStageFlagBits2::eComputeShader |
+  vk::PipelineStageFlagBits2::eTessellationControlShader;
+
+DepthPyramid::DepthPyramid()
+  : extent(1, 1)
+  , levels(1)
+  , enabled(true)
+  , headerValid(false)
+{
+}
+
+void DepthPyramid::allocateResources(glm::uvec2 resolution)
+{
+  extent = {std::bit_floor(resolution.x), std::bit_floor(resolution.y)};
+  levels = static_cast<std::uint32_t>(std::bit_width(glm::max(extent.x, extent.y)));
+
+  std::size_t texelsAmount = 0;
+  for (std::uint32_t level = 0; level < levels; level++)
+  {
+    glm::uvec2 size = glm::max(extent >> level, glm::uvec2(1));
+    texelsAmount += size.x * size.y;
+  }
+
+  auto& ctx = etna::get_context();
+
+  pyramidBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(DepthPyramidHeader) + sizeof(float) * texelsAmount,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "depthPyramid"});
+
+  oneShotCommands = ctx.createOneShotCmdMgr();
+
+  // header stays invalid until the first frame is rendered
+  auto commandBuffer = oneShotCommands->start();
+  ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
+  {
+    commandBuffer.fillBuffer(pyramidBuffer.get(), 0, vk::WholeSize, 0);
+  }
+  ETNA_CHECK_VK_RESULT(commandBuffer.end());
+  oneShotCommands->submitAndWait(commandBuffer);
+
+  headerValid = false;
+}
+
+void DepthPyramid::loadShaders()
+{
+  etna::create_program(
+    "depth_pyramid_build", {DEPTH_PYRAMID_MODULE_SHADERS_ROOT "depth_pyramid_build.comp.spv"});
+}
+
+void DepthPyramid::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  buildPipeline = pipelineManager.createComputePipeline("depth_pyramid_build", {});
+}
+
+void DepthPyramid::execute(
+  vk::CommandBuffer cmd_buf, const glm::mat4x4& proj_view, etna::Binding depth_binding)
+{
+  ZoneScoped;
+
+  if (!enabled)
+  {
+    if (headerValid)
+    {
+      barrier(
+        cmd_buf,
+        CONSUMER_STAGES,
+        vk::AccessFlagBits2::eShaderRead,
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite);
+
+      cmd_buf.fillBuffer(
+        pyramidBuffer.get(), offsetof(DepthPyramidHeader, valid), sizeof(std::uint32_t), 0);
+
+      barrier(
+        cmd_buf,
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        CONSUMER_STAGES,
+        vk::AccessFlagBits2::eShaderRead);
+
+      headerValid = false;
+    }
+    return;
+  }
+
+  ETNA_PROFILE_GPU(cmd_buf, buildDepthPyramid);
+
+  // culling of this frame could still read the previous pyramid
+  barrier(
+    cmd_buf,
+    CONSUMER_STAGES,
+    vk::AccessFlagBits2::eShaderRead,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite);
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, buildPipeline.getVkPipeline());
+
+  auto shaderInfo = etna::get_shader_program("depth_pyramid_build");
+  auto set = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {depth_binding, etna::Binding{1, pyramidBuffer.genBinding()}});
+  auto vkSet = set.getVkSet();
+
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    buildPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+
+  for (std::uint32_t level = 0; level < levels; level++)
+  {
+    cmd_buf.pushConstants<PushConstants>(
+      buildPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      {{.projView = proj_view, .extent = extent, .level = level, .levels = levels}});
+
+    glm::uvec2 size = glm::max(extent >> level, glm::uvec2(1));
+    cmd_buf.dispatch((size.x + 7) / 8, (size.y + 7) / 8, 1);
+
+    // next level reads this one, culling of the next frame reads all of them
+    barrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderWrite,
+      CONSUMER_STAGES,
+      vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+  }
+
+  headerValid = true;
+}
+
+void DepthPyramid::drawGui()
+{
+  ImGui::Begin("Application Settings");
+
+  if (ImGui::CollapsingHeader("Occlusion Culling"))
+  {
+    ImGui::Checkbox("Enable Occlusion Culling", &enabled);
+    ImGui::Text("Depth pyramid: %ux%u, %u levels", extent.x, extent.y, levels);
+  }
+
+  ImGui::End();
+}
+
+void DepthPyramid::barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+    .buffer = pyramidBuffer.get(),
+    .size = vk::WholeSize}};
+
+  vk::DependencyInfo dependencyInfo = {
+    .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+    .pBufferMemoryBarriers = bufferBarriers.data()};
+
+  cmd_buf.pipelineBarrier2(dependencyInfo);
+}
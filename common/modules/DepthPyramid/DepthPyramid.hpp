@@ -0,0 +1,58 @@
+#pragma once
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <glm/glm.hpp>
+
+#include "occlusion/DepthPyramid.h"
+
+
+// Max depth pyramid of the last rendered frame, used for occlusion culling in the next one
+class DepthPyramid
+{
+public:
+  DepthPyramid();
+
+  void allocateResources(glm::uvec2 resolution);
+  void loadShaders();
+  void setupPipelines();
+
+  // Depth should be readable in compute shaders, depth_binding is expected to be binding 0
+  void execute(
+    vk::CommandBuffer cmd_buf, const glm::mat4x4& proj_view, etna::Binding depth_binding);
+
+  void drawGui();
+
+  const etna::Buffer& getBuffer() const { return pyramidBuffer; }
+
+private:
+  struct PushConstants
+  {
+    glm::mat4x4 projView;
+    glm::uvec2 extent;
+    std::uint32_t level;
+    std::uint32_t levels;
+  };
+
+  void barrier(
+    vk::CommandBuffer cmd_buf,
+    vk::PipelineStageFlags2 src_stage,
+    vk::AccessFlags2 src_access,
+    vk::PipelineStageFlags2 dst_stage,
+    vk::AccessFlags2 dst_access);
+
+private:
+  glm::uvec2 extent;
+  std::uint32_t levels;
+
+  bool enabled;
+  bool headerValid;
+
+  etna::Buffer pyramidBuffer;
+
+  etna::ComputePipeline buildPipeline;
+
+  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
+};
@@ -0,0 +1,598 @@
+#include "HeightComposite.hpp"
+
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+#include <imgui.h>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+
+
+HeightComposite::HeightComposite()
+  : params()
+  , finestTexelSize(1.0f)
+  , normalMips(1)
+  , varianceMips(1)
+  , outdated(true)
+  , rebuiltLevels(0)
+  , texturesAmount(0)
+{
+}
+
+void HeightComposite::allocateResources(
+  std::uint32_t levels_amount,
+  std::uint32_t level_size,
+  float finest_texel_size,
+  std::uint32_t normal_mips,
+  std::uint32_t variance_mips)
+{
+  ETNA_VERIFYF(
+    levels_amount > 0 && levels_amount <= HEIGHT_COMPOSITE_MAX_LEVELS,
+    "Height composite supports from 1 to {} levels, got {}",
+    HEIGHT_COMPOSITE_MAX_LEVELS,
+    levels_amount);
+  ETNA_VERIFYF(
+    normal_mips > 0 && (level_size >> (normal_mips - 1)) > 0,
+    "Height composite level of size {} can not have {} normal mips",
+    level_size,
+    normal_mips);
+  ETNA_VERIFYF(
+    variance_mips > 0 &&
+      ((level_size / HEIGHT_COMPOSITE_VARIANCE_FOOTPRINT) >> (variance_mips - 1)) > 0,
+    "Height composite level of size {} can not have {} variance mips",
+    level_size,
+    variance_mips);
+
+  params.levelsAmount = levels_amount;
+  params.levelSize = level_size;
+  finestTexelSize = finest_texel_size;
+  normalMips = normal_mips;
+  varianceMips = variance_mips;
+
+  builtOrigins.assign(levels_amount, std::nullopt);
+
+  auto& ctx = etna::get_context();
+
+  composite = ctx.createImage(
+    etna::Image::CreateInfo{
+      .extent = vk::Extent3D{level_size, level_size, 1},
+      .name = "heightComposite",
+      .format = vk::Format::eR32Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+      .layers = levels_amount});
+  normals = ctx.createImage(
+    etna::Image::CreateInfo{
+      .extent = vk::Extent3D{level_size, level_size, 1},
+      .name = "heightCompositeNormals",
+      .format = vk::Format::eR16G16Snorm,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+      .layers = levels_amount,
+      .mipLevels = normal_mips});
+  std::uint32_t varianceSize = level_size / HEIGHT_COMPOSITE_VARIANCE_FOOTPRINT;
+  variance = ctx.createImage(
+    etna::Image::CreateInfo{
+      .extent = vk::Extent3D{varianceSize, varianceSize, 1},
+      .name = "heightCompositeVariance",
+      .format = vk::Format::eR32G32Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+      .layers = levels_amount,
+      .mipLevels = variance_mips});
+  compositeSampler = etna::Sampler(
+    etna::Sampler::CreateInfo{
+      .filter = vk::Filter::eLinear,
+      .addressMode = vk::SamplerAddressMode::eClampToEdge,
+      .name = "heightCompositeSampler"});
+
+  paramsBuffer.emplace(ctx.getMainWorkCount(), [&ctx](std::size_t i) {
+    return ctx.createBuffer(
+      etna::Buffer::CreateInfo{
+        .size = sizeof(HeightCompositeParams),
+        .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
+        .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+        .allocationCreate =
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .name = fmt::format("heightCompositeParams{}", i)});
+  });
+
+  oneShotCommands = ctx.createOneShotCmdMgr();
+}
+
+void HeightComposite::loadShaders()
+{
+  etna::create_program(
+    "height_composite_build",
+    {HEIGHT_COMPOSITE_MODULE_SHADERS_ROOT "height_composite_build.comp.spv"});
+  etna::create_program(
+    "height_composite_normals",
+    {HEIGHT_COMPOSITE_MODULE_SHADERS_ROOT "height_composite_normals.comp.spv"});
+  etna::create_program(
+    "height_composite_normals_downsample",
+    {HEIGHT_COMPOSITE_MODULE_SHADERS_ROOT "height_composite_normals_downsample.comp.spv"});
+  etna::create_program(
+    "height_composite_variance",
+    {HEIGHT_COMPOSITE_MODULE_SHADERS_ROOT "height_composite_variance.comp.spv"});
+  etna::create_program(
+    "height_composite_variance_downsample",
+    {HEIGHT_COMPOSITE_MODULE_SHADERS_ROOT "height_composite_variance_downsample.comp.spv"});
+}
+
+void HeightComposite::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  buildPipeline = pipelineManager.createComputePipeline("height_composite_build", {});
+  normalsPipeline = pipelineManager.createComputePipeline("height_composite_normals", {});
+  downsamplePipeline =
+    pipelineManager.createComputePipeline("height_composite_normals_downsample", {});
+  variancePipeline = pipelineManager.createComputePipeline("height_composite_variance", {});
+  varianceDownsamplePipeline =
+    pipelineManager.createComputePipeline("height_composite_variance_downsample", {});
+}
+
+void HeightComposite::loadMaps(std::vector<etna::Binding> terrain_bindings)
+{
+  auto shaderInfo = etna::get_shader_program("height_composite_build");
+  heightMapsSet =
+    std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0), terrain_bindings, true));
+
+  auto commandBuffer = oneShotCommands->start();
+  ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
+  {
+    heightMapsSet->processBarriers(commandBuffer);
+  }
+  ETNA_CHECK_VK_RESULT(commandBuffer.end());
+  oneShotCommands->submitAndWait(commandBuffer);
+
+  texturesAmount = static_cast<std::uint32_t>(terrain_bindings.size() - 1);
+  outdated = true;
+}
+
+void HeightComposite::execute(vk::CommandBuffer cmd_buf, glm::vec3 camera_position)
+{
+  ZoneScoped;
+
+  if (!heightMapsSet)
+  {
+    return;
+  }
+
+  std::vector<std::uint32_t> levelsToBuild;
+  for (std::uint32_t level = 0; level < params.levelsAmount; level++)
+  {
+    float texelSize = finestTexelSize * static_cast<float>(1u << level);
+    float levelExtent = texelSize * static_cast<float>(params.levelSize);
+
+    // camera stays at least 3/8 of the level away from its borders
+    float step = levelExtent / 4.0f;
+    glm::vec2 center = glm::round(glm::vec2(camera_position.x, camera_position.z) / step) * step;
+    glm::vec2 origin = center - levelExtent / 2.0f;
+
+    params.levels[level] = glm::vec4(origin, texelSize, 0.0f);
+
+    if (outdated || builtOrigins[level] != origin)
+    {
+      builtOrigins[level] = origin;
+      levelsToBuild.push_back(level);
+    }
+  }
+  outdated = false;
+  rebuiltLevels = static_cast<std::uint32_t>(levelsToBuild.size());
+
+  auto& currentParams = paramsBuffer->get();
+  currentParams.map();
+  std::memcpy(currentParams.data(), &params, sizeof(HeightCompositeParams));
+  currentParams.unmap();
+
+  if (levelsToBuild.empty())
+  {
+    return;
+  }
+
+  ETNA_PROFILE_GPU(cmd_buf, buildHeightComposite);
+
+  etna::set_state(
+    cmd_buf,
+    composite.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, buildPipeline.getVkPipeline());
+
+  auto shaderInfo = etna::get_shader_program("height_composite_build");
+  auto compositeSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(1),
+    cmd_buf,
+    {etna::Binding{
+      0,
+      composite.genBinding(
+        compositeSampler.get(),
+        vk::ImageLayout::eGeneral,
+        {.type = vk::ImageViewType::e2DArray})}});
+
+  std::array vkSets = {heightMapsSet->getVkSet(), compositeSet.getVkSet()};
+
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    buildPipeline.getVkPipelineLayout(),
+    0,
+    static_cast<uint32_t>(vkSets.size()),
+    vkSets.data(),
+    0,
+    nullptr);
+
+  for (std::uint32_t level : levelsToBuild)
+  {
+    cmd_buf.pushConstants<PushConstants>(
+      buildPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      {{.levelOrigin = glm::vec2(params.levels[level]),
+        .texelSize = params.levels[level].z,
+        .level = level,
+        .levelSize = params.levelSize,
+        .texturesAmount = texturesAmount}});
+
+    cmd_buf.dispatch((params.levelSize + 7) / 8, (params.levelSize + 7) / 8, 1);
+  }
+
+  buildNormals(cmd_buf, levelsToBuild);
+  buildVariance(cmd_buf, levelsToBuild);
+
+  etna::set_state(
+    cmd_buf,
+    composite.get(),
+    vk::PipelineStageFlagBits2::eComputeShader |
+      vk::PipelineStageFlagBits2::eVertexShader |
+      vk::PipelineStageFlagBits2::eTessellationControlShader |
+      vk::PipelineStageFlagBits2::eTessellationEvaluationShader |
+      vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    normals.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    variance.get(),
+    vk::PipelineStageFlagBits2::eComputeShader |
+      vk::PipelineStageFlagBits2::eTessellationControlShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+void HeightComposite::buildNormals(
+  vk::CommandBuffer cmd_buf, const std::vector<std::uint32_t>& levels)
+{
+  ETNA_PROFILE_GPU(cmd_buf, buildHeightCompositeNormals);
+
+  etna::set_state(
+    cmd_buf,
+    composite.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    normals.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  {
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, normalsPipeline.getVkPipeline());
+
+    auto shaderInfo = etna::get_shader_program("height_composite_normals");
+    auto set = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{
+         0,
+         composite.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.type = vk::ImageViewType::e2DArray})},
+       etna::Binding{
+         1,
+         normals.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.baseMip = 0, .levelCount = 1, .type = vk::ImageViewType::e2DArray})}});
+
+    auto vkSet = set.getVkSet();
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      normalsPipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+
+    for (std::uint32_t level : levels)
+    {
+      cmd_buf.pushConstants<NormalsPushConstants>(
+        normalsPipeline.getVkPipelineLayout(),
+        vk::ShaderStageFlagBits::eCompute,
+        0,
+        {{.texelSize = params.levels[level].z, .level = level, .levelSize = params.levelSize}});
+
+      cmd_buf.dispatch((params.levelSize + 7) / 8, (params.levelSize + 7) / 8, 1);
+    }
+  }
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, downsamplePipeline.getVkPipeline());
+
+  auto shaderInfo = etna::get_shader_program("height_composite_normals_downsample");
+  for (std::uint32_t mip = 1; mip < normalMips; mip++)
+  {
+    // previous mip is written by the previous dispatches
+    {
+      std::array imageBarriers = {vk::ImageMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+        .oldLayout = vk::ImageLayout::eGeneral,
+        .newLayout = vk::ImageLayout::eGeneral,
+        .image = normals.get(),
+        .subresourceRange = {
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .baseMipLevel = mip - 1,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = params.levelsAmount}}};
+
+      vk::DependencyInfo dependencyInfo = {
+        .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+        .imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size()),
+        .pImageMemoryBarriers = imageBarriers.data()};
+
+      cmd_buf.pipelineBarrier2(dependencyInfo);
+    }
+
+    auto set = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{
+         0,
+         normals.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.baseMip = mip - 1, .levelCount = 1, .type = vk::ImageViewType::e2DArray})},
+       etna::Binding{
+         1,
+         normals.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.baseMip = mip, .levelCount = 1, .type = vk::ImageViewType::e2DArray})}});
+
+    auto vkSet = set.getVkSet();
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      downsamplePipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+
+    std::uint32_t mipSize = params.levelSize >> mip;
+    for (std::uint32_t level : levels)
+    {
+      cmd_buf.pushConstants<DownsamplePushConstants>(
+        downsamplePipeline.getVkPipelineLayout(),
+        vk::ShaderStageFlagBits::eCompute,
+        0,
+        {{.level = level, .mipSize = mipSize}});
+
+      cmd_buf.dispatch((mipSize + 7) / 8, (mipSize + 7) / 8, 1);
+    }
+  }
+}
+
+void HeightComposite::buildVariance(
+  vk::CommandBuffer cmd_buf, const std::vector<std::uint32_t>& levels)
+{
+  ETNA_PROFILE_GPU(cmd_buf, buildHeightCompositeVariance);
+
+  // composite is already readable by compute after the normals
+  etna::set_state(
+    cmd_buf,
+    variance.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  std::uint32_t varianceSize = params.levelSize / HEIGHT_COMPOSITE_VARIANCE_FOOTPRINT;
+
+  {
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, variancePipeline.getVkPipeline());
+
+    auto shaderInfo = etna::get_shader_program("height_composite_variance");
+    auto set = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{
+         0,
+         composite.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.type = vk::ImageViewType::e2DArray})},
+       etna::Binding{
+         1,
+         variance.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.baseMip = 0, .levelCount = 1, .type = vk::ImageViewType::e2DArray})}});
+
+    auto vkSet = set.getVkSet();
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      variancePipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+
+    for (std::uint32_t level : levels)
+    {
+      cmd_buf.pushConstants<DownsamplePushConstants>(
+        variancePipeline.getVkPipelineLayout(),
+        vk::ShaderStageFlagBits::eCompute,
+        0,
+        {{.level = level, .mipSize = varianceSize}});
+
+      cmd_buf.dispatch((varianceSize + 7) / 8, (varianceSize + 7) / 8, 1);
+    }
+  }
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, varianceDownsamplePipeline.getVkPipeline());
+
+  auto shaderInfo = etna::get_shader_program("height_composite_variance_downsample");
+  for (std::uint32_t mip = 1; mip < varianceMips; mip++)
+  {
+    // previous mip is written by the previous dispatches
+    {
+      std::array imageBarriers = {vk::ImageMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+        .oldLayout = vk::ImageLayout::eGeneral,
+        .newLayout = vk::ImageLayout::eGeneral,
+        .image = variance.get(),
+        .subresourceRange = {
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .baseMipLevel = mip - 1,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = params.levelsAmount}}};
+
+      vk::DependencyInfo dependencyInfo = {
+        .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+        .imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size()),
+        .pImageMemoryBarriers = imageBarriers.data()};
+
+      cmd_buf.pipelineBarrier2(dependencyInfo);
+    }
+
+    auto set = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{
+         0,
+         variance.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.baseMip = mip - 1, .levelCount = 1, .type = vk::ImageViewType::e2DArray})},
+       etna::Binding{
+         1,
+         variance.genBinding(
+           compositeSampler.get(),
+           vk::ImageLayout::eGeneral,
+           {.baseMip = mip, .levelCount = 1, .type = vk::ImageViewType::e2DArray})}});
+
+    auto vkSet = set.getVkSet();
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      varianceDownsamplePipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+
+    std::uint32_t mipSize = varianceSize >> mip;
+    for (std::uint32_t level : levels)
+    {
+      cmd_buf.pushConstants<DownsamplePushConstants>(
+        varianceDownsamplePipeline.getVkPipelineLayout(),
+        vk::ShaderStageFlagBits::eCompute,
+        0,
+        {{.level = level, .mipSize = mipSize}});
+
+      cmd_buf.dispatch((mipSize + 7) / 8, (mipSize + 7) / 8, 1);
+    }
+  }
+}
+
+void HeightComposite::drawGui()
+{
+  ImGui::Begin("Application Settings");
+
+  if (ImGui::CollapsingHeader("Height Composite"))
+  {
+    ImGui::Text(
+      "Levels: %u of %ux%u, finest texel %.3f",
+      params.levelsAmount,
+      params.levelSize,
+      params.levelSize,
+      finestTexelSize);
+    ImGui::Text("Levels rebuilt last frame: %u", rebuiltLevels);
+    if (ImGui::Button("Rebuild Composite"))
+    {
+      outdated = true;
+    }
+  }
+
+  ImGui::End();
+}
+
+etna::Binding HeightComposite::genBinding(std::uint32_t binding) const
+{
+  return etna::Binding{
+    binding,
+    composite.genBinding(
+      compositeSampler.get(),
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      {.type = vk::ImageViewType::e2DArray})};
+}
+
+etna::Binding HeightComposite::genParamsBinding(std::uint32_t binding)
+{
+  return etna::Binding{binding, paramsBuffer->get().genBinding()};
+}
+
+etna::Binding HeightComposite::genNormalsBinding(std::uint32_t binding) const
+{
+  return etna::Binding{
+    binding,
+    normals.genBinding(
+      compositeSampler.get(),
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      {.type = vk::ImageViewType::e2DArray})};
+}
+
+etna::Binding HeightComposite::genVarianceBinding(std::uint32_t binding) const
+{
+  return etna::Binding{
+    binding,
+    variance.genBinding(
+      compositeSampler.get(),
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      {.type = vk::ImageViewType::e2DArray})};
+}
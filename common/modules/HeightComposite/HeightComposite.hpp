@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <etna/Image.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+
+#include "composite/HeightComposite.h"
+
+
+// Sum of every terrain cascade baked into camera centered levels, so terrain shaders sample one
+// texture instead of looping over cascades. Every level has the same amount of texels and twice
+// the texel size of the previous one, levels are rebuilt when the camera moves a quarter of
+// their size or when cascades change. Normals of every level are baked into a mip mapped
+// octahedral map together with its heights, and so are height mean and variance pyramids that
+// tell subdivision how rough terrain is under a bisector
+class HeightComposite
+{
+public:
+  HeightComposite();
+
+  // Coarsest level should cover everything terrain is drawn over,
+  // finest texel size should match the finest cascade
+  void allocateResources(
+    std::uint32_t levels_amount = 11,
+    std::uint32_t level_size = 1024,
+    float finest_texel_size = 0.125f,
+    std::uint32_t normal_mips = 5,
+    std::uint32_t variance_mips = 6);
+  void loadShaders();
+  void setupPipelines();
+
+  // Bindings are the same as for terrain rendering: cascades array and their infos
+  void loadMaps(std::vector<etna::Binding> terrain_bindings);
+  // Every level is rebuilt on the next execute
+  void updateHeightMaps() { outdated = true; }
+
+  // Records rebuilding of outdated levels and their normals, composite is sampled in
+  // tessellation and fragment shaders after that
+  void execute(vk::CommandBuffer cmd_buf, glm::vec3 camera_position);
+
+  void drawGui();
+
+  // See height_composite.glsl, params change every frame, so both are bound every frame
+  etna::Binding genBinding(std::uint32_t binding) const;
+  etna::Binding genParamsBinding(std::uint32_t binding);
+  etna::Binding genNormalsBinding(std::uint32_t binding) const;
+  etna::Binding genVarianceBinding(std::uint32_t binding) const;
+
+private:
+  void buildNormals(vk::CommandBuffer cmd_buf, const std::vector<std::uint32_t>& levels);
+  void buildVariance(vk::CommandBuffer cmd_buf, const std::vector<std::uint32_t>& levels);
+
+private:
+  struct PushConstants
+  {
+    glm::vec2 levelOrigin;
+    float texelSize;
+    std::uint32_t level;
+    std::uint32_t levelSize;
+    std::uint32_t texturesAmount;
+  };
+
+  struct NormalsPushConstants
+  {
+    float texelSize;
+    std::uint32_t level;
+    std::uint32_t levelSize;
+  };
+
+  struct DownsamplePushConstants
+  {
+    std::uint32_t level;
+    std::uint32_t mipSize;
+  };
+
+private:
+  HeightCompositeParams params;
+  float finestTexelSize;
+  std::uint32_t normalMips;
+  std::uint32_t varianceMips;
+
+  // corner every level was last built with
+  std::vector<std::optional<glm::vec2>> builtOrigins;
+  bool outdated;
+  std::uint32_t rebuiltLevels;
+
+  std::uint32_t texturesAmount;
+  std::unique_ptr<etna::PersistentDescriptorSet> heightMapsSet;
+
+  etna::Image composite;
+  etna::Image normals;
+  etna::Image variance;
+  etna::Sampler compositeSampler;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> paramsBuffer;
+
+  etna::ComputePipeline buildPipeline;
+  etna::ComputePipeline normalsPipeline;
+  etna::ComputePipeline downsamplePipeline;
+  etna::ComputePipeline variancePipeline;
+  etna::ComputePipeline varianceDownsamplePipeline;
+
+  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
+};
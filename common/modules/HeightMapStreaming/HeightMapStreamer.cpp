@@ -0,0 +1,643 @@
+#include "HeightMapStreamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <span>
+
+#include <tracy/Tracy.hpp>
+#include <imgui.h>
+#include <glm/gtc/packing.hpp>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/Profiling.hpp>
+
+#include "render_utils/Utilities.hpp"
+
+
+static constexpr std::uint32_t NOT_WANTED = std::numeric_limits<std::uint32_t>::max();
+
+HeightMapStreamer::HeightMapStreamer()
+  : tileSize(256)
+  , slotsAmount(96)
+  , uploadsPerFrame(4)
+  , index()
+  , frameIndex(0)
+  , residencyVersion(0)
+  , pageTableChanged(true)
+  , stats()
+  , stopping(false)
+  , header()
+{
+}
+
+HeightMapStreamer::~HeightMapStreamer()
+{
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  requestsChanged.notify_all();
+
+  if (loadingThread.joinable())
+  {
+    loadingThread.join();
+  }
+}
+
+void HeightMapStreamer::allocateResources(std::filesystem::path source)
+{
+  ZoneScoped;
+
+  tilesDirectory = source.parent_path() / (source.stem().string() + "_tiles");
+  index = height_map_tiles::prepare(source, tilesDirectory, tileSize);
+
+  mipPageOffsets.resize(index.mipsAmount);
+  std::uint32_t pagesAmount = 0;
+  for (std::uint32_t mip = 0; mip < index.mipsAmount; mip++)
+  {
+    mipPageOffsets[mip] = pagesAmount;
+    std::uint32_t tilesPerRow = height_map_tiles::tiles_per_row(index, mip);
+    pagesAmount += tilesPerRow * tilesPerRow;
+  }
+
+  pageStates.assign(pagesAmount, PageState::eAbsent);
+  pageTable.assign(pagesAmount, 0);
+  wantedPriorities.assign(pagesAmount, NOT_WANTED);
+  slots.assign(slotsAmount, {.page = std::nullopt, .lastUsedFrame = 0});
+
+  std::uint32_t slotsPerRow =
+    static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<float>(slotsAmount))));
+  std::uint32_t slotsPerColumn = (slotsAmount + slotsPerRow - 1) / slotsPerRow;
+
+  header = {
+    .sourceSize = index.sourceSize,
+    .tileSize = tileSize,
+    .mipsAmount = index.mipsAmount,
+    .slotsPerRow = slotsPerRow};
+
+  auto& ctx = etna::get_context();
+
+  pool = ctx.createImage(
+    etna::Image::CreateInfo{
+      .extent =
+        vk::Extent3D{slotsPerRow * (tileSize + 1), slotsPerColumn * (tileSize + 1), 1},
+      .name = "streamedHeightMapPool",
+      .format = vk::Format::eR32Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst});
+  // shaders only use texelFetch, filtering is done manually
+  poolSampler = etna::Sampler(
+    etna::Sampler::CreateInfo{
+      .filter = vk::Filter::eNearest, .name = "streamedHeightMapPoolSampler"});
+
+  const vk::DeviceSize pageTableSize =
+    sizeof(StreamedHeightMapHeader) + sizeof(std::uint32_t) * pagesAmount;
+
+  pageTableBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = pageTableSize,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "streamedHeightMapPageTable"});
+
+  // bounds never change, so they are written once
+  boundsBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(glm::vec2) * index.bounds.size(),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+      .allocationCreate =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .name = "streamedHeightMapBounds"});
+
+  boundsBuffer.map();
+  std::memcpy(boundsBuffer.data(), index.bounds.data(), sizeof(glm::vec2) * index.bounds.size());
+  boundsBuffer.unmap();
+
+  const vk::DeviceSize tileBytes = sizeof(float) * (tileSize + 1) * (tileSize + 1);
+  stagingBuffer.emplace(ctx.getMainWorkCount(), [&](std::size_t i) {
+    return ctx.createBuffer(
+      etna::Buffer::CreateInfo{
+        .size = tileBytes * uploadsPerFrame + pageTableSize,
+        .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+        .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+        .allocationCreate =
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .name = fmt::format("streamedHeightMapStaging{}", i)});
+  });
+
+  // written by the GPU and read back by the host every frame, starts with nothing requested
+  feedbackBuffer.emplace(ctx.getMainWorkCount(), [&](std::size_t i) {
+    auto buffer = ctx.createBuffer(
+      etna::Buffer::CreateInfo{
+        .size = pageTableSize,
+        .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+        .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+        .allocationCreate =
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .name = fmt::format("streamedHeightMapFeedback{}", i)});
+
+    buffer.map();
+    std::memset(buffer.data(), 0, pageTableSize);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    buffer.unmap();
+
+    return buffer;
+  });
+
+  oneShotCommands = ctx.createOneShotCmdMgr();
+  transferHelper = std::make_unique<etna::BlockingTransferHelper>(
+    etna::BlockingTransferHelper::CreateInfo{
+      .stagingSize = sizeof(std::uint16_t) * tileSize * tileSize});
+
+  // coarsest mip is a single tile that always stays resident, so sampling never misses
+  height_map_tiles::TileKey coarsestKey = {.mip = index.mipsAmount - 1, .x = 0, .y = 0};
+  auto coarsestTexels = height_map_tiles::read_tile(tilesDirectory, coarsestKey, tileSize);
+
+  createOverviewTexture(coarsestTexels);
+
+  std::uint32_t coarsestPage = pageIndex(coarsestKey);
+  pageStates[coarsestPage] = PageState::eRequested;
+  loadedTiles.push_back(
+    {.page = coarsestPage,
+     .key = coarsestKey,
+     .texels = std::move(coarsestTexels),
+     .requestTime = std::chrono::steady_clock::now()});
+
+  loadingThread = std::thread(&HeightMapStreamer::loadTiles, this);
+}
+
+void HeightMapStreamer::requestTiles()
+{
+  ZoneScoped;
+
+  std::fill(wantedPriorities.begin(), wantedPriorities.end(), NOT_WANTED);
+
+  // buffer of this frame was last written mainWorkCount frames ago and is already read back
+  auto& feedback = feedbackBuffer->get();
+  feedback.map();
+  auto* requested =
+    reinterpret_cast<std::uint32_t*>(feedback.data() + sizeof(StreamedHeightMapHeader));
+
+  for (std::uint32_t mip = 0; mip < index.mipsAmount; mip++)
+  {
+    std::uint32_t tilesPerRow = height_map_tiles::tiles_per_row(index, mip);
+    for (std::uint32_t tile = 0; tile < tilesPerRow * tilesPerRow; tile++)
+    {
+      if (requested[mipPageOffsets[mip] + tile] == 0)
+      {
+        continue;
+      }
+
+      // coarser tiles under the requested one are its fallback while it is loading,
+      // so they are wanted as well and loaded first
+      height_map_tiles::TileKey key = {
+        .mip = mip, .x = tile % tilesPerRow, .y = tile / tilesPerRow};
+      for (; key.mip < index.mipsAmount; key = {key.mip + 1, key.x / 2, key.y / 2})
+      {
+        std::uint32_t page = pageIndex(key);
+        if (wantedPriorities[page] != NOT_WANTED)
+        {
+          break;
+        }
+        wantedPriorities[page] = index.mipsAmount - 1 - key.mip;
+      }
+    }
+  }
+  wantedPriorities[pageIndex({.mip = index.mipsAmount - 1, .x = 0, .y = 0})] = 0;
+
+  // cleared for the frame recorded into this buffer now
+  std::memset(requested, 0, sizeof(std::uint32_t) * pageTable.size());
+  feedback.unmap();
+
+  // tiles over the pool budget are not loaded at all, coarsest ones are kept
+  wantedPages.clear();
+  for (std::uint32_t page = 0; page < wantedPriorities.size(); page++)
+  {
+    if (wantedPriorities[page] != NOT_WANTED)
+    {
+      wantedPages.push_back(page);
+    }
+  }
+  if (wantedPages.size() > slotsAmount)
+  {
+    std::nth_element(
+      wantedPages.begin(),
+      wantedPages.begin() + slotsAmount,
+      wantedPages.end(),
+      [this](std::uint32_t a, std::uint32_t b) {
+        return wantedPriorities[a] < wantedPriorities[b];
+      });
+    for (auto page = wantedPages.begin() + slotsAmount; page != wantedPages.end(); page++)
+    {
+      wantedPriorities[*page] = NOT_WANTED;
+    }
+    stats.overBudgetTiles = static_cast<std::uint32_t>(wantedPages.size() - slotsAmount);
+  }
+  else
+  {
+    stats.overBudgetTiles = 0;
+  }
+
+  for (auto& slot : slots)
+  {
+    if (slot.page.has_value() && wantedPriorities[*slot.page] != NOT_WANTED)
+    {
+      slot.lastUsedFrame = frameIndex;
+    }
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard lock(mutex);
+
+    // requests for tiles shaders stopped asking for are dropped before they are read
+    std::erase_if(pendingRequests, [&](const Request& request) {
+      if (wantedPriorities[request.page] == NOT_WANTED)
+      {
+        pageStates[request.page] = PageState::eAbsent;
+        stats.droppedRequests++;
+        return true;
+      }
+      return false;
+    });
+
+    for (auto& request : pendingRequests)
+    {
+      request.priority = wantedPriorities[request.page];
+    }
+
+    for (std::uint32_t mip = 0; mip < index.mipsAmount; mip++)
+    {
+      std::uint32_t tilesPerRow = height_map_tiles::tiles_per_row(index, mip);
+      for (std::uint32_t page = mipPageOffsets[mip];
+           page < mipPageOffsets[mip] + tilesPerRow * tilesPerRow;
+           page++)
+      {
+        if (wantedPriorities[page] == NOT_WANTED || pageStates[page] != PageState::eAbsent)
+        {
+          continue;
+        }
+
+        std::uint32_t tile = page - mipPageOffsets[mip];
+        pendingRequests.push_back(
+          {.page = page,
+           .key = {.mip = mip, .x = tile % tilesPerRow, .y = tile / tilesPerRow},
+           .priority = wantedPriorities[page],
+           .requestTime = now});
+        pageStates[page] = PageState::eRequested;
+      }
+    }
+
+    stats.pendingTiles = static_cast<std::uint32_t>(pendingRequests.size());
+  }
+  requestsChanged.notify_one();
+}
+
+void HeightMapStreamer::execute(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  frameIndex++;
+
+  requestTiles();
+
+  std::vector<LoadedTile> uploads;
+  {
+    std::lock_guard lock(mutex);
+    while (!loadedTiles.empty() && uploads.size() < uploadsPerFrame)
+    {
+      uploads.push_back(std::move(loadedTiles.front()));
+      loadedTiles.pop_front();
+    }
+  }
+
+  if (uploads.empty() && !pageTableChanged)
+  {
+    return;
+  }
+
+  ETNA_PROFILE_GPU(cmd_buf, streamHeightMapTiles);
+
+  auto& staging = stagingBuffer->get();
+  staging.map();
+
+  const vk::DeviceSize tileBytes = sizeof(float) * (tileSize + 1) * (tileSize + 1);
+  std::vector<vk::BufferImageCopy> copyRegions;
+  auto now = std::chrono::steady_clock::now();
+
+  for (auto& tile : uploads)
+  {
+    bool coarsest = tile.key.mip == index.mipsAmount - 1;
+    if (!coarsest && wantedPriorities[tile.page] == NOT_WANTED)
+    {
+      // tile stopped being wanted while it was read
+      pageStates[tile.page] = PageState::eAbsent;
+      stats.droppedRequests++;
+      continue;
+    }
+
+    auto slot = acquireSlot();
+    if (!slot.has_value())
+    {
+      // every slot holds a wanted tile, the tile is requested again once some is released
+      pageStates[tile.page] = PageState::eAbsent;
+      stats.droppedRequests++;
+      continue;
+    }
+
+    // coarsest tile gets slot 0 and is never evicted, as it comes first and is always wanted
+    slots[*slot] = {.page = tile.page, .lastUsedFrame = frameIndex};
+    pageStates[tile.page] = PageState::eResident;
+    pageTable[tile.page] = *slot + 1;
+    pageTableChanged = true;
+
+    vk::DeviceSize offset = tileBytes * copyRegions.size();
+    std::memcpy(staging.data() + offset, tile.texels.data(), tileBytes);
+
+    glm::uvec2 slotOrigin =
+      glm::uvec2(*slot % header.slotsPerRow, *slot / header.slotsPerRow) * (tileSize + 1);
+    copyRegions.push_back(
+      vk::BufferImageCopy{
+        .bufferOffset = offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+          {.aspectMask = vk::ImageAspectFlagBits::eColor,
+           .mipLevel = 0,
+           .baseArrayLayer = 0,
+           .layerCount = 1},
+        .imageOffset =
+          vk::Offset3D{static_cast<int32_t>(slotOrigin.x), static_cast<int32_t>(slotOrigin.y), 0},
+        .imageExtent = vk::Extent3D{tileSize + 1, tileSize + 1, 1}});
+
+    double latencyMs =
+      std::chrono::duration<double, std::milli>(now - tile.requestTime).count();
+    stats.loadedTiles++;
+    stats.latencySumMs += latencyMs;
+    stats.maxLatencyMs = glm::max(stats.maxLatencyMs, latencyMs);
+  }
+
+  const vk::DeviceSize tableOffset = tileBytes * uploadsPerFrame;
+  if (pageTableChanged)
+  {
+    std::memcpy(staging.data() + tableOffset, &header, sizeof(header));
+    std::memcpy(
+      staging.data() + tableOffset + sizeof(header),
+      pageTable.data(),
+      sizeof(std::uint32_t) * pageTable.size());
+  }
+
+  staging.unmap();
+
+  if (!copyRegions.empty())
+  {
+    etna::set_state(
+      cmd_buf,
+      pool.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmd_buf);
+
+    cmd_buf.copyBufferToImage(
+      staging.get(),
+      pool.get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      static_cast<uint32_t>(copyRegions.size()),
+      copyRegions.data());
+
+    etna::set_state(
+      cmd_buf,
+      pool.get(),
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmd_buf);
+
+    residencyVersion++;
+  }
+
+  if (pageTableChanged)
+  {
+    tableBarrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderRead,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite);
+
+    vk::BufferCopy tableCopy = {
+      .srcOffset = tableOffset,
+      .dstOffset = 0,
+      .size = sizeof(header) + sizeof(std::uint32_t) * pageTable.size()};
+    cmd_buf.copyBuffer(staging.get(), pageTableBuffer.get(), 1, &tableCopy);
+
+    tableBarrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderRead);
+
+    pageTableChanged = false;
+  }
+
+  stats.residentTiles = static_cast<std::uint32_t>(
+    std::count(pageStates.begin(), pageStates.end(), PageState::eResident));
+}
+
+void HeightMapStreamer::readbackFeedback(vk::CommandBuffer cmd_buf)
+{
+  std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+    .buffer = feedbackBuffer->get().get(),
+    .size = vk::WholeSize}};
+
+  vk::DependencyInfo dependencyInfo = {
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+    .pBufferMemoryBarriers = bufferBarriers.data()};
+
+  cmd_buf.pipelineBarrier2(dependencyInfo);
+}
+
+void HeightMapStreamer::drawGui()
+{
+  ImGui::Begin("Application Settings");
+
+  if (ImGui::CollapsingHeader("Height Map Streaming"))
+  {
+    ImGui::Text(
+      "Source: %ux%u, tiles of %u, %u mips",
+      index.sourceSize,
+      index.sourceSize,
+      index.tileSize,
+      index.mipsAmount);
+    ImGui::Text("Resident tiles: %u/%u", stats.residentTiles, slotsAmount);
+    ImGui::Text("Pending requests: %u", stats.pendingTiles);
+    ImGui::Text("Requested over budget: %u", stats.overBudgetTiles);
+    ImGui::Text(
+      "Loaded: %llu, evicted: %llu, dropped: %llu",
+      static_cast<unsigned long long>(stats.loadedTiles),
+      static_cast<unsigned long long>(stats.evictedTiles),
+      static_cast<unsigned long long>(stats.droppedRequests));
+    ImGui::Text(
+      "Request to upload latency: average %.3f ms, max %.3f ms",
+      stats.loadedTiles > 0 ? stats.latencySumMs / static_cast<double>(stats.loadedTiles) : 0.0,
+      stats.maxLatencyMs);
+  }
+
+  ImGui::End();
+}
+
+etna::Binding HeightMapStreamer::genPoolBinding(std::uint32_t binding) const
+{
+  return etna::Binding{
+    binding, pool.genBinding(poolSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)};
+}
+
+etna::Binding HeightMapStreamer::genPageTableBinding(std::uint32_t binding) const
+{
+  return etna::Binding{binding, pageTableBuffer.genBinding()};
+}
+
+etna::Binding HeightMapStreamer::genBoundsBinding(std::uint32_t binding) const
+{
+  return etna::Binding{binding, boundsBuffer.genBinding()};
+}
+
+void HeightMapStreamer::loadTiles()
+{
+  while (true)
+  {
+    Request request;
+    {
+      std::unique_lock lock(mutex);
+      requestsChanged.wait(lock, [this]() { return stopping || !pendingRequests.empty(); });
+
+      if (stopping)
+      {
+        return;
+      }
+
+      auto next = std::min_element(
+        pendingRequests.begin(), pendingRequests.end(), [](const auto& a, const auto& b) {
+          return a.priority < b.priority;
+        });
+      request = *next;
+      pendingRequests.erase(next);
+    }
+
+    auto texels = height_map_tiles::read_tile(tilesDirectory, request.key, tileSize);
+
+    {
+      std::lock_guard lock(mutex);
+      loadedTiles.push_back(
+        {.page = request.page,
+         .key = request.key,
+         .texels = std::move(texels),
+         .requestTime = request.requestTime});
+    }
+  }
+}
+
+std::uint32_t HeightMapStreamer::pageIndex(height_map_tiles::TileKey key) const
+{
+  return mipPageOffsets[key.mip] + key.y * height_map_tiles::tiles_per_row(index, key.mip) +
+    key.x;
+}
+
+std::optional<std::uint32_t> HeightMapStreamer::acquireSlot()
+{
+  std::optional<std::uint32_t> leastRecent;
+  for (std::uint32_t i = 0; i < slotsAmount; i++)
+  {
+    if (!slots[i].page.has_value())
+    {
+      return i;
+    }
+
+    // tiles wanted this frame and the coarsest tile are kept
+    bool evictable = slots[i].lastUsedFrame < frameIndex &&
+      *slots[i].page != pageIndex({.mip = index.mipsAmount - 1, .x = 0, .y = 0});
+    if (evictable && (!leastRecent || slots[i].lastUsedFrame < slots[*leastRecent].lastUsedFrame))
+    {
+      leastRecent = i;
+    }
+  }
+
+  if (leastRecent.has_value())
+  {
+    std::uint32_t page = *slots[*leastRecent].page;
+    pageStates[page] = PageState::eAbsent;
+    pageTable[page] = 0;
+    slots[*leastRecent].page.reset();
+    stats.evictedTiles++;
+  }
+
+  return leastRecent;
+}
+
+void HeightMapStreamer::createOverviewTexture(const std::vector<float>& coarsest_texels)
+{
+  // tile without its shared row and column is the whole coarsest mip
+  std::vector<std::uint16_t> texels(tileSize * tileSize);
+  for (std::uint32_t y = 0; y < tileSize; y++)
+  {
+    for (std::uint32_t x = 0; x < tileSize; x++)
+    {
+      texels[y * tileSize + x] = glm::packHalf1x16(coarsest_texels[y * (tileSize + 1) + x]);
+    }
+  }
+
+  auto& ctx = etna::get_context();
+
+  etna::Buffer overviewBuffer = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(std::uint16_t) * texels.size(),
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+      .name = "streamedHeightMapOverview_buffer"});
+
+  transferHelper->uploadBuffer(
+    *oneShotCommands, overviewBuffer, 0, std::as_bytes(std::span(texels)));
+
+  overviewTexture = ctx.createImage(
+    etna::Image::CreateInfo{
+      .extent = vk::Extent3D{tileSize, tileSize, 1},
+      .name = "streamedHeightMapOverview",
+      .format = vk::Format::eR16Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst});
+
+  render_utility::local_copy_buffer_to_image(*oneShotCommands, overviewBuffer, overviewTexture, 1);
+}
+
+void HeightMapStreamer::tableBarrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+    .buffer = pageTableBuffer.get(),
+    .size = vk::WholeSize}};
+
+  vk::DependencyInfo dependencyInfo = {
+    .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+    .pBufferMemoryBarriers = bufferBarriers.data()};
+
+  cmd_buf.pipelineBarrier2(dependencyInfo);
+}
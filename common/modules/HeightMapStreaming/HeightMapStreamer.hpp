@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/BlockingTransferHelper.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <etna/Image.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+
+#include "HeightMapTiles.hpp"
+#include "streaming/StreamedHeightMap.h"
+
+
+// Software virtual texture of a heightmap split into tiles on disk. Shaders write tiles they
+// want into a feedback buffer, which is read back a few frames later, wanted tiles and coarser
+// ones under them are read by a background thread, uploaded into a fixed size pool texture
+// from the frame command buffer and the least recently wanted tiles are evicted
+class HeightMapStreamer
+{
+public:
+  HeightMapStreamer();
+  ~HeightMapStreamer();
+
+  HeightMapStreamer(const HeightMapStreamer&) = delete;
+  HeightMapStreamer& operator=(const HeightMapStreamer&) = delete;
+
+  // Splits source into tiles next to it if needed, coarsest mip is loaded right away
+  void allocateResources(std::filesystem::path source);
+
+  // Reacts to feedback and records uploads of tiles loaded since the last call and page table
+  // changes, should be recorded before passes sampling the streamed heightmap
+  void execute(vk::CommandBuffer cmd_buf);
+  // Makes feedback of this frame visible to the host, should be recorded after passes writing it
+  void readbackFeedback(vk::CommandBuffer cmd_buf);
+
+  void drawGui();
+
+  etna::Binding genPoolBinding(std::uint32_t binding) const;
+  etna::Binding genPageTableBinding(std::uint32_t binding) const;
+  // Conservative min/max of the source for the finest height bounds level
+  etna::Binding genBoundsBinding(std::uint32_t binding) const;
+
+  // Feedback of the current frame, see streamed_height_map_feedback.glsl
+  const etna::Buffer& getFeedbackBuffer() { return feedbackBuffer->get(); }
+
+  // Coarsest mip as a regular texture, for users that sample the whole heightmap rarely
+  const etna::Image& getOverviewTexture() const { return overviewTexture; }
+
+  // Changes every time resident tiles change
+  std::uint64_t getResidencyVersion() const { return residencyVersion; }
+
+private:
+  enum class PageState
+  {
+    eAbsent,
+    eRequested,
+    eResident,
+  };
+
+  struct Request
+  {
+    std::uint32_t page;
+    height_map_tiles::TileKey key;
+    // lower is loaded first
+    std::uint32_t priority;
+    std::chrono::steady_clock::time_point requestTime;
+  };
+
+  struct LoadedTile
+  {
+    std::uint32_t page;
+    height_map_tiles::TileKey key;
+    std::vector<float> texels;
+    std::chrono::steady_clock::time_point requestTime;
+  };
+
+  struct Slot
+  {
+    std::optional<std::uint32_t> page;
+    std::uint64_t lastUsedFrame;
+  };
+
+  struct Stats
+  {
+    std::uint32_t residentTiles;
+    std::uint32_t pendingTiles;
+    std::uint32_t overBudgetTiles;
+    std::uint64_t loadedTiles;
+    std::uint64_t evictedTiles;
+    std::uint64_t droppedRequests;
+    double latencySumMs;
+    double maxLatencyMs;
+  };
+
+private:
+  void requestTiles();
+  void loadTiles();
+
+  std::uint32_t pageIndex(height_map_tiles::TileKey key) const;
+  std::optional<std::uint32_t> acquireSlot();
+  void createOverviewTexture(const std::vector<float>& coarsest_texels);
+
+  void tableBarrier(
+    vk::CommandBuffer cmd_buf,
+    vk::PipelineStageFlags2 src_stage,
+    vk::AccessFlags2 src_access,
+    vk::PipelineStageFlags2 dst_stage,
+    vk::AccessFlags2 dst_access);
+
+private:
+  std::uint32_t tileSize;
+  std::uint32_t slotsAmount;
+  std::uint32_t uploadsPerFrame;
+
+  std::filesystem::path tilesDirectory;
+  height_map_tiles::Index index;
+  std::vector<std::uint32_t> mipPageOffsets;
+
+  // state of the main thread
+  std::uint64_t frameIndex;
+  std::uint64_t residencyVersion;
+  std::vector<PageState> pageStates;
+  // pool slot + 1 for every page, as in the shader
+  std::vector<std::uint32_t> pageTable;
+  std::vector<std::uint32_t> wantedPriorities;
+  std::vector<std::uint32_t> wantedPages;
+  std::vector<Slot> slots;
+  bool pageTableChanged;
+  Stats stats;
+
+  // shared with the loading thread
+  std::mutex mutex;
+  std::condition_variable requestsChanged;
+  std::vector<Request> pendingRequests;
+  std::deque<LoadedTile> loadedTiles;
+  bool stopping;
+  std::thread loadingThread;
+
+  StreamedHeightMapHeader header;
+
+  etna::Image pool;
+  etna::Sampler poolSampler;
+  etna::Buffer pageTableBuffer;
+  etna::Buffer boundsBuffer;
+  etna::Image overviewTexture;
+
+  // tiles and page table of a frame are copied from here
+  std::optional<etna::GpuSharedResource<etna::Buffer>> stagingBuffer;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> feedbackBuffer;
+
+  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
+  std::unique_ptr<etna::BlockingTransferHelper> transferHelper;
+};
@@ -0,0 +1,294 @@
+#include "HeightMapTiles.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <optional>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <stb_image.h>
+#include <tracy/Tracy.hpp>
+
+#include <etna/Assert.hpp>
+
+#include "clipmap/HeightBounds.h"
+
+
+namespace height_map_tiles
+{
+
+namespace
+{
+
+constexpr std::uint32_t INDEX_MAGIC = 0x4c544d48; // "HMTL"
+constexpr std::uint32_t INDEX_VERSION = 1;
+
+// fixed part of the index file, followed by bounds
+struct IndexHeader
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t sourceSize;
+  std::uint32_t tileSize;
+  std::uint32_t mipsAmount;
+  std::uint32_t boundsSize;
+};
+
+std::filesystem::path index_path(const std::filesystem::path& directory)
+{
+  return directory / "index.bin";
+}
+
+std::filesystem::path tile_path(const std::filesystem::path& directory, TileKey key)
+{
+  return directory / fmt::format("{}_{}_{}.bin", key.mip, key.x, key.y);
+}
+
+// heightmaps were loaded as sRGB textures, so values are linearized the same way
+float srgb_to_linear(std::uint8_t value)
+{
+  float c = static_cast<float>(value) / 255.0f;
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+std::optional<Index> read_index(const std::filesystem::path& directory, std::uint32_t tile_size)
+{
+  std::ifstream file(index_path(directory), std::ios::binary);
+  if (!file)
+  {
+    return std::nullopt;
+  }
+
+  IndexHeader header = {};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (
+    !file || header.magic != INDEX_MAGIC || header.version != INDEX_VERSION ||
+    header.tileSize != tile_size || header.boundsSize != HEIGHT_BOUNDS_SIZE)
+  {
+    return std::nullopt;
+  }
+
+  Index result = {
+    .sourceSize = header.sourceSize,
+    .tileSize = header.tileSize,
+    .mipsAmount = header.mipsAmount,
+    .bounds = std::vector<glm::vec2>(HEIGHT_BOUNDS_SIZE * HEIGHT_BOUNDS_SIZE)};
+
+  file.read(
+    reinterpret_cast<char*>(result.bounds.data()),
+    static_cast<std::streamsize>(result.bounds.size() * sizeof(glm::vec2)));
+  if (!file)
+  {
+    return std::nullopt;
+  }
+
+  return result;
+}
+
+void write_index(const std::filesystem::path& directory, const Index& index)
+{
+  IndexHeader header = {
+    .magic = INDEX_MAGIC,
+    .version = INDEX_VERSION,
+    .sourceSize = index.sourceSize,
+    .tileSize = index.tileSize,
+    .mipsAmount = index.mipsAmount,
+    .boundsSize = HEIGHT_BOUNDS_SIZE};
+
+  std::ofstream file(index_path(directory), std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(
+    reinterpret_cast<const char*>(index.bounds.data()),
+    static_cast<std::streamsize>(index.bounds.size() * sizeof(glm::vec2)));
+
+  ETNA_VERIFYF(file.good(), "Height map tiles index is not written to {}", directory.string());
+}
+
+// same footprint as the height bounds build of whole heightmaps uses, then grown by two texels
+// around, as texels of coarser mips cover up to one bounds texel and are filtered with neighbours
+std::vector<glm::vec2> compute_bounds(const std::vector<float>& texels, std::uint32_t size)
+{
+  auto texel = [&](std::int32_t x, std::int32_t y) {
+    std::int32_t s = static_cast<std::int32_t>(size);
+    return texels[((y % s + s) % s) * s + ((x % s + s) % s)];
+  };
+
+  std::int32_t boundsSize = HEIGHT_BOUNDS_SIZE;
+  std::int32_t sourceSize = static_cast<std::int32_t>(size);
+
+  std::vector<glm::vec2> footprints(boundsSize * boundsSize);
+  for (std::int32_t y = 0; y < boundsSize; y++)
+  {
+    for (std::int32_t x = 0; x < boundsSize; x++)
+    {
+      glm::ivec2 first = glm::ivec2(x, y) * sourceSize / boundsSize - 1;
+      glm::ivec2 last = glm::max((glm::ivec2(x, y) + 1) * sourceSize / boundsSize, first + 2);
+
+      glm::vec2 result = glm::vec2(texel(first.x, first.y));
+      for (std::int32_t v = first.y; v <= last.y; v++)
+      {
+        for (std::int32_t u = first.x; u <= last.x; u++)
+        {
+          result = {glm::min(result.x, texel(u, v)), glm::max(result.y, texel(u, v))};
+        }
+      }
+      footprints[y * boundsSize + x] = result;
+    }
+  }
+
+  std::vector<glm::vec2> result(boundsSize * boundsSize);
+  for (std::int32_t y = 0; y < boundsSize; y++)
+  {
+    for (std::int32_t x = 0; x < boundsSize; x++)
+    {
+      glm::vec2 merged = footprints[y * boundsSize + x];
+      for (std::int32_t v = y - 2; v <= y + 2; v++)
+      {
+        for (std::int32_t u = x - 2; u <= x + 2; u++)
+        {
+          glm::vec2 other = footprints
+            [((v + boundsSize) % boundsSize) * boundsSize + (u + boundsSize) % boundsSize];
+          merged = {glm::min(merged.x, other.x), glm::max(merged.y, other.y)};
+        }
+      }
+      result[y * boundsSize + x] = merged;
+    }
+  }
+
+  return result;
+}
+
+} // namespace
+
+Index prepare(
+  const std::filesystem::path& source,
+  const std::filesystem::path& directory,
+  std::uint32_t tile_size)
+{
+  ZoneScoped;
+
+  if (
+    std::filesystem::exists(index_path(directory)) &&
+    std::filesystem::last_write_time(index_path(directory)) >=
+      std::filesystem::last_write_time(source))
+  {
+    if (auto index = read_index(directory, tile_size); index.has_value())
+    {
+      return *index;
+    }
+  }
+
+  spdlog::info("Splitting height map {} into tiles of {}", source.string(), tile_size);
+
+  int width, height, channels;
+  auto sourceString = source.generic_string<char>();
+  unsigned char* sourceData =
+    stbi_load(sourceString.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+  ETNA_VERIFYF(sourceData != nullptr, "Texture {} is not loaded!", sourceString);
+
+  std::uint32_t size = static_cast<std::uint32_t>(width);
+  ETNA_VERIFYF(
+    width == height && std::has_single_bit(size) && size >= tile_size &&
+      std::has_single_bit(tile_size),
+    "Streamed height map {} should be a square power of two not smaller than tile size {}, "
+    "got {}x{}",
+    sourceString,
+    tile_size,
+    width,
+    height);
+
+  // heights are taken from the red channel, as with sampling .x of the whole texture
+  std::vector<float> texels(size * size);
+  for (std::size_t i = 0; i < texels.size(); i++)
+  {
+    texels[i] = srgb_to_linear(sourceData[i * 4]);
+  }
+  stbi_image_free(sourceData);
+
+  Index index = {
+    .sourceSize = size,
+    .tileSize = tile_size,
+    .mipsAmount = static_cast<std::uint32_t>(std::countr_zero(size / tile_size)) + 1,
+    .bounds = compute_bounds(texels, size)};
+
+  std::filesystem::create_directories(directory);
+
+  std::vector<float> tile((tile_size + 1) * (tile_size + 1));
+  std::uint32_t mipSize = size;
+  for (std::uint32_t mip = 0; mip < index.mipsAmount; mip++)
+  {
+    for (std::uint32_t y = 0; y < mipSize / tile_size; y++)
+    {
+      for (std::uint32_t x = 0; x < mipSize / tile_size; x++)
+      {
+        for (std::uint32_t v = 0; v <= tile_size; v++)
+        {
+          for (std::uint32_t u = 0; u <= tile_size; u++)
+          {
+            std::uint32_t sourceX = (x * tile_size + u) % mipSize;
+            std::uint32_t sourceY = (y * tile_size + v) % mipSize;
+            tile[v * (tile_size + 1) + u] = texels[sourceY * mipSize + sourceX];
+          }
+        }
+
+        std::ofstream file(tile_path(directory, {mip, x, y}), std::ios::binary);
+        file.write(
+          reinterpret_cast<const char*>(tile.data()),
+          static_cast<std::streamsize>(tile.size() * sizeof(float)));
+      }
+    }
+
+    // box filtered next mip
+    std::uint32_t nextSize = mipSize / 2;
+    std::vector<float> nextTexels(nextSize * nextSize);
+    for (std::uint32_t y = 0; y < nextSize; y++)
+    {
+      for (std::uint32_t x = 0; x < nextSize; x++)
+      {
+        nextTexels[y * nextSize + x] = 0.25f *
+          (texels[(2 * y) * mipSize + 2 * x] + texels[(2 * y) * mipSize + 2 * x + 1] +
+           texels[(2 * y + 1) * mipSize + 2 * x] + texels[(2 * y + 1) * mipSize + 2 * x + 1]);
+      }
+    }
+    texels = std::move(nextTexels);
+    mipSize = nextSize;
+  }
+
+  // index is written last, so interrupted splitting is redone on the next start
+  write_index(directory, index);
+
+  return index;
+}
+
+std::vector<float> read_tile(
+  const std::filesystem::path& directory, TileKey key, std::uint32_t tile_size)
+{
+  ZoneScoped;
+
+  std::vector<float> result((tile_size + 1) * (tile_size + 1));
+
+  std::ifstream file(tile_path(directory, key), std::ios::binary);
+  file.read(
+    reinterpret_cast<char*>(result.data()),
+    static_cast<std::streamsize>(result.size() * sizeof(float)));
+
+  ETNA_VERIFYF(
+    file.good(),
+    "Height map tile {} {} {} is not read from {}",
+    key.mip,
+    key.x,
+    key.y,
+    directory.string());
+
+  return result;
+}
+
+std::uint32_t tiles_per_row(const Index& index, std::uint32_t mip)
+{
+  return (index.sourceSize >> mip) / index.tileSize;
+}
+
+} // namespace height_map_tiles
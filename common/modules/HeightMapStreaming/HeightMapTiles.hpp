@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Source heightmap split into tiles of every mip on disk, so it never has to be loaded whole.
+// Tile files hold (tileSize + 1)^2 floats, last row and column repeat the first ones of the next
+// tile, wrapped around the heightmap border like repeat addressing does
+namespace height_map_tiles
+{
+
+struct Index
+{
+  std::uint32_t sourceSize;
+  std::uint32_t tileSize;
+  std::uint32_t mipsAmount;
+  // min/max of the source for every texel of the finest height bounds level, conservative for
+  // sampling any of the mips
+  std::vector<glm::vec2> bounds;
+};
+
+struct TileKey
+{
+  std::uint32_t mip;
+  std::uint32_t x;
+  std::uint32_t y;
+};
+
+// Splits square power of two 8-bit sRGB heightmap into tiles placed in directory,
+// tiles are reused if they were made from the same source with the same tile size
+Index prepare(
+  const std::filesystem::path& source,
+  const std::filesystem::path& directory,
+  std::uint32_t tile_size);
+
+// Safe to call from any thread
+std::vector<float> read_tile(
+  const std::filesystem::path& directory, TileKey key, std::uint32_t tile_size);
+
+std::uint32_t tiles_per_row(const Index& index, std::uint32_t mip);
+
+} // namespace height_map_tiles
@@ -112,6 +112,7 @@ void TerrainGeneratorModule::setupPipelines()
 void TerrainGeneratorModule::execute()
 {
   transferHelper->uploadBuffer(*oneShotCommands, infosBuffer, 0, std::as_bytes(std::span(infos)));
+  mapsVersion++;
 
   auto commandBuffer = oneShotCommands->start();
 
@@ -248,6 +249,7 @@ void TerrainGeneratorModule::drawGui()
     ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
     transferHelper->uploadBuffer(*oneShotCommands, infosBuffer, 0, std::as_bytes(std::span(infos)));
     infosChanged = false;
+    mapsVersion++;
   }
 
   ImGui::End();
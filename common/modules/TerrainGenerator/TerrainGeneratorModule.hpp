@@ -39,6 +39,8 @@ public:
   // const etna::Image& getMap() const { return terrainMap; }
   std::vector<etna::Binding> getBindings(vk::ImageLayout layout) const;
   const etna::Sampler& getSampler() const { return terrainSampler; }
+  // Incremented every time maps or their infos change
+  uint32_t getMapsVersion() const { return mapsVersion; }
 
 private:
 struct TerrainCascadeInfo {
@@ -57,6 +59,7 @@ private:
   etna::Buffer infosBuffer;
 
   uint32_t texturesAmount;
+  uint32_t mapsVersion = 0;
 
   etna::GraphicsPipeline terrainGenerationPipeline;
 
@@ -0,0 +1,62 @@
+#include "GpuTimer.hpp"
+
+#include <array>
+#include <cstdint>
+
+#include <etna/GlobalContext.hpp>
+
+
+void GpuTimer::allocateResources()
+{
+  auto& ctx = etna::get_context();
+
+  timestampPeriod = ctx.getPhysicalDevice().getProperties().limits.timestampPeriod;
+
+  queries.emplace(ctx.getMainWorkCount(), [&ctx](std::size_t) {
+    vk::QueryPoolCreateInfo info{.queryType = vk::QueryType::eTimestamp, .queryCount = 2};
+    return Queries{
+      .pool = etna::unwrap_vk_result(ctx.getDevice().createQueryPoolUnique(info)),
+      .written = false};
+  });
+}
+
+void GpuTimer::readback()
+{
+  auto& current = queries->get();
+  if (!current.written)
+  {
+    return;
+  }
+
+  // caller waited for the fence of the frame that wrote these queries, so they are available
+  std::array<std::uint64_t, 2> timestamps = {};
+  vk::Result result = etna::get_context().getDevice().getQueryPoolResults(
+    current.pool.get(),
+    0,
+    static_cast<std::uint32_t>(timestamps.size()),
+    sizeof(timestamps),
+    timestamps.data(),
+    sizeof(std::uint64_t),
+    vk::QueryResultFlagBits::e64);
+
+  if (result == vk::Result::eSuccess)
+  {
+    milliseconds =
+      static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f;
+  }
+  current.written = false;
+}
+
+void GpuTimer::start(vk::CommandBuffer cmd_buf)
+{
+  auto& current = queries->get();
+  cmd_buf.resetQueryPool(current.pool.get(), 0, 2);
+  cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, current.pool.get(), 0);
+}
+
+void GpuTimer::stop(vk::CommandBuffer cmd_buf)
+{
+  auto& current = queries->get();
+  cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, current.pool.get(), 1);
+  current.written = true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <optional>
+
+#include <etna/GpuSharedResource.hpp>
+#include <etna/Vulkan.hpp>
+
+
+// Time of a span of commands on the GPU, for the GUI (for the whole frame use Tracy).
+// Every frame in flight writes its own pair of timestamps, read back when it comes around again
+class GpuTimer
+{
+public:
+  void allocateResources();
+
+  // Takes timestamps written mainWorkCount frames ago, should be called after the fence of this
+  // frame is waited for, i.e. after acquiring its command buffer
+  void readback();
+
+  // Both are recorded outside of rendering, start resets the queries of this frame
+  void start(vk::CommandBuffer cmd_buf);
+  void stop(vk::CommandBuffer cmd_buf);
+
+  // Last measured span, zero until the first readback of written timestamps
+  float getMilliseconds() const { return milliseconds; }
+
+private:
+  struct Queries
+  {
+    vk::UniqueQueryPool pool;
+    bool written;
+  };
+
+private:
+  std::optional<etna::GpuSharedResource<Queries>> queries;
+  float timestampPeriod = 0.0f;
+  float milliseconds = 0.0f;
+};
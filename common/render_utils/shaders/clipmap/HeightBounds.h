@@ -0,0 +1,23 @@
+#ifndef HEIGHT_BOUNDS_H_INCLUDED
+#define HEIGHT_BOUNDS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// every cascade gets the same min/max pyramid, 256x256 texels at the finest level
+#define HEIGHT_BOUNDS_SIZE 256
+#define HEIGHT_BOUNDS_LEVELS 9
+// (4^HEIGHT_BOUNDS_LEVELS - 1) / 3
+#define HEIGHT_BOUNDS_TEXELS_PER_CASCADE 87381
+#define HEIGHT_BOUNDS_MAX_CASCADES 32
+
+// copy of the cascade info the pyramid was built with
+struct HeightBoundsCascade
+{
+  shader_vec2 extent;
+  shader_float heightOffset;
+  shader_float heightAmplifier;
+};
+
+
+#endif // HEIGHT_BOUNDS_H_INCLUDED
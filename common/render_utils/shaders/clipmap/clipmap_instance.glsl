@@ -0,0 +1,36 @@
+#ifndef CLIPMAP_INSTANCE_GLSL_INCLUDED
+#define CLIPMAP_INSTANCE_GLSL_INCLUDED
+
+
+// same layout as ClipmapInstanceGLSLCompat
+struct ClipmapInstance
+{
+  vec2 offset;
+  uint scaleExponent;
+  uint rotation; // 0 - 0 degrees, 1 - 90 degrees, 2 - 270 degrees, 3 - 180 degrees
+};
+
+vec2 rotateClipmapPosition(vec2 position, uint rotation)
+{
+  switch (rotation)
+  {
+  case 1:
+    return vec2(position.y, -position.x);
+  case 2:
+    return vec2(-position.y, position.x);
+  case 3:
+    return -position;
+  default:
+    return position;
+  }
+}
+
+// horizontal world position of a mesh vertex placed by instance
+vec2 toWorldPosition(ClipmapInstance instance, vec2 position)
+{
+  return instance.offset +
+    rotateClipmapPosition(position, instance.rotation) * float(1u << instance.scaleExponent);
+}
+
+
+#endif // CLIPMAP_INSTANCE_GLSL_INCLUDED
@@ -0,0 +1,42 @@
+#ifndef CLIPMAP_VERTEX_GLSL_INCLUDED
+#define CLIPMAP_VERTEX_GLSL_INCLUDED
+
+
+// same layout as ClipmapRelemLayoutGLSLCompat
+struct ClipmapRelemLayout
+{
+  vec2 origin;
+  vec2 step;
+  uint vertexOffset;
+  uint rowLength;
+  uint perimeterSide; // not zero for relems laid out along the outline of a square
+  uint _padding0;
+};
+
+// vertex_index is relative to the first vertex of the relem, same as
+// TerrainManager::pullVertexPosition
+vec2 pullClipmapVertex(ClipmapRelemLayout layout, uint vertex_index)
+{
+  if (layout.perimeterSide != 0)
+  {
+    float side = float(layout.perimeterSide);
+    float t = float(vertex_index % layout.perimeterSide);
+    switch (vertex_index / layout.perimeterSide)
+    {
+    case 0:
+      return layout.origin + vec2(t, 0);
+    case 1:
+      return layout.origin + vec2(side, t);
+    case 2:
+      return layout.origin + vec2(side - t, side);
+    default:
+      return layout.origin + vec2(0, side - t);
+    }
+  }
+
+  return layout.origin +
+    vec2(vertex_index % layout.rowLength, vertex_index / layout.rowLength) * layout.step;
+}
+
+
+#endif // CLIPMAP_VERTEX_GLSL_INCLUDED
@@ -0,0 +1,90 @@
+#ifndef HEIGHT_BOUNDS_GLSL_INCLUDED
+#define HEIGHT_BOUNDS_GLSL_INCLUDED
+
+#include "HeightBounds.h"
+
+#ifndef HEIGHT_BOUNDS_SET
+#define HEIGHT_BOUNDS_SET 0
+#endif
+
+// min/max pyramids of raw heightmap values for every cascade, levels go from finest to coarsest
+layout(set = HEIGHT_BOUNDS_SET, binding = HEIGHT_BOUNDS_BINDING) buffer height_bounds_t
+{
+  uint cascadesAmount;
+  uint _padding0;
+  uint _padding1;
+  uint _padding2;
+  HeightBoundsCascade cascades[HEIGHT_BOUNDS_MAX_CASCADES];
+  vec2 bounds[];
+}
+heightBounds;
+
+uint heightBoundsIndex(uint cascade, uint level, uvec2 texel)
+{
+  uint size = HEIGHT_BOUNDS_SIZE >> level;
+  uint levelOffset =
+    ((1u << (2 * HEIGHT_BOUNDS_LEVELS)) - (1u << (2 * (HEIGHT_BOUNDS_LEVELS - level)))) / 3;
+  return cascade * HEIGHT_BOUNDS_TEXELS_PER_CASCADE + levelOffset + texel.y * size + texel.x;
+}
+
+// heightmap coordinates covered by texCoords in [tex_coord_min, tex_coord_max],
+// folded into [0, 1] so that both repeat and mirrored repeat addressing stay conservative
+void foldHeightBoundsFootprint(inout vec2 tex_coord_min, inout vec2 tex_coord_max)
+{
+  vec2 cell = floor(tex_coord_min);
+  vec2 low = tex_coord_min - cell;
+  vec2 high = tex_coord_max - cell;
+
+  bvec2 mirrored = equal(mod(cell, 2.0), vec2(1.0));
+  vec2 foldedLow = mix(low, min(low, 1.0 - high), mirrored);
+  vec2 foldedHigh = mix(high, max(high, 1.0 - low), mirrored);
+
+  bvec2 wraps = notEqual(cell, floor(tex_coord_max));
+  tex_coord_min = mix(foldedLow, vec2(0.0), wraps);
+  tex_coord_max = mix(foldedHigh, vec2(1.0), wraps);
+}
+
+// lower and upper bound of the terrain height over a horizontal world space rectangle
+vec2 terrainHeightBounds(vec2 min_pos, vec2 max_pos)
+{
+  vec2 result = vec2(0.0);
+
+  for (uint i = 0; i < heightBounds.cascadesAmount; i++)
+  {
+    HeightBoundsCascade cascade = heightBounds.cascades[i];
+
+    // filtering footprint of every texel is already accounted for when the pyramid is built
+    vec2 texCoordMin = 0.5 * min_pos / cascade.extent + 0.5;
+    vec2 texCoordMax = 0.5 * max_pos / cascade.extent + 0.5;
+    foldHeightBoundsFootprint(texCoordMin, texCoordMax);
+
+    float lastTexel = float(HEIGHT_BOUNDS_SIZE - 1);
+    uvec2 texelMin = uvec2(clamp(texCoordMin * HEIGHT_BOUNDS_SIZE, 0.0, lastTexel));
+    uvec2 texelMax = uvec2(clamp(texCoordMax * HEIGHT_BOUNDS_SIZE, 0.0, lastTexel));
+
+    // coarsest level where the footprint is at most 2x2 texels
+    uint level = 0;
+    while (any(greaterThan(texelMax - texelMin, uvec2(1))))
+    {
+      texelMin >>= 1;
+      texelMax >>= 1;
+      level++;
+    }
+
+    vec2 rawBounds = heightBounds.bounds[heightBoundsIndex(i, level, texelMin)];
+    vec2 corner = heightBounds.bounds[heightBoundsIndex(i, level, uvec2(texelMax.x, texelMin.y))];
+    rawBounds = vec2(min(rawBounds.x, corner.x), max(rawBounds.y, corner.y));
+    corner = heightBounds.bounds[heightBoundsIndex(i, level, uvec2(texelMin.x, texelMax.y))];
+    rawBounds = vec2(min(rawBounds.x, corner.x), max(rawBounds.y, corner.y));
+    corner = heightBounds.bounds[heightBoundsIndex(i, level, texelMax)];
+    rawBounds = vec2(min(rawBounds.x, corner.x), max(rawBounds.y, corner.y));
+
+    vec2 heights = (rawBounds - cascade.heightOffset) * cascade.heightAmplifier;
+    result += vec2(min(heights.x, heights.y), max(heights.x, heights.y));
+  }
+
+  return result;
+}
+
+
+#endif // HEIGHT_BOUNDS_GLSL_INCLUDED
@@ -0,0 +1,61 @@
+#ifndef LEVEL_MAPS_GLSL_INCLUDED
+#define LEVEL_MAPS_GLSL_INCLUDED
+
+#ifndef LEVEL_MAPS_SET
+#define LEVEL_MAPS_SET 0
+#endif
+
+// every clipmap level owns a square window of texels placed one under another in a single
+// texture, texel of a level is a vertex of its grid, so its world position is texel * 2^level;
+// windows are addressed toroidally, so only newly exposed strips are written when camera moves;
+// x is height, yzw is normal
+#ifdef LEVEL_MAPS_WRITE
+layout(set = LEVEL_MAPS_SET, binding = LEVEL_MAPS_BINDING, rgba32f) writeonly uniform image2D
+  levelMaps;
+
+int levelMapsWindowSize()
+{
+  return imageSize(levelMaps).x;
+}
+#else
+layout(set = LEVEL_MAPS_SET, binding = LEVEL_MAPS_BINDING) uniform sampler2D levelMaps;
+
+int levelMapsWindowSize()
+{
+  return textureSize(levelMaps, 0).x;
+}
+#endif
+
+ivec2 levelMapsTexel(ivec2 level_texel, uint level)
+{
+  int windowSize = levelMapsWindowSize();
+  ivec2 wrapped = ((level_texel % windowSize) + windowSize) % windowSize;
+  return wrapped + ivec2(0, int(level) * windowSize);
+}
+
+#ifndef LEVEL_MAPS_WRITE
+// value at a vertex of level grid
+vec4 fetchLevelMaps(vec2 world_position, uint level)
+{
+  ivec2 levelTexel = ivec2(round(world_position / float(1u << level)));
+  return texelFetch(levelMaps, levelMapsTexel(levelTexel, level), 0);
+}
+
+// bilinear filtering is done manually, hardware one would mix neighbouring windows
+vec4 sampleLevelMaps(vec2 world_position, uint level)
+{
+  vec2 position = world_position / float(1u << level);
+  ivec2 base = ivec2(floor(position));
+  vec2 weights = position - vec2(base);
+
+  vec4 v00 = texelFetch(levelMaps, levelMapsTexel(base, level), 0);
+  vec4 v10 = texelFetch(levelMaps, levelMapsTexel(base + ivec2(1, 0), level), 0);
+  vec4 v01 = texelFetch(levelMaps, levelMapsTexel(base + ivec2(0, 1), level), 0);
+  vec4 v11 = texelFetch(levelMaps, levelMapsTexel(base + ivec2(1, 1), level), 0);
+
+  return mix(mix(v00, v10, weights.x), mix(v01, v11, weights.x), weights.y);
+}
+#endif
+
+
+#endif // LEVEL_MAPS_GLSL_INCLUDED
@@ -0,0 +1,23 @@
+#ifndef HEIGHT_COMPOSITE_H_INCLUDED
+#define HEIGHT_COMPOSITE_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define HEIGHT_COMPOSITE_MAX_LEVELS 16
+// heights along a side of a texel of the finest height variance mip
+#define HEIGHT_COMPOSITE_VARIANCE_FOOTPRINT 4
+
+// every level has the same amount of texels, texel size doubles with every level
+struct HeightCompositeParams
+{
+  // xy - world position of the level corner, z - texel size in world units
+  shader_vec4 levels[HEIGHT_COMPOSITE_MAX_LEVELS];
+  shader_uint levelsAmount;
+  shader_uint levelSize;
+  shader_uint _padding0;
+  shader_uint _padding1;
+};
+
+
+#endif // HEIGHT_COMPOSITE_H_INCLUDED
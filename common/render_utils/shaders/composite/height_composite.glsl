@@ -0,0 +1,112 @@
+#ifndef HEIGHT_COMPOSITE_GLSL_INCLUDED
+#define HEIGHT_COMPOSITE_GLSL_INCLUDED
+
+#include "HeightComposite.h"
+
+#ifndef HEIGHT_COMPOSITE_SET
+#define HEIGHT_COMPOSITE_SET 0
+#endif
+
+// summed height of every terrain cascade, one layer per level
+layout(set = HEIGHT_COMPOSITE_SET, binding = HEIGHT_COMPOSITE_BINDING) uniform sampler2DArray
+  heightComposite;
+layout(set = HEIGHT_COMPOSITE_SET, binding = HEIGHT_COMPOSITE_PARAMS_BINDING) uniform
+height_composite_params_t
+{
+  HeightCompositeParams heightCompositeParams;
+};
+
+// finest level that has texels on both sides of the position, coarsest one outside of all levels
+uint heightCompositeLevel(vec2 world_position)
+{
+  float levelSize = float(heightCompositeParams.levelSize);
+  for (uint level = 0; level + 1 < heightCompositeParams.levelsAmount; level++)
+  {
+    vec4 origin = heightCompositeParams.levels[level];
+    vec2 texel = (world_position - origin.xy) / origin.z;
+    if (all(greaterThanEqual(texel, vec2(1.0))) && all(lessThanEqual(texel, vec2(levelSize - 1.0))))
+    {
+      return level;
+    }
+  }
+  return heightCompositeParams.levelsAmount - 1;
+}
+
+float heightCompositeTexelSize(uint level)
+{
+  return heightCompositeParams.levels[level].z;
+}
+
+float sampleHeightComposite(vec2 world_position, uint level)
+{
+  vec4 origin = heightCompositeParams.levels[level];
+  vec2 uv = (world_position - origin.xy) / (origin.z * float(heightCompositeParams.levelSize));
+  return textureLod(heightComposite, vec3(uv, float(level)), 0.0).x;
+}
+
+float sampleHeightComposite(vec2 world_position)
+{
+  return sampleHeightComposite(world_position, heightCompositeLevel(world_position));
+}
+
+#ifdef HEIGHT_COMPOSITE_NORMALS_BINDING
+
+#include "/octahedral.glsl"
+
+// normals baked from the composite heights, one layer per level, mip mapped
+layout(set = HEIGHT_COMPOSITE_SET, binding = HEIGHT_COMPOSITE_NORMALS_BINDING) uniform
+  sampler2DArray heightCompositeNormals;
+
+// gradients are world position derivatives, explicit so that mips do not jump where levels change
+vec3 sampleHeightCompositeNormal(vec2 world_position, vec2 world_dx, vec2 world_dy)
+{
+  uint level = heightCompositeLevel(world_position);
+  vec4 origin = heightCompositeParams.levels[level];
+  float levelExtent = origin.z * float(heightCompositeParams.levelSize);
+
+  vec2 uv = (world_position - origin.xy) / levelExtent;
+  vec2 encoded = textureGrad(
+                   heightCompositeNormals,
+                   vec3(uv, float(level)),
+                   world_dx / levelExtent,
+                   world_dy / levelExtent)
+                   .xy;
+
+  return octahedralDecode(encoded).xzy;
+}
+
+#endif // HEIGHT_COMPOSITE_NORMALS_BINDING
+
+#ifdef HEIGHT_COMPOSITE_VARIANCE_BINDING
+
+// mean and variance of composite heights, one layer per level, mip mapped
+layout(set = HEIGHT_COMPOSITE_SET, binding = HEIGHT_COMPOSITE_VARIANCE_BINDING) uniform
+  sampler2DArray heightCompositeVariance;
+
+// standard deviation of heights in a square of footprint world size around the position,
+// squares larger than the coarsest mip of a level are taken from coarser levels
+float sampleHeightCompositeDeviation(vec2 world_position, float footprint)
+{
+  uint level = heightCompositeLevel(world_position);
+  float maxLod = float(textureQueryLevels(heightCompositeVariance) - 1);
+  float finestTexelSize = heightCompositeTexelSize(level) * HEIGHT_COMPOSITE_VARIANCE_FOOTPRINT;
+  float lod = log2(max(footprint / finestTexelSize, 1.0));
+
+  // every next level has twice the texel size
+  while (lod > maxLod && level + 1 < heightCompositeParams.levelsAmount)
+  {
+    level++;
+    lod -= 1.0;
+  }
+
+  vec4 origin = heightCompositeParams.levels[level];
+  vec2 uv = (world_position - origin.xy) / (origin.z * float(heightCompositeParams.levelSize));
+  float variance = textureLod(heightCompositeVariance, vec3(uv, float(level)), lod).y;
+
+  return sqrt(max(variance, 0.0));
+}
+
+#endif // HEIGHT_COMPOSITE_VARIANCE_BINDING
+
+
+#endif // HEIGHT_COMPOSITE_GLSL_INCLUDED
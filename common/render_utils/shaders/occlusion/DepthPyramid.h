@@ -0,0 +1,19 @@
+#ifndef DEPTH_PYRAMID_H_INCLUDED
+#define DEPTH_PYRAMID_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// finest level is the largest power of two not exceeding resolution, every next level halves it
+struct DepthPyramidHeader
+{
+  // matrix the depth was rendered with, occlusion tests project bounds with it
+  shader_mat4 projView;
+  shader_uvec2 extent;
+  shader_uint levels;
+  // zero until the first pyramid is built or while occlusion culling is disabled
+  shader_uint valid;
+};
+
+
+#endif // DEPTH_PYRAMID_H_INCLUDED
@@ -0,0 +1,104 @@
+#ifndef DEPTH_PYRAMID_GLSL_INCLUDED
+#define DEPTH_PYRAMID_GLSL_INCLUDED
+
+#include "DepthPyramid.h"
+
+#ifndef DEPTH_PYRAMID_SET
+#define DEPTH_PYRAMID_SET 0
+#endif
+
+// only the pyramid build writes to it
+#ifdef DEPTH_PYRAMID_WRITE
+#define DEPTH_PYRAMID_ACCESS
+#else
+#define DEPTH_PYRAMID_ACCESS readonly
+#endif
+
+// max depth pyramid of the previous frame, levels go from finest to coarsest
+layout(set = DEPTH_PYRAMID_SET, binding = DEPTH_PYRAMID_BINDING) DEPTH_PYRAMID_ACCESS buffer
+depth_pyramid_t
+{
+  DepthPyramidHeader header;
+  float depths[];
+}
+depthPyramid;
+
+uvec2 depthPyramidLevelSize(uvec2 extent, uint level)
+{
+  return max(extent >> level, uvec2(1));
+}
+
+uint depthPyramidIndex(uvec2 extent, uint level, uvec2 texel)
+{
+  uint offset = 0;
+  for (uint i = 0; i < level; i++)
+  {
+    uvec2 size = depthPyramidLevelSize(extent, i);
+    offset += size.x * size.y;
+  }
+
+  return offset + texel.y * depthPyramidLevelSize(extent, level).x + texel.x;
+}
+
+// true only if the box is fully hidden behind the depth of the frame the pyramid was built from
+bool isOccluded(vec3 box_min, vec3 box_max)
+{
+  if (depthPyramid.header.valid == 0)
+  {
+    return false;
+  }
+
+  vec2 screenMin = vec2(1.0);
+  vec2 screenMax = vec2(0.0);
+  float closestDepth = 1.0;
+
+  for (uint i = 0; i < 8; i++)
+  {
+    vec3 corner = mix(box_min, box_max, bvec3((i & 1) != 0, (i & 2) != 0, (i & 4) != 0));
+    vec4 projected = depthPyramid.header.projView * vec4(corner, 1.0);
+
+    // box crosses the near plane, nothing can be said about it
+    if (projected.w <= 0.0)
+    {
+      return false;
+    }
+
+    vec3 ndc = projected.xyz / projected.w;
+    screenMin = min(screenMin, ndc.xy * 0.5 + 0.5);
+    screenMax = max(screenMax, ndc.xy * 0.5 + 0.5);
+    closestDepth = min(closestDepth, ndc.z);
+  }
+
+  // parts outside of the previous frame are unknown
+  if (any(lessThan(screenMin, vec2(0.0))) || any(greaterThan(screenMax, vec2(1.0))))
+  {
+    return false;
+  }
+
+  uvec2 extent = depthPyramid.header.extent;
+  uvec2 texelMin = uvec2(min(screenMin * extent, vec2(extent - 1)));
+  uvec2 texelMax = uvec2(min(screenMax * extent, vec2(extent - 1)));
+
+  // coarsest level where the rectangle is at most 2x2 texels
+  uint level = 0;
+  while (any(greaterThan(texelMax - texelMin, uvec2(1))))
+  {
+    texelMin >>= 1;
+    texelMax >>= 1;
+    level++;
+  }
+
+  float farthestDepth = depthPyramid.depths[depthPyramidIndex(extent, level, texelMin)];
+  farthestDepth = max(
+    farthestDepth,
+    depthPyramid.depths[depthPyramidIndex(extent, level, uvec2(texelMax.x, texelMin.y))]);
+  farthestDepth = max(
+    farthestDepth,
+    depthPyramid.depths[depthPyramidIndex(extent, level, uvec2(texelMin.x, texelMax.y))]);
+  farthestDepth = max(farthestDepth, depthPyramid.depths[depthPyramidIndex(extent, level, texelMax)]);
+
+  return closestDepth > farthestDepth;
+}
+
+
+#endif // DEPTH_PYRAMID_GLSL_INCLUDED
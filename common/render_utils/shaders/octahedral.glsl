@@ -0,0 +1,27 @@
+#ifndef OCTAHEDRAL_GLSL_INCLUDED
+#define OCTAHEDRAL_GLSL_INCLUDED
+
+// unit vectors packed into two [-1, 1] components, see "A Survey of Efficient Representations
+// for Independent Unit Vectors", Cigolle et al.
+
+vec2 octahedralWrap(vec2 v)
+{
+  return (1.0 - abs(v.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v, vec2(0.0)));
+}
+
+vec2 octahedralEncode(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  return n.z >= 0.0 ? n.xy : octahedralWrap(n.xy);
+}
+
+vec3 octahedralDecode(vec2 f)
+{
+  vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+  float t = clamp(-n.z, 0.0, 1.0);
+  n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+  return normalize(n);
+}
+
+
+#endif // OCTAHEDRAL_GLSL_INCLUDED
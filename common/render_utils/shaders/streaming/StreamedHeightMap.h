@@ -0,0 +1,19 @@
+#ifndef STREAMED_HEIGHT_MAP_H_INCLUDED
+#define STREAMED_HEIGHT_MAP_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// source heightmap is split into square tiles on every mip, tiles store one more row and column
+// shared with the next tile, so bilinear filtering never leaves a tile
+struct StreamedHeightMapHeader
+{
+  shader_uint sourceSize;
+  shader_uint tileSize;
+  shader_uint mipsAmount;
+  // resident tiles are placed in the pool texture row by row
+  shader_uint slotsPerRow;
+};
+
+
+#endif // STREAMED_HEIGHT_MAP_H_INCLUDED
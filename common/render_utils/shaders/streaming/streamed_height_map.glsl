@@ -0,0 +1,79 @@
+#ifndef STREAMED_HEIGHT_MAP_GLSL_INCLUDED
+#define STREAMED_HEIGHT_MAP_GLSL_INCLUDED
+
+#include "StreamedHeightMap.h"
+
+#ifndef STREAMED_HEIGHT_MAP_SET
+#define STREAMED_HEIGHT_MAP_SET 0
+#endif
+
+layout(set = STREAMED_HEIGHT_MAP_SET, binding = STREAMED_HEIGHT_MAP_POOL_BINDING) uniform sampler2D
+  streamedHeightMapPool;
+
+// page of every tile of every mip, 0 if tile is not resident, pool slot + 1 otherwise
+layout(set = STREAMED_HEIGHT_MAP_SET, binding = STREAMED_HEIGHT_MAP_TABLE_BINDING) readonly buffer
+streamed_height_map_table_t
+{
+  StreamedHeightMapHeader header;
+  uint pages[];
+}
+streamedHeightMap;
+
+uint streamedHeightMapPageOffset(uint mip)
+{
+  StreamedHeightMapHeader header = streamedHeightMap.header;
+  uint offset = 0;
+  for (uint i = 0; i < mip; i++)
+  {
+    uint tilesPerRow = (header.sourceSize >> i) / header.tileSize;
+    offset += tilesPerRow * tilesPerRow;
+  }
+  return offset;
+}
+
+ivec2 streamedHeightMapSize()
+{
+  return ivec2(streamedHeightMap.header.sourceSize);
+}
+
+// same as sampling the whole heightmap with bilinear filtering and repeat addressing,
+// but the finest resident mip is used, the coarsest mip is always resident
+float sampleStreamedHeight(vec2 tex_coord)
+{
+  StreamedHeightMapHeader header = streamedHeightMap.header;
+  int tileSize = int(header.tileSize);
+
+  for (uint mip = 0; mip < header.mipsAmount; mip++)
+  {
+    int size = int(header.sourceSize >> mip);
+    vec2 position = tex_coord * float(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 weights = position - vec2(base);
+    base = ((base % size) + size) % size;
+
+    ivec2 tile = base / tileSize;
+    uint page = streamedHeightMap.pages
+      [streamedHeightMapPageOffset(mip) + uint(tile.y * (size / tileSize) + tile.x)];
+
+    if (page == 0)
+    {
+      continue;
+    }
+
+    uint slot = page - 1;
+    ivec2 slotOrigin = ivec2(slot % header.slotsPerRow, slot / header.slotsPerRow) * (tileSize + 1);
+    ivec2 texel = slotOrigin + base - tile * tileSize;
+
+    float h00 = texelFetch(streamedHeightMapPool, texel, 0).x;
+    float h10 = texelFetch(streamedHeightMapPool, texel + ivec2(1, 0), 0).x;
+    float h01 = texelFetch(streamedHeightMapPool, texel + ivec2(0, 1), 0).x;
+    float h11 = texelFetch(streamedHeightMapPool, texel + ivec2(1, 1), 0).x;
+
+    return mix(mix(h00, h10, weights.x), mix(h01, h11, weights.x), weights.y);
+  }
+
+  return 0.0;
+}
+
+
+#endif // STREAMED_HEIGHT_MAP_GLSL_INCLUDED
@@ -0,0 +1,73 @@
+#ifndef STREAMED_HEIGHT_MAP_FEEDBACK_GLSL_INCLUDED
+#define STREAMED_HEIGHT_MAP_FEEDBACK_GLSL_INCLUDED
+
+#include "StreamedHeightMap.h"
+
+#ifndef STREAMED_HEIGHT_MAP_FEEDBACK_SET
+#define STREAMED_HEIGHT_MAP_FEEDBACK_SET 0
+#endif
+
+// tiles of the streamed heightmap shaders want this frame, same order as the page table,
+// 0 if tile was not requested, cleared and read back by HeightMapStreamer
+layout(
+  set = STREAMED_HEIGHT_MAP_FEEDBACK_SET,
+  binding = STREAMED_HEIGHT_MAP_FEEDBACK_BINDING) buffer streamed_height_map_feedback_t
+{
+  StreamedHeightMapHeader header;
+  uint requested[];
+}
+streamedHeightMapFeedback;
+
+// at most that many tiles are requested along every axis, coarser mip is requested instead
+#define STREAMED_HEIGHT_MAP_FEEDBACK_MAX_TILES 4
+
+// requests tiles covering [tex_coord_min, tex_coord_max] from the coarsest mip that still has
+// at least resolution texels across the whole heightmap
+void requestStreamedHeightTiles(vec2 tex_coord_min, vec2 tex_coord_max, float resolution)
+{
+  StreamedHeightMapHeader header = streamedHeightMapFeedback.header;
+  int tileSize = int(header.tileSize);
+
+  uint mip = uint(clamp(
+    floor(log2(float(header.sourceSize) / max(resolution, 1.0))),
+    0.0,
+    float(header.mipsAmount - 1)));
+
+  uint offset = 0;
+  for (uint i = 0; i < mip; i++)
+  {
+    uint tilesPerRow = (header.sourceSize >> i) / header.tileSize;
+    offset += tilesPerRow * tilesPerRow;
+  }
+
+  for (; mip < header.mipsAmount; mip++)
+  {
+    int size = int(header.sourceSize >> mip);
+    int tilesPerRow = size / tileSize;
+
+    // bilinear filtering reaches half a texel around the range
+    ivec2 tileMin = ivec2(floor((tex_coord_min * float(size) - 0.5) / float(tileSize)));
+    ivec2 tileMax = ivec2(floor((tex_coord_max * float(size) + 0.5) / float(tileSize)));
+
+    if (
+      all(lessThan(tileMax - tileMin, ivec2(STREAMED_HEIGHT_MAP_FEEDBACK_MAX_TILES))) ||
+      mip == header.mipsAmount - 1)
+    {
+      tileMax = min(tileMax, tileMin + tilesPerRow - 1);
+      for (int y = tileMin.y; y <= tileMax.y; y++)
+      {
+        for (int x = tileMin.x; x <= tileMax.x; x++)
+        {
+          ivec2 tile = ((ivec2(x, y) % tilesPerRow) + tilesPerRow) % tilesPerRow;
+          streamedHeightMapFeedback.requested[offset + uint(tile.y * tilesPerRow + tile.x)] = 1;
+        }
+      }
+      return;
+    }
+
+    offset += uint(tilesPerRow * tilesPerRow);
+  }
+}
+
+
+#endif // STREAMED_HEIGHT_MAP_FEEDBACK_GLSL_INCLUDED
@@ -0,0 +1,18 @@
+#ifndef TESSELLATION_STATS_H_INCLUDED
+#define TESSELLATION_STATS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Counted by tessellation control shaders of a frame, see tessellation_factors.glsl
+struct TessellationStats
+{
+  shader_uint patches;
+  // vertices the tessellator makes with the factors in use
+  shader_uint vertices;
+  // vertices it would make with the uniform factor on every edge
+  shader_uint uniformVertices;
+};
+
+
+#endif // TESSELLATION_STATS_H_INCLUDED
@@ -0,0 +1,24 @@
+#ifndef BISECTOR_PATCH_GLSL_INCLUDED
+#define BISECTOR_PATCH_GLSL_INCLUDED
+
+// Vertices of BisectorPatchMesh, a leaf per instance. Weights are the ones of gl_TessCoord,
+// so vertex shaders place them the same way tessellation evaluation shaders do
+
+#ifndef BISECTOR_PATCH_SET
+#define BISECTOR_PATCH_SET 0
+#endif
+
+layout(std430, set = BISECTOR_PATCH_SET, binding = BISECTOR_PATCH_BINDING) readonly buffer
+  bisector_patch_vertices_t
+{
+  vec2 bisectorPatchVertices[];
+};
+
+// leaf of the instance is gl_InstanceIndex
+vec3 bisectorPatchWeights()
+{
+  vec2 weights = bisectorPatchVertices[gl_VertexIndex];
+  return vec3(weights, 1.0 - weights.x - weights.y);
+}
+
+#endif // BISECTOR_PATCH_GLSL_INCLUDED
@@ -0,0 +1,212 @@
+#ifndef BISECTOR_POOL_GLSL_INCLUDED
+#define BISECTOR_POOL_GLSL_INCLUDED
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "leb_matrices.glsl"
+
+// shaders that use set 0 for their own resources move the pool to another one
+#ifndef BISECTOR_POOL_SET
+#define BISECTOR_POOL_SET 0
+#endif
+
+// Leaves of a square LEB subdivision in a fixed pool of slots with explicit neighbour links,
+// see BisectorPool. Heap ids are 64 bit, so the depth is not limited by a heap over every
+// possible node. Passes have a thread per active bisector, its slot is bisectorPoolActiveSlot
+
+const uint kBisectorNullSlot = 0xFFFFFFFFu;
+const int kBisectorPoolMaxDepth = 63;
+
+// command flags
+const uint kBisectorSplitRequested = 1u;
+const uint kBisectorMergeRequested = 2u;
+// slots of the command are valid, split children or merge parent
+const uint kBisectorAllocated = 4u;
+
+// edges of unmirrored vertices, left is u0 u1, right is u1 u2 and edge is the longest one u0 u2
+const uint kBisectorLeft = 0u;
+const uint kBisectorRight = 1u;
+const uint kBisectorEdge = 2u;
+
+struct BisectorPoolState
+{
+  uint capacity;
+  int maxDepth;
+  uint activeCount;
+  uint freeCount;
+  // active list read by the passes, finalize writes the other one
+  uint currentList;
+  uint allocated;
+  // base of the reservation crossing the end of free slots
+  uint straddleBase;
+  uint freedCount;
+  uint nextActiveCount;
+};
+
+struct Bisector
+{
+  uvec2 heapId; // low and high words
+  uint neighbours[3];
+};
+
+struct BisectorCommand
+{
+  uint flags;
+  uint slots[2];
+};
+
+layout(std430, set = BISECTOR_POOL_SET, binding = 0) buffer bisector_pool_state_t
+{
+  BisectorPoolState bisectorPool;
+};
+
+layout(std430, set = BISECTOR_POOL_SET, binding = 1) buffer bisector_pool_bisectors_t
+{
+  Bisector bisectors[];
+};
+
+layout(std430, set = BISECTOR_POOL_SET, binding = 2) buffer bisector_pool_commands_t
+{
+  BisectorCommand bisectorCommands[];
+};
+
+// two lists of capacity slots each
+layout(std430, set = BISECTOR_POOL_SET, binding = 3) buffer bisector_pool_active_t
+{
+  uint bisectorActiveSlots[];
+};
+
+// stack, allocation takes slots from the top
+layout(std430, set = BISECTOR_POOL_SET, binding = 4) buffer bisector_pool_free_t
+{
+  uint bisectorFreeSlots[];
+};
+
+
+uint bisectorPoolActiveCount()
+{
+  return bisectorPool.activeCount;
+}
+
+uint bisectorPoolActiveSlot(uint index)
+{
+  return bisectorActiveSlots[bisectorPool.currentList * bisectorPool.capacity + index];
+}
+
+int bisectorHeapIdDepth(uvec2 heap_id)
+{
+  return heap_id.y != 0u ? 32 + findMSB(heap_id.y) : findMSB(heap_id.x);
+}
+
+uvec2 bisectorHeapIdChild(uvec2 heap_id, uint child)
+{
+  return uvec2((heap_id.x << 1u) | child, (heap_id.y << 1u) | (heap_id.x >> 31u));
+}
+
+uvec2 bisectorHeapIdParent(uvec2 heap_id)
+{
+  return uvec2((heap_id.x >> 1u) | (heap_id.y << 31u), heap_id.y >> 1u);
+}
+
+int bisectorPoolDepth(uint slot)
+{
+  return bisectorHeapIdDepth(bisectors[slot].heapId);
+}
+
+uint bisectorPoolNeighbour(uint slot, uint which)
+{
+  return bisectors[slot].neighbours[which];
+}
+
+// ----- decoding, as leb.glsl does for a 32 bit heap index -----
+uint _bisectorHeapIdBits(uvec2 heap_id, int first_bit, int bit_count)
+{
+  // table entries never cross the word boundary
+  return first_bit >= 32 ? bitfieldExtract(heap_id.y, first_bit - 32, bit_count)
+                         : bitfieldExtract(heap_id.x, first_bit, bit_count);
+}
+
+mat3x3 _bisectorDecodeTransformationMatrix(uvec2 heap_id)
+{
+  int depth = bisectorHeapIdDepth(heap_id);
+  int splitBits = max(0, depth - 1);
+  uint isSecondTriangle = _bisectorHeapIdBits(heap_id, splitBits, 1);
+
+  mat3x3 transform = _lebGetSquareMatrix(isSecondTriangle);
+
+  // bits that do not fill a whole table entry go first, one at a time
+  int tableBitIndex = splitBits - splitBits % kLebSplitTableBits;
+  for (int bitIndex = splitBits - 1; bitIndex >= tableBitIndex; bitIndex--)
+  {
+    transform = _lebGetSplitMatrix(_bisectorHeapIdBits(heap_id, bitIndex, 1)) * transform;
+  }
+
+  for (tableBitIndex -= kLebSplitTableBits; tableBitIndex >= 0;
+       tableBitIndex -= kLebSplitTableBits)
+  {
+    uint entry = _bisectorHeapIdBits(heap_id, tableBitIndex, kLebSplitTableBits);
+    transform = kLebSplitTable[entry] * transform;
+  }
+
+  return _lebGetMirrorMatrix((depth ^ 1) & 1) * transform;
+}
+
+// vertices are float, edges of depth 48 bisectors are near float precision of the unit square
+vec3 bisectorPoolDecodeAttribute(uint slot, vec3 data)
+{
+  return _bisectorDecodeTransformationMatrix(bisectors[slot].heapId) * data;
+}
+
+mat2x3 bisectorPoolDecodeAttribute(uint slot, mat2x3 data)
+{
+  return _bisectorDecodeTransformationMatrix(bisectors[slot].heapId) * data;
+}
+
+mat3x3 bisectorPoolDecodeAttribute(uint slot, mat3x3 data)
+{
+  return _bisectorDecodeTransformationMatrix(bisectors[slot].heapId) * data;
+}
+
+// parent is not in the pool, it is decoded from the heap id, bisector should not be a root
+mat2x3 bisectorPoolDecodeParentAttribute(uint slot, mat2x3 data)
+{
+  return _bisectorDecodeTransformationMatrix(bisectorHeapIdParent(bisectors[slot].heapId)) * data;
+}
+
+// ----- classification -----
+// A bisector can be split together with a same depth twin only, longest edge neighbours of a
+// chain get coarser until there is one. That diamond is split in this pass and the bisector
+// itself in one of the next ones
+void bisectorPoolRequestSplit(uint slot)
+{
+  if (bisectorPoolDepth(slot) >= bisectorPool.maxDepth)
+  {
+    return;
+  }
+
+  uint current = slot;
+  for (int hop = 0; hop <= kBisectorPoolMaxDepth; hop++)
+  {
+    uint twin = bisectorPoolNeighbour(current, kBisectorEdge);
+    if (twin == kBisectorNullSlot)
+    {
+      atomicOr(bisectorCommands[current].flags, kBisectorSplitRequested);
+      return;
+    }
+    if (bisectorPoolNeighbour(twin, kBisectorEdge) == current)
+    {
+      atomicOr(bisectorCommands[current].flags, kBisectorSplitRequested);
+      atomicOr(bisectorCommands[twin].flags, kBisectorSplitRequested);
+      return;
+    }
+    current = twin;
+  }
+}
+
+// Merge happens only when all bisectors of the diamond request it
+void bisectorPoolRequestMerge(uint slot)
+{
+  atomicOr(bisectorCommands[slot].flags, kBisectorMergeRequested);
+}
+
+#endif // BISECTOR_POOL_GLSL_INCLUDED
@@ -2,13 +2,17 @@
 #define CBT_GLSL_INCLUDED
 
 
-// only once cbt for now
+// trees of the same max depth one after another, every tree has its own counts and dirty flag.
+// A tree is selected with cbtSetTree before anything else, the first one is used otherwise
 layout(std430, set = 0, binding = 0) buffer cbt_buffer
 {
   uint heap[];
 }
 cbt;
 
+// words of the trees before the selected one
+uint _cbtHeapOffset = 0u;
+
 struct CBTNode
 {
   uint index; // heap index
@@ -36,10 +40,17 @@ bool cbtNodeIsLeaf(CBTNode node);
 bool cbtNodeIsRoot(CBTNode node);
 bool cbtNodeIsNull(CBTNode node);
 
+// Tree selection (O(1))
+void cbtSetTree(uint tree_index);
+uint cbtTreeCount();
+
 // Tree queries (O(1))
 int cbtMaxDepth();
 uint cbtNodeCount();
 uint cbtHeapRead(CBTNode node);
+// Set by split and merge when they change the tree, cleared by the last reduction dispatch
+bool cbtIsDirty();
+void cbtClearDirty();
 
 // Node constructors (O(1))
 CBTNode cbtNodeGet(uint heap_index, int depth);
@@ -74,8 +85,8 @@ void _cbtSetBit(uint storage_index, uint bit_index, uint bit_value)
 {
   const uint bitMask = ~(1u << bit_index);
 
-  atomicAnd(cbt.heap[storage_index], bitMask);
-  atomicOr(cbt.heap[storage_index], bit_value << bit_index);
+  atomicAnd(cbt.heap[_cbtHeapOffset + storage_index], bitMask);
+  atomicOr(cbt.heap[_cbtHeapOffset + storage_index], bit_value << bit_index);
 }
 
 uint _cbtGetBitRange(uint bit_field, uint first_bit_index, uint bit_count)
@@ -88,12 +99,23 @@ void _cbtSetBitRange(uint storage_index, uint first_bit_index, uint bit_count, u
 {
   const uint bitMask = ~(~(kFullBitField << bit_count) << first_bit_index);
 
-  atomicAnd(cbt.heap[storage_index], bitMask);
-  atomicOr(cbt.heap[storage_index], bit_data << first_bit_index);
+  atomicAnd(cbt.heap[_cbtHeapOffset + storage_index], bitMask);
+  atomicOr(cbt.heap[_cbtHeapOffset + storage_index], bit_data << first_bit_index);
+}
+
+uint _cbtHeapLoad(uint storage_index)
+{
+  return cbt.heap[_cbtHeapOffset + storage_index];
+}
+
+void _cbtHeapStore(uint storage_index, uint bit_field)
+{
+  cbt.heap[_cbtHeapOffset + storage_index] = bit_field;
 }
 // ------------------------------------------
 
 // --- Tree queries ---
+// every tree has the same depth, so the first one tells it for all
 int cbtMaxDepth()
 {
   return findLSB(cbt.heap[0]);
@@ -104,6 +126,27 @@ uint cbtNodeCount()
   return cbtHeapRead(cbtNodeGet(1u, 0));
 }
 
+// bits between max depth bit and root node are unused, so the flag lives right after max depth
+uint _cbtDirtyMask()
+{
+  return 2u << cbtMaxDepth();
+}
+
+bool cbtIsDirty()
+{
+  return (_cbtHeapLoad(0u) & _cbtDirtyMask()) != 0u;
+}
+
+void _cbtMarkDirty()
+{
+  atomicOr(cbt.heap[_cbtHeapOffset], _cbtDirtyMask());
+}
+
+void cbtClearDirty()
+{
+  atomicAnd(cbt.heap[_cbtHeapOffset], ~_cbtDirtyMask());
+}
+
 uint _cbtHeapSizeBytes()
 {
   return 1u << (cbtMaxDepth() - 1);
@@ -115,6 +158,18 @@ uint _cbtHeapSizeU32s()
 }
 // -------------------
 
+// --- Tree selection ---
+void cbtSetTree(uint tree_index)
+{
+  _cbtHeapOffset = tree_index * _cbtHeapSizeU32s();
+}
+
+uint cbtTreeCount()
+{
+  return uint(cbt.heap.length()) / _cbtHeapSizeU32s();
+}
+// ----------------------
+
 // --- Tree node queries ---
 CBTNode cbtNodeGet(uint heap_index, int depth)
 {
@@ -249,13 +304,18 @@ _CBTHeapQueryArgs _cbtGetHeapQueryArgs(CBTNode node, int bit_count)
 uint _cbtHeapReadBitfield(CBTNode node)
 {
   uint bit_index = _cbtNodeBitIndexDeepestLeaf(node);
-  return _cbtGetBit(cbt.heap[bit_index >> 5u], bit_index & 31u);
+  return _cbtGetBit(_cbtHeapLoad(bit_index >> 5u), bit_index & 31u);
 }
 
 void _cbtHeapWriteBitfield(CBTNode node, uint bit_value)
 {
   uint bit_index = _cbtNodeBitIndexDeepestLeaf(node);
-  _cbtSetBit(bit_index >> 5u, bit_index & 31u, bit_value);
+  // a stale read only costs a redundant write, whoever changes the bit marks the tree dirty
+  if (_cbtGetBit(_cbtHeapLoad(bit_index >> 5u), bit_index & 31u) != bit_value)
+  {
+    _cbtSetBit(bit_index >> 5u, bit_index & 31u, bit_value);
+    _cbtMarkDirty();
+  }
 }
 
 uint _cbtHeapReadDirect(CBTNode node, int bit_count)
@@ -263,8 +323,8 @@ uint _cbtHeapReadDirect(CBTNode node, int bit_count)
   _CBTHeapQueryArgs args = _cbtGetHeapQueryArgs(node, bit_count);
 
   uint leftSideBits =
-    _cbtGetBitRange(cbt.heap[args.heapIndexLeft], args.bitOffsetLeft, args.bitCountLeft);
-  uint rightSideBits = _cbtGetBitRange(cbt.heap[args.heapIndexRight], 0u, args.bitCountRight);
+    _cbtGetBitRange(_cbtHeapLoad(args.heapIndexLeft), args.bitOffsetLeft, args.bitCountLeft);
+  uint rightSideBits = _cbtGetBitRange(_cbtHeapLoad(args.heapIndexRight), 0u, args.bitCountRight);
 
   return (leftSideBits | (rightSideBits << args.bitCountLeft));
 }
@@ -4,6 +4,7 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "cbt.glsl"
+#include "leb_matrices.glsl"
 
 struct LEBDiamondParent
 {
@@ -134,6 +135,39 @@ void lebSquareNodeSplit(CBTNode node)
   }
 }
 
+// a split adds a leaf when the bit it sets is still clear
+uint _lebSplitCost(CBTNode node)
+{
+  return cbtNodeIsDeepestLeaf(node) ? 0u : 1u - _cbtHeapReadBitfield(cbtNodeGetRightChild(node));
+}
+
+// Leaves lebSquareNodeSplit would add, see cbt_reference::leb_square_split_cost. Splits of the
+// same pass may share some of them, so for a pass it is an upper bound
+uint lebSquareNodeSplitCost(CBTNode node)
+{
+  if (cbtNodeIsDeepestLeaf(node))
+  {
+    return 0u;
+  }
+
+  CBTNode nodeIterator = node;
+  uint cost = _lebSplitCost(nodeIterator);
+  nodeIterator = _lebSquareEdgeNeighbour(nodeIterator);
+
+  while (nodeIterator.index > 1u)
+  {
+    cost += _lebSplitCost(nodeIterator);
+    nodeIterator = cbtNodeGetParentFast(nodeIterator);
+    if (nodeIterator.index > 1u)
+    {
+      cost += _lebSplitCost(nodeIterator);
+      nodeIterator = _lebSquareEdgeNeighbour(nodeIterator);
+    }
+  }
+
+  return cost;
+}
+
 LEBDiamondParent lebDiamondParentDecode(CBTNode node)
 {
   CBTNode parent = cbtNodeGetParentFast(node);
@@ -178,53 +212,39 @@ void lebSquareNodeMerge(CBTNode node, LEBDiamondParent diamond_parent)
   }
 }
 
-mat3x3 _lebGetSplitMatrix(uint split_bit)
+// bits that do not fill a whole table entry go first, one at a time
+mat3x3 _lebDecodeSplitMatrices(CBTNode node, int split_bits, mat3x3 transform)
 {
-  float bit = float(split_bit);
-  float oppositeBit = 1.0 - bit;
-  return transpose(mat3x3(oppositeBit, bit, 0.0, 0.5, 0.0, 0.5, 0.0, oppositeBit, bit));
-}
-
-mat3x3 _lebGetSquareMatrix(uint quad_bit)
-{
-  float bit = float(quad_bit);
-  float oppositeBit = 1.0 - bit;
-
-  return transpose(mat3x3(oppositeBit, 0.0, bit, bit, oppositeBit, bit, bit, 0.0, oppositeBit));
-}
+  int tableBitIndex = split_bits - split_bits % kLebSplitTableBits;
+  for (int bitIndex = split_bits - 1; bitIndex >= tableBitIndex; bitIndex--)
+  {
+    transform = _lebGetSplitMatrix(_lebGetBit(node.index, bitIndex)) * transform;
+  }
 
-mat3x3 _lebGetMirrorMatrix(uint mirror_bit)
-{
-  float bit = float(mirror_bit);
-  float oppositeBit = 1.0 - bit;
+  for (tableBitIndex -= kLebSplitTableBits; tableBitIndex >= 0;
+       tableBitIndex -= kLebSplitTableBits)
+  {
+    uint entry = bitfieldExtract(node.index, tableBitIndex, kLebSplitTableBits);
+    transform = kLebSplitTable[entry] * transform;
+  }
 
-  return mat3x3(oppositeBit, 0.0, bit, 0, 1.0, 0, bit, 0.0, oppositeBit);
+  return transform;
 }
 
 mat3x3 _lebDecodeTransformationMatrix(CBTNode node)
 {
-  mat3x3 transform = mat3x3(1.0);
-
-  for (int bitIndex = node.depth - 1; bitIndex >= 0; bitIndex--)
-  {
-    transform = _lebGetSplitMatrix(_lebGetBit(node.index, bitIndex)) * transform;
-  }
-  transform = _lebGetMirrorMatrix(node.depth & 1) * transform;
+  mat3x3 transform = _lebDecodeSplitMatrices(node, node.depth, mat3x3(1.0));
 
-  return transform;
+  return _lebGetMirrorMatrix(node.depth & 1) * transform;
 }
 
 mat3x3 _lebSquareDecodeTransformationMatrix(CBTNode node)
 {
   uint isSecondTriangle = _lebGetBit(node.index, max(0, node.depth - 1));
 
-  mat3x3 transform = _lebGetSquareMatrix(isSecondTriangle);
+  mat3x3 transform = _lebDecodeSplitMatrices(
+    node, max(0, node.depth - 1), _lebGetSquareMatrix(isSecondTriangle));
 
-  for (int bitIndex = node.depth - 2; bitIndex >= 0; bitIndex--)
-  {
-    transform = _lebGetSplitMatrix(_lebGetBit(node.index, bitIndex)) * transform;
-  }
-  
   return _lebGetMirrorMatrix((node.depth ^ 1) & 1) * transform;
 }
 
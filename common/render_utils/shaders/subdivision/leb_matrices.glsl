@@ -0,0 +1,50 @@
+#ifndef LEB_MATRICES_GLSL_INCLUDED
+#define LEB_MATRICES_GLSL_INCLUDED
+
+// Subdivision matrices of leb.glsl, apart so that decoders of other node storages can use them
+
+mat3x3 _lebGetSplitMatrix(uint split_bit)
+{
+  float bit = float(split_bit);
+  float oppositeBit = 1.0 - bit;
+  return transpose(mat3x3(oppositeBit, bit, 0.0, 0.5, 0.0, 0.5, 0.0, oppositeBit, bit));
+}
+
+mat3x3 _lebGetSquareMatrix(uint quad_bit)
+{
+  float bit = float(quad_bit);
+  float oppositeBit = 1.0 - bit;
+
+  return transpose(mat3x3(oppositeBit, 0.0, bit, bit, oppositeBit, bit, bit, 0.0, oppositeBit));
+}
+
+mat3x3 _lebGetMirrorMatrix(uint mirror_bit)
+{
+  float bit = float(mirror_bit);
+  float oppositeBit = 1.0 - bit;
+
+  return mat3x3(oppositeBit, 0.0, bit, 0, 1.0, 0, bit, 0.0, oppositeBit);
+}
+
+// split matrices of 4 consecutive heap index bits multiplied together, entry i consumes the bits
+// of i from the highest one, see cbt_reference::leb_split_table
+const int kLebSplitTableBits = 4;
+const mat3x3 kLebSplitTable[16] = mat3x3[16](
+  mat3x3(1.0, 0.75, 0.75, 0.0, 0.25, 0.0, 0.0, 0.0, 0.25),
+  mat3x3(0.75, 0.75, 0.5, 0.0, 0.25, 0.5, 0.25, 0.0, 0.0),
+  mat3x3(0.5, 0.5, 0.75, 0.5, 0.25, 0.0, 0.0, 0.25, 0.25),
+  mat3x3(0.75, 0.5, 0.5, 0.0, 0.25, 0.0, 0.25, 0.25, 0.5),
+  mat3x3(0.5, 0.5, 0.25, 0.0, 0.25, 0.5, 0.5, 0.25, 0.25),
+  mat3x3(0.25, 0.5, 0.5, 0.5, 0.25, 0.5, 0.25, 0.25, 0.0),
+  mat3x3(0.5, 0.25, 0.25, 0.5, 0.75, 0.5, 0.0, 0.0, 0.25),
+  mat3x3(0.25, 0.25, 0.0, 0.5, 0.75, 1.0, 0.25, 0.0, 0.0),
+  mat3x3(0.0, 0.0, 0.25, 1.0, 0.75, 0.5, 0.0, 0.25, 0.25),
+  mat3x3(0.25, 0.0, 0.0, 0.5, 0.75, 0.5, 0.25, 0.25, 0.5),
+  mat3x3(0.0, 0.25, 0.25, 0.5, 0.25, 0.5, 0.5, 0.5, 0.25),
+  mat3x3(0.25, 0.25, 0.5, 0.5, 0.25, 0.0, 0.25, 0.5, 0.5),
+  mat3x3(0.5, 0.25, 0.25, 0.0, 0.25, 0.0, 0.5, 0.5, 0.75),
+  mat3x3(0.25, 0.25, 0.0, 0.0, 0.25, 0.5, 0.75, 0.5, 0.5),
+  mat3x3(0.0, 0.0, 0.25, 0.5, 0.25, 0.0, 0.5, 0.75, 0.75),
+  mat3x3(0.25, 0.0, 0.0, 0.0, 0.25, 0.0, 0.75, 0.75, 1.0));
+
+#endif // LEB_MATRICES_GLSL_INCLUDED
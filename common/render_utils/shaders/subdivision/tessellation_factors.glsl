@@ -0,0 +1,71 @@
+#ifndef TESSELLATION_FACTORS_GLSL_INCLUDED
+#define TESSELLATION_FACTORS_GLSL_INCLUDED
+
+// Per edge tessellation factors of triangle patches with equal spacing. Neighbouring bisectors
+// decode bitwise equal vertices of their shared edge, so a factor that depends on the edge
+// endpoints alone and not on their order never makes cracks
+
+// Segments for the edge to take segments_factor of them per unit of its length over camera
+// distance, endpoints are in view space
+float edgeLengthSegments(vec3 first, vec3 second, float segments_factor)
+{
+  return segments_factor * distance(first, second) / length(0.5 * (first + second));
+}
+
+// Length tells how many segments are seen, error tells how many are needed, flat edges stay whole
+float edgeTessellationFactor(float length_segments, float error_segments, float max_factor)
+{
+  return clamp(min(length_segments, error_segments), 1.0, max_factor);
+}
+
+// outer levels follow gl_TessLevelOuter, edges opposite to the first, second and third vertex
+float innerTessellationFactor(vec3 outer)
+{
+  return max(max(outer.x, outer.y), outer.z);
+}
+
+// Vertices made by the tessellator for the levels, rounded up as equal spacing does. Inner rings
+// lose two segments each and end with a vertex or a triangle
+uint tessellatedVertexCount(vec3 outer, float inner)
+{
+  uvec3 outerSegments = uvec3(max(ceil(outer), vec3(1.0)));
+  uint innerSegments = uint(max(ceil(inner), 1.0));
+
+  if (innerSegments == 1u)
+  {
+    if (all(equal(outerSegments, uvec3(1u))))
+    {
+      return 3u;
+    }
+    innerSegments = 2u;
+  }
+
+  uint ringVertices = (innerSegments & 1u) == 1u
+    ? 3u * ((innerSegments - 1u) / 2u) * ((innerSegments - 1u) / 2u)
+    : 3u * (innerSegments / 2u - 1u) * (innerSegments / 2u) + 1u;
+
+  return outerSegments.x + outerSegments.y + outerSegments.z + ringVertices;
+}
+
+#ifdef TESSELLATION_STATS_BINDING
+
+#include "TessellationStats.h"
+
+// cleared by the host before the frame is recorded
+layout(std430, set = 0, binding = TESSELLATION_STATS_BINDING) buffer tessellation_stats_t
+{
+  TessellationStats tessellationStats;
+};
+
+void countTessellatedVertices(vec3 outer, float inner, float uniform_factor)
+{
+  atomicAdd(tessellationStats.patches, 1u);
+  atomicAdd(tessellationStats.vertices, tessellatedVertexCount(outer, inner));
+  atomicAdd(
+    tessellationStats.uniformVertices,
+    tessellatedVertexCount(vec3(uniform_factor), uniform_factor));
+}
+
+#endif // TESSELLATION_STATS_BINDING
+
+#endif // TESSELLATION_FACTORS_GLSL_INCLUDED
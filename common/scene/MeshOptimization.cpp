@@ -0,0 +1,183 @@
+#include "MeshOptimization.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <etna/Assert.hpp>
+
+
+namespace mesh_optimization
+{
+
+VertexCacheStats measure_vertex_cache(
+  std::span<const std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size)
+{
+  std::deque<std::uint32_t> cache;
+  std::vector<bool> used(vertex_count, false);
+
+  std::uint32_t misses = 0;
+  std::uint32_t usedVertices = 0;
+  for (auto index : indices)
+  {
+    if (!used[index])
+    {
+      used[index] = true;
+      usedVertices++;
+    }
+
+    bool hit = false;
+    for (auto cached : cache)
+    {
+      hit = hit || cached == index;
+    }
+    if (hit)
+    {
+      continue;
+    }
+
+    misses++;
+    cache.push_back(index);
+    if (cache.size() > cache_size)
+    {
+      cache.pop_front();
+    }
+  }
+
+  std::size_t triangleCount = indices.size() / 3;
+  return VertexCacheStats{
+    .acmr = triangleCount == 0 ? 0.0f : static_cast<float>(misses) / triangleCount,
+    .atvr = usedVertices == 0 ? 0.0f : static_cast<float>(misses) / usedVertices};
+}
+
+void optimize_vertex_cache(
+  std::span<std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size)
+{
+  ETNA_VERIFYF(indices.size() % 3 == 0, "Triangle list expected, got {} indices", indices.size());
+
+  std::uint32_t triangleCount = static_cast<std::uint32_t>(indices.size() / 3);
+
+  // triangles adjacent to every vertex, stored as offsets into one array
+  std::vector<std::uint32_t> liveTriangles(vertex_count, 0);
+  for (auto index : indices)
+  {
+    ETNA_VERIFYF(index < vertex_count, "Index {} is out of {} vertices", index, vertex_count);
+    liveTriangles[index]++;
+  }
+
+  std::vector<std::uint32_t> adjacencyOffsets(vertex_count + 1, 0);
+  for (std::uint32_t vertex = 0; vertex < vertex_count; vertex++)
+  {
+    adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+  }
+
+  std::vector<std::uint32_t> adjacency(indices.size());
+  {
+    std::vector<std::uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (std::uint32_t triangle = 0; triangle < triangleCount; triangle++)
+    {
+      for (std::uint32_t corner = 0; corner < 3; corner++)
+      {
+        adjacency[fill[indices[triangle * 3 + corner]]++] = triangle;
+      }
+    }
+  }
+
+  std::vector<std::uint32_t> cacheTimestamps(vertex_count, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<std::uint32_t> deadEnds;
+  std::vector<std::uint32_t> candidates;
+
+  std::vector<std::uint32_t> result;
+  result.reserve(indices.size());
+
+  std::uint32_t timestamp = cache_size + 1;
+  std::uint32_t cursor = 0;
+
+  auto skipDeadEnd = [&]() -> std::int64_t {
+    while (!deadEnds.empty())
+    {
+      std::uint32_t vertex = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveTriangles[vertex] > 0)
+      {
+        return vertex;
+      }
+    }
+
+    while (cursor < vertex_count)
+    {
+      std::uint32_t vertex = cursor++;
+      if (liveTriangles[vertex] > 0)
+      {
+        return vertex;
+      }
+    }
+
+    return -1;
+  };
+
+  std::int64_t fanningVertex = skipDeadEnd();
+  while (fanningVertex >= 0)
+  {
+    candidates.clear();
+
+    std::uint32_t vertex = static_cast<std::uint32_t>(fanningVertex);
+    for (std::uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; i++)
+    {
+      std::uint32_t triangle = adjacency[i];
+      if (emitted[triangle])
+      {
+        continue;
+      }
+
+      for (std::uint32_t corner = 0; corner < 3; corner++)
+      {
+        std::uint32_t cornerVertex = indices[triangle * 3 + corner];
+        result.push_back(cornerVertex);
+        deadEnds.push_back(cornerVertex);
+        candidates.push_back(cornerVertex);
+        liveTriangles[cornerVertex]--;
+        if (timestamp - cacheTimestamps[cornerVertex] > cache_size)
+        {
+          cacheTimestamps[cornerVertex] = timestamp++;
+        }
+      }
+      emitted[triangle] = true;
+    }
+
+    // prefer the candidate that stays in cache the longest while its triangles are emitted
+    std::int64_t nextVertex = -1;
+    std::uint32_t bestPriority = 0;
+    for (auto candidate : candidates)
+    {
+      if (liveTriangles[candidate] == 0)
+      {
+        continue;
+      }
+
+      std::uint32_t priority = 0;
+      if (timestamp - cacheTimestamps[candidate] + 2 * liveTriangles[candidate] <= cache_size)
+      {
+        priority = timestamp - cacheTimestamps[candidate];
+      }
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        nextVertex = candidate;
+      }
+    }
+
+    fanningVertex = nextVertex >= 0 ? nextVertex : skipDeadEnd();
+  }
+
+  ETNA_VERIFYF(
+    result.size() == indices.size(),
+    "Reordering lost triangles, got {} indices, needed - {}",
+    result.size(),
+    indices.size());
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+}; // namespace mesh_optimization
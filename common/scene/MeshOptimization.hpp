@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+
+namespace mesh_optimization
+{
+
+struct VertexCacheStats
+{
+  // average cache miss ratio, transformed vertices per triangle
+  float acmr;
+  // average transform to vertex ratio, transformed vertices per unique vertex
+  float atvr;
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries over triangle list indices
+VertexCacheStats measure_vertex_cache(
+  std::span<const std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size);
+
+// Reorders triangles in place for post-transform cache reuse (Tipsify, Sander et al. 2007).
+// Vertices and triangle winding stay the same, only the order of triangles changes
+void optimize_vertex_cache(
+  std::span<std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size);
+
+}; // namespace mesh_optimization
@@ -61,3 +61,27 @@ struct MaterialGLSLCompat {
   std::uint32_t _padding2 = 0;
 };
 static_assert(sizeof(MaterialGLSLCompat) % (sizeof(float) * 4) == 0);
+
+// Placement of a single clipmap instance, position of a vertex in world space is
+// offset + rotate(position, rotation) * 2^scaleExponent
+struct ClipmapInstanceGLSLCompat
+{
+  glm::vec2 offset;
+  std::uint32_t scaleExponent;
+  // 0 - 0 degrees, 1 - 90 degrees, 2 - 270 degrees, 3 - 180 degrees
+  std::uint32_t rotation;
+};
+static_assert(sizeof(ClipmapInstanceGLSLCompat) == sizeof(float) * 4);
+
+// Describes how positions of clipmap relem vertices are derived from vertex index, vertices are
+// laid out in rows of rowLength, or along the outline of a square with perimeterSide long sides
+struct ClipmapRelemLayoutGLSLCompat
+{
+  glm::vec2 origin;
+  glm::vec2 step;
+  std::uint32_t vertexOffset;
+  std::uint32_t rowLength;
+  std::uint32_t perimeterSide;
+  std::uint32_t _padding0 = 0;
+};
+static_assert(sizeof(ClipmapRelemLayoutGLSLCompat) % (sizeof(float) * 4) == 0);
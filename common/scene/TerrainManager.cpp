@@ -1,9 +1,10 @@
 #include "TerrainManager.hpp"
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 #include <glm/fwd.hpp>
-#include <glm/ext/matrix_transform.hpp>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
@@ -11,11 +12,17 @@
 #include <fmt/std.h>
 
 #include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/Profiling.hpp>
+#include <etna/Etna.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 
 #include "RenderStructs.hpp"
+#include "MeshOptimization.hpp"
+#include "clipmap/HeightBounds.h"
 
 
 #define DEBUG_FILE_WRITE 0
@@ -65,6 +72,7 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
     std::size_t relemsAmount = 2 + 1 + 4 + 2 + 1;
     result.relems.reserve(relemsAmount);
     result.bounds.reserve(relemsAmount);
+    result.layouts.reserve(relemsAmount);
     result.meshes.reserve(1 + 1 + 1 + 1 + 1);
   }
 
@@ -108,6 +116,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(-static_cast<float>(tileSize), 0),
+          .step = glm::vec2(1, 1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = 2 * vertexTileSize,
+          .perimeterSide = 0});
       result.bounds.emplace_back(
         Bounds{
           .minPos = {-static_cast<int32_t>(tileSize), 0},
@@ -204,6 +219,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(0, -static_cast<float>(tileSize)),
+          .step = glm::vec2(1, 1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = 2,
+          .perimeterSide = 0});
       result.bounds.emplace_back(
         Bounds{
           .minPos = {0, -static_cast<int32_t>(tileSize)},
@@ -304,6 +326,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
       }
     }
 
+    result.layouts.emplace_back(
+      ClipmapRelemLayoutGLSLCompat{
+        .origin = glm::vec2(0, 0),
+        .step = glm::vec2(1, 1),
+        .vertexOffset = relem.vertexOffset,
+        .rowLength = vertexTileSize,
+        .perimeterSide = 0});
     result.bounds.emplace_back(
       Bounds{.minPos = {0, 0}, .maxPos = {vertexTileSize - 1, vertexTileSize - 1}});
 
@@ -407,6 +436,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(offset + 1, 0),
+          .step = glm::vec2(1, 1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = vertexTileSize,
+          .perimeterSide = 0});
       result.bounds.emplace_back(Bounds{.minPos = {0, 0}, .maxPos = {offset + vertexTileSize, 1}});
 
 #if DEBUG_FILE_WRITE
@@ -497,6 +533,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(0, offset + 1),
+          .step = glm::vec2(1, 1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = 2,
+          .perimeterSide = 0});
       result.bounds.emplace_back(Bounds{.minPos = {0, 0}, .maxPos = {1, offset + vertexTileSize}});
 
 #if DEBUG_FILE_WRITE
@@ -589,6 +632,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(-static_cast<float>(offset), 0),
+          .step = glm::vec2(-1, 1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = vertexTileSize,
+          .perimeterSide = 0});
       result.bounds.emplace_back(
         Bounds{
           .minPos = {-int32_t(offset + vertexTileSize - 1), 0},
@@ -682,6 +732,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(0, -static_cast<float>(offset)),
+          .step = glm::vec2(1, -1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = 2,
+          .perimeterSide = 0});
       result.bounds.emplace_back(
         Bounds{
           .minPos = {0, -int32_t(offset + vertexTileSize - 1)},
@@ -784,6 +841,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(0, vertexGridSize - 1) + vertexOffset,
+          .step = glm::vec2(1, -1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = 2,
+          .perimeterSide = 0});
       result.bounds.emplace_back(
         Bounds{
           .minPos = glm::vec2(0, 0) + vertexOffset,
@@ -874,6 +938,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
         }
       }
 
+      result.layouts.emplace_back(
+        ClipmapRelemLayoutGLSLCompat{
+          .origin = glm::vec2(1, 0) + vertexOffset,
+          .step = glm::vec2(1, 1),
+          .vertexOffset = relem.vertexOffset,
+          .rowLength = vertexGridSize - 1,
+          .perimeterSide = 0});
       result.bounds.emplace_back(
         Bounds{
           .minPos = glm::vec2(1, 0) + vertexOffset,
@@ -1005,6 +1076,13 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
 #endif
     }
 
+    result.layouts.emplace_back(
+      ClipmapRelemLayoutGLSLCompat{
+        .origin = glm::vec2(0, 0),
+        .step = glm::vec2(1, 1),
+        .vertexOffset = relem.vertexOffset,
+        .rowLength = 0,
+        .perimeterSide = vertexGridSize - 1});
     result.bounds.emplace_back(
       Bounds{.minPos = {0, 0}, .maxPos = {vertexGridSize, vertexGridSize}});
 #if DEBUG_FILE_WRITE
@@ -1076,9 +1154,56 @@ TerrainManager::ProcessedMeshes TerrainManager::initializeMeshes() const
     }
   }
 
+  // vertices are never uploaded, shaders rebuild them from layouts and must get the same positions
+  for (std::size_t relemIdx = 0; relemIdx < result.relems.size(); relemIdx++)
+  {
+    const auto& layout = result.layouts[relemIdx];
+    std::size_t vertexEnd = relemIdx + 1 < result.relems.size()
+      ? result.relems[relemIdx + 1].vertexOffset
+      : result.vertices.size();
+
+    for (std::size_t vertexIdx = layout.vertexOffset; vertexIdx < vertexEnd; vertexIdx++)
+    {
+      glm::vec2 pulledPosition = pullVertexPosition(
+        layout, static_cast<std::uint32_t>(vertexIdx - layout.vertexOffset));
+      ETNA_VERIFYF(
+        pulledPosition == result.vertices[vertexIdx].position,
+        "Relem {} layout gives wrong position for vertex {}, got - {}, needed - {}",
+        relemIdx,
+        vertexIdx,
+        glm::to_string(pulledPosition),
+        glm::to_string(result.vertices[vertexIdx].position));
+    }
+  }
+
   return result;
 }
 
+glm::vec2 TerrainManager::pullVertexPosition(
+  const ClipmapRelemLayoutGLSLCompat& layout, std::uint32_t vertex_index) const
+{
+  // same as pullClipmapVertex in clipmap_vertex.glsl
+  if (layout.perimeterSide != 0)
+  {
+    float side = static_cast<float>(layout.perimeterSide);
+    float t = static_cast<float>(vertex_index % layout.perimeterSide);
+    switch (vertex_index / layout.perimeterSide)
+    {
+    case 0:
+      return layout.origin + glm::vec2(t, 0);
+    case 1:
+      return layout.origin + glm::vec2(side, t);
+    case 2:
+      return layout.origin + glm::vec2(side - t, side);
+    default:
+      return layout.origin + glm::vec2(0, side - t);
+    }
+  }
+
+  return layout.origin +
+    glm::vec2(vertex_index % layout.rowLength, vertex_index / layout.rowLength) * layout.step;
+}
+
 TerrainManager::ProcessedInstances TerrainManager::processInstances() const
 {
   ProcessedInstances result;
@@ -1086,7 +1211,7 @@ TerrainManager::ProcessedInstances TerrainManager::processInstances() const
   std::size_t instancesAmount =
     1 + 4 + 12 * clipmapLevels + clipmapLevels + clipmapLevels + clipmapLevels;
 
-  result.matrices.reserve(instancesAmount);
+  result.instances.reserve(instancesAmount);
   result.meshes.reserve(instancesAmount);
 
   std::uint32_t crossMesh = 0;
@@ -1095,52 +1220,50 @@ TerrainManager::ProcessedInstances TerrainManager::processInstances() const
   std::uint32_t trimMesh = 3;
   std::uint32_t seamMesh = 4;
 
-  const auto& identityMat = glm::identity<glm::mat4x4>();
-
   // cross and 4 inner squares
   {
-    result.matrices.emplace_back(identityMat);
+    result.instances.emplace_back(ClipmapInstanceGLSLCompat{.scaleExponent = 0, .rotation = 0});
     result.meshes.emplace_back(crossMesh);
 
     for (uint32_t x = 0; x < 2; x++)
     {
       for (uint32_t y = 0; y < 2; y++)
       {
-        result.matrices.emplace_back(identityMat);
+        result.instances.emplace_back(
+          ClipmapInstanceGLSLCompat{.scaleExponent = 0, .rotation = 0});
         result.meshes.emplace_back(squareMesh);
       }
     }
   }
 
-  uint32_t scale = 1;
   for (uint32_t level = 0; level < clipmapLevels; level++)
   {
-    scale = 1u << level;
     for (uint32_t i = 0; i < 12; i++)
     {
-      result.matrices.emplace_back(glm::scale(identityMat, {scale, 1, scale}));
+      result.instances.emplace_back(
+        ClipmapInstanceGLSLCompat{.scaleExponent = level, .rotation = 0});
       result.meshes.emplace_back(squareMesh);
     }
   }
 
   for (uint32_t level = 0; level < clipmapLevels; level++)
   {
-    scale = 1u << level;
-    result.matrices.emplace_back(glm::scale(identityMat, {scale, 1, scale}));
+    result.instances.emplace_back(
+      ClipmapInstanceGLSLCompat{.scaleExponent = level, .rotation = 0});
     result.meshes.emplace_back(fillerMesh);
   }
 
   for (uint32_t level = 0; level < clipmapLevels; level++)
   {
-    scale = 1u << level;
-    result.matrices.emplace_back(glm::scale(identityMat, {scale, 1, scale}));
+    result.instances.emplace_back(
+      ClipmapInstanceGLSLCompat{.scaleExponent = level, .rotation = 0});
     result.meshes.emplace_back(trimMesh);
   }
 
   for (uint32_t level = 0; level < clipmapLevels; level++)
   {
-    scale = 1u << level;
-    result.matrices.emplace_back(glm::scale(identityMat, {scale, 1, scale}));
+    result.instances.emplace_back(
+      ClipmapInstanceGLSLCompat{.scaleExponent = level, .rotation = 0});
     result.meshes.emplace_back(seamMesh);
   }
 
@@ -1148,29 +1271,37 @@ TerrainManager::ProcessedInstances TerrainManager::processInstances() const
   return result;
 }
 
-void TerrainManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+void TerrainManager::uploadData(std::span<const std::uint32_t> indices)
 {
   auto& ctx = etna::get_context();
 
-  unifiedVbuf = ctx.createBuffer(
-    etna::Buffer::CreateInfo{
-      .size = vertices.size_bytes(),
-      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-      .name = "unifiedTerrainVbuf",
-    });
+  // indices are local to relems, so 16 bits are enough unless some relem is too large
+  std::uint32_t maxIndex = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end());
+  indexType = vk::IndexType::eUint32;
+  if (maxIndex <= std::numeric_limits<std::uint16_t>::max())
+  {
+    indexType = vk::IndexType::eUint16;
+  }
 
   unifiedIbuf = ctx.createBuffer(
     etna::Buffer::CreateInfo{
-      .size = indices.size_bytes(),
+      .size = indices.size() *
+        (indexType == vk::IndexType::eUint16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t)),
       .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
       .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
       .name = "unifiedTerrainIbuf",
     });
 
-  transferHelper->uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper->uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  if (indexType == vk::IndexType::eUint16)
+  {
+    std::vector<std::uint16_t> shortIndices(indices.begin(), indices.end());
+    transferHelper->uploadBuffer<std::uint16_t>(
+      *oneShotCommands, unifiedIbuf, 0, std::span(shortIndices));
+  }
+  else
+  {
+    transferHelper->uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  }
 
   unifiedRelemsbuf = ctx.createBuffer(
     etna::Buffer::CreateInfo{
@@ -1202,6 +1333,13 @@ void TerrainManager::uploadData(
         vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
       .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
       .name = "unifiedBoundsbuf"});
+  unifiedRelemLayoutsbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = renderElementsLayouts.size() * sizeof(ClipmapRelemLayoutGLSLCompat),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "unifiedRelemLayoutsbuf"});
   unifiedMeshesbuf = ctx.createBuffer(
     etna::Buffer::CreateInfo{
       .size = meshes.size() * sizeof(Mesh),
@@ -1210,24 +1348,42 @@ void TerrainManager::uploadData(
       .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
       .name = "unifiedMeshesbuf"});
 
-  unifiedInstanceMatricesbuf.emplace(
+  unifiedInstancesbuf.emplace(
     ctx.getMainWorkCount(),
-    [&ctx, instanceMatricesSize = this->instanceMatrices.size()](std::size_t i) {
-      return ctx.createBuffer(
-        etna::Buffer::CreateInfo{
-          .size = instanceMatricesSize * sizeof(glm::mat4x4),
-          .bufferUsage =
-            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
-          .memoryUsage = VMA_MEMORY_USAGE_AUTO,
-          .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-            VMA_ALLOCATION_CREATE_MAPPED_BIT,
-          .name = fmt::format("unifiedInstanceMatricesbuf{}", i)});
+    [&ctx, instancesSize = this->instances.size(), levels = this->clipmapLevels](std::size_t i) {
+      InstancesBuffer result = {
+        .buffer = ctx.createBuffer(
+          etna::Buffer::CreateInfo{
+            .size = instancesSize * sizeof(ClipmapInstanceGLSLCompat),
+            .bufferUsage =
+              vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+            .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+            .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+              VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .name = fmt::format("unifiedInstancesbuf{}", i)}),
+        .levelPositions = std::vector<std::optional<glm::vec2>>(levels)};
+
+      // stays mapped for the whole lifetime, moveClipmap writes only the levels that moved
+      result.buffer.map();
+
+      return result;
     });
 
+  gpuInstancesbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = instances.size() * sizeof(ClipmapInstanceGLSLCompat),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "gpuInstancesbuf"});
+
+  transferHelper->uploadBuffer<ClipmapInstanceGLSLCompat>(
+    *oneShotCommands, gpuInstancesbuf, 0, std::span(instances));
+
   spdlog::info(
-    "{} - relem bounds size, {} - instance matrices size",
+    "{} - relem bounds size, {} - instances size",
     renderElementsBounds.size(),
-    instanceMatrices.size());
+    instances.size());
 
   unifiedInstanceMeshesbuf = ctx.createBuffer(
     etna::Buffer::CreateInfo{
@@ -1239,34 +1395,14 @@ void TerrainManager::uploadData(
 
   transferHelper->uploadBuffer<Bounds>(
     *oneShotCommands, unifiedBoundsbuf, 0, std::span(renderElementsBounds));
+  transferHelper->uploadBuffer<ClipmapRelemLayoutGLSLCompat>(
+    *oneShotCommands, unifiedRelemLayoutsbuf, 0, std::span(renderElementsLayouts));
   transferHelper->uploadBuffer<Mesh>(*oneShotCommands, unifiedMeshesbuf, 0, std::span(meshes));
 
   transferHelper->uploadBuffer<std::uint32_t>(
     *oneShotCommands, unifiedInstanceMeshesbuf, 0, std::span(instanceMeshes));
 
-  std::size_t drawRelemsInstancesIndicesSize = 0;
-  for (auto meshIndex : instanceMeshes)
-  {
-    drawRelemsInstancesIndicesSize += meshes[meshIndex].relemCount;
-  }
-
-  // filled on GPU when culling
-  unifiedDrawRelemsInstanceIndicesbuf = ctx.createBuffer(
-    etna::Buffer::CreateInfo{
-      .size = drawRelemsInstancesIndicesSize * sizeof(std::uint32_t),
-      .bufferUsage =
-        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
-      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-      .name = "unifiedDrawRelemsInstanceIndicesbuf"});
-
-  unifiedRelemInstanceOffsetsbuf = ctx.createBuffer(
-    etna::Buffer::CreateInfo{
-      .size = renderElements.size() * sizeof(std::uint32_t),
-      .bufferUsage =
-        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
-      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-      .name = "unifiedRelemInstanceOffsetsbuf"});
-
+  // every culling pair is one instance of one relem, pairs of a relem are contiguous
   std::vector<std::uint32_t> relemInstanceOffsets(renderElements.size(), 0);
   for (const auto& meshIdx : instanceMeshes)
   {
@@ -1287,59 +1423,663 @@ void TerrainManager::uploadData(
     amount = offset;
     offset += previousAmount;
   }
+  cullingPairsCount = offset;
+
+  std::vector<glm::uvec2> cullingPairs(cullingPairsCount);
+  {
+    std::vector<std::uint32_t> relemPairsWritten(renderElements.size(), 0);
+    for (std::uint32_t instanceIdx = 0; instanceIdx < instanceMeshes.size(); instanceIdx++)
+    {
+      const auto& currentMesh = meshes[instanceMeshes[instanceIdx]];
+      for (std::uint32_t relemIdx = currentMesh.firstRelem;
+           relemIdx < currentMesh.firstRelem + currentMesh.relemCount;
+           relemIdx++)
+      {
+        cullingPairs[relemInstanceOffsets[relemIdx] + relemPairsWritten[relemIdx]++] = {
+          instanceIdx, relemIdx};
+      }
+    }
+  }
+
+  unifiedCullingPairsbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = cullingPairsCount * sizeof(glm::uvec2),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "unifiedCullingPairsbuf"});
+
+  transferHelper->uploadBuffer<glm::uvec2>(
+    *oneShotCommands, unifiedCullingPairsbuf, 0, std::span(cullingPairs));
+
+  unifiedRelemInstanceOffsetsbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = renderElements.size() * sizeof(std::uint32_t),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "unifiedRelemInstanceOffsetsbuf"});
 
   transferHelper->uploadBuffer<std::uint32_t>(
     *oneShotCommands, unifiedRelemInstanceOffsetsbuf, 0, std::span(relemInstanceOffsets));
 
+  // all buffers below are filled on GPU when culling
+  cullingVisibilitybuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = cullingPairsCount * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "cullingVisibilitybuf"});
+
+  cullingVisibilityScanbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = cullingPairsCount * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "cullingVisibilityScanbuf"});
+
+  // one more element for the total amount of visible pairs
+  cullingGroupSumsbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = (compactionGroupsCount() + 1) * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "cullingGroupSumsbuf"});
+
+  unifiedDrawRelemsInstanceIndicesbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = cullingPairsCount * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "unifiedDrawRelemsInstanceIndicesbuf"});
+
   unifiedDrawCommandsbuf = ctx.createBuffer(
     etna::Buffer::CreateInfo{
       .size = renderElements.size() * sizeof(vk::DrawIndexedIndirectCommand),
-      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst |
+      .bufferUsage =
         vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
       .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
       .name = "unifiedDrawCommandsbuf"});
 
-  std::vector<vk::DrawIndexedIndirectCommand> drawCommands;
-  drawCommands.reserve(renderElements.size());
-  for (uint32_t i = 0; i < renderElements.size(); i++)
-  {
-    drawCommands.emplace_back(
-      vk::DrawIndexedIndirectCommand{
-        .indexCount = renderElements[i].indexCount,
-        .instanceCount = 0,
-        .firstIndex = renderElements[i].indexOffset,
-        .vertexOffset = static_cast<std::int32_t>(renderElements[i].vertexOffset),
-        .firstInstance = relemInstanceOffsets[i]});
-  }
+  unifiedDrawRelemsbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = renderElements.size() * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "unifiedDrawRelemsbuf"});
 
-  transferHelper->uploadBuffer<vk::DrawIndexedIndirectCommand>(
-    *oneShotCommands, unifiedDrawCommandsbuf, 0, std::span(drawCommands));
+  unifiedDrawCountbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(std::uint32_t),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "unifiedDrawCountbuf"});
 }
 
 void TerrainManager::loadTerrain()
 {
-  auto [verts, inds, relems, meshs, bounds] = initializeMeshes();
+  auto [verts, inds, relems, meshs, bounds, layouts] = initializeMeshes();
 
   renderElements = std::move(relems);
   meshes = std::move(meshs);
   renderElementsBounds = std::move(bounds);
+  renderElementsLayouts = std::move(layouts);
+
+  optimizeIndices(inds);
 
-  auto [instMats, instMeshes] = processInstances();
-  instanceMatrices = std::move(instMats);
+  auto [insts, instMeshes] = processInstances();
+  instances = std::move(insts);
   instanceMeshes = std::move(instMeshes);
 
-  uploadData(verts, inds);
+  levelPositions.assign(clipmapLevels, std::nullopt);
+
+  uploadData(inds);
 
   spdlog::info("vertices amount - {}, indices amount - {}", verts.size(), inds.size());
 }
 
-void TerrainManager::moveClipmap(glm::vec3 camera_position)
+void TerrainManager::optimizeIndices(std::span<std::uint32_t> indices) const
 {
-  ZoneScopedN("moveClipmap");
-  glm::vec2 cameraHorizontalPosition = glm::vec2(camera_position.x, camera_position.z);
+  ZoneScopedN("optimizeIndices");
+
+  // roughly the post-transform cache of current GPUs
+  const std::uint32_t cacheSize = 32;
+
+  for (std::size_t relemIdx = 0; relemIdx < renderElements.size(); relemIdx++)
+  {
+    const auto& relem = renderElements[relemIdx];
+    auto relemIndices = indices.subspan(relem.indexOffset, relem.indexCount);
+    std::uint32_t vertexCount = *std::max_element(relemIndices.begin(), relemIndices.end()) + 1;
+
+    auto before = mesh_optimization::measure_vertex_cache(relemIndices, vertexCount, cacheSize);
+    mesh_optimization::optimize_vertex_cache(relemIndices, vertexCount, cacheSize);
+    auto after = mesh_optimization::measure_vertex_cache(relemIndices, vertexCount, cacheSize);
+
+    spdlog::info(
+      "Relem {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+      relemIdx,
+      before.acmr,
+      after.acmr,
+      before.atvr,
+      after.atvr);
+  }
+}
+
+void TerrainManager::loadShaders()
+{
+  etna::create_program("clipmap_placement", {SCENE_SHADERS_ROOT "clipmap_placement.comp.spv"});
+  etna::create_program("clipmap_height_bounds", {SCENE_SHADERS_ROOT "height_bounds.comp.spv"});
+  etna::create_program(
+    "clipmap_height_bounds_streamed", {SCENE_SHADERS_ROOT "height_bounds_streamed.comp.spv"});
+  etna::create_program("clipmap_level_maps", {SCENE_SHADERS_ROOT "level_maps.comp.spv"});
+  etna::create_program(
+    "clipmap_level_maps_streamed", {SCENE_SHADERS_ROOT "level_maps_streamed.comp.spv"});
+  etna::create_program("compaction_scan", {SCENE_SHADERS_ROOT "compaction_scan.comp.spv"});
+  etna::create_program(
+    "compaction_scan_groups", {SCENE_SHADERS_ROOT "compaction_scan_groups.comp.spv"});
+  etna::create_program(
+    "compaction_instances", {SCENE_SHADERS_ROOT "compaction_instances.comp.spv"});
+  etna::create_program("compaction_draws", {SCENE_SHADERS_ROOT "compaction_draws.comp.spv"});
+}
+
+void TerrainManager::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  placementPipeline = pipelineManager.createComputePipeline("clipmap_placement", {});
+  heightBoundsPipeline = pipelineManager.createComputePipeline("clipmap_height_bounds", {});
+  heightBoundsStreamedPipeline =
+    pipelineManager.createComputePipeline("clipmap_height_bounds_streamed", {});
+  levelMapsPipeline = pipelineManager.createComputePipeline("clipmap_level_maps", {});
+  levelMapsStreamedPipeline =
+    pipelineManager.createComputePipeline("clipmap_level_maps_streamed", {});
+  compactionScanPipeline = pipelineManager.createComputePipeline("compaction_scan", {});
+  compactionScanGroupsPipeline =
+    pipelineManager.createComputePipeline("compaction_scan_groups", {});
+  compactionInstancesPipeline = pipelineManager.createComputePipeline("compaction_instances", {});
+  compactionDrawsPipeline = pipelineManager.createComputePipeline("compaction_draws", {});
+}
+
+void TerrainManager::compactDraws(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+        .buffer = cullingVisibilitybuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = unifiedDrawRelemsInstanceIndicesbuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = unifiedDrawRelemsbuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = unifiedDrawCommandsbuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .buffer = unifiedDrawCountbuf.get(),
+        .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  auto dispatchPhase = [&](
+                         const char* program_name,
+                         const etna::ComputePipeline& pipeline,
+                         std::vector<etna::Binding> bindings,
+                         std::span<const std::uint32_t> constants,
+                         std::uint32_t group_count) {
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+
+    auto shaderInfo = etna::get_shader_program(program_name);
+    auto set = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+    auto vkSet = set.getVkSet();
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+
+    cmd_buf.pushConstants(
+      pipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      static_cast<std::uint32_t>(constants.size_bytes()),
+      constants.data());
+
+    cmd_buf.dispatch(group_count, 1, 1);
+  };
+
+  std::uint32_t groupsCount = compactionGroupsCount();
+  std::uint32_t relemsCount = static_cast<std::uint32_t>(renderElements.size());
+
+  std::array scanConstants = {cullingPairsCount};
+  dispatchPhase(
+    "compaction_scan",
+    compactionScanPipeline,
+    {etna::Binding{0, cullingVisibilitybuf.genBinding()},
+     etna::Binding{1, cullingVisibilityScanbuf.genBinding()},
+     etna::Binding{2, cullingGroupSumsbuf.genBinding()}},
+    scanConstants,
+    groupsCount);
+
+  compactionBarrier(cmd_buf, {cullingVisibilityScanbuf.get(), cullingGroupSumsbuf.get()});
+
+  std::array scanGroupsConstants = {groupsCount};
+  dispatchPhase(
+    "compaction_scan_groups",
+    compactionScanGroupsPipeline,
+    {etna::Binding{0, cullingGroupSumsbuf.genBinding()}},
+    scanGroupsConstants,
+    1);
+
+  compactionBarrier(cmd_buf, {cullingGroupSumsbuf.get()});
+
+  // instances and draws do not depend on each other
+  std::array instancesConstants = {cullingPairsCount};
+  dispatchPhase(
+    "compaction_instances",
+    compactionInstancesPipeline,
+    {etna::Binding{0, unifiedCullingPairsbuf.genBinding()},
+     etna::Binding{1, cullingVisibilitybuf.genBinding()},
+     etna::Binding{2, cullingVisibilityScanbuf.genBinding()},
+     etna::Binding{3, cullingGroupSumsbuf.genBinding()},
+     etna::Binding{4, unifiedDrawRelemsInstanceIndicesbuf.genBinding()}},
+    instancesConstants,
+    groupsCount);
+
+  std::array drawsConstants = {cullingPairsCount, relemsCount};
+  dispatchPhase(
+    "compaction_draws",
+    compactionDrawsPipeline,
+    {etna::Binding{0, unifiedRelemsbuf.genBinding()},
+     etna::Binding{1, unifiedRelemInstanceOffsetsbuf.genBinding()},
+     etna::Binding{2, cullingVisibilityScanbuf.genBinding()},
+     etna::Binding{3, cullingGroupSumsbuf.genBinding()},
+     etna::Binding{4, unifiedDrawCommandsbuf.genBinding()},
+     etna::Binding{5, unifiedDrawRelemsbuf.genBinding()},
+     etna::Binding{6, unifiedDrawCountbuf.genBinding()}},
+    drawsConstants,
+    1);
+
+  {
+    std::array bufferBarriers = {
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+        .buffer = unifiedDrawRelemsInstanceIndicesbuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+        .buffer = unifiedDrawRelemsbuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .buffer = unifiedDrawCommandsbuf.get(),
+        .size = vk::WholeSize},
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
+        .buffer = unifiedDrawCountbuf.get(),
+        .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+}
+
+void TerrainManager::compactionBarrier(
+  vk::CommandBuffer cmd_buf, std::initializer_list<vk::Buffer> buffers)
+{
+  std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+  bufferBarriers.reserve(buffers.size());
+  for (auto buffer : buffers)
+  {
+    bufferBarriers.emplace_back(
+      vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite,
+        .buffer = buffer,
+        .size = vk::WholeSize});
+  }
 
-  std::uint32_t meshOffset = 0;
+  vk::DependencyInfo dependencyInfo = {
+    .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+    .pBufferMemoryBarriers = bufferBarriers.data()};
 
+  cmd_buf.pipelineBarrier2(dependencyInfo);
+}
+
+void TerrainManager::loadHeightMaps(std::vector<etna::Binding> terrain_bindings)
+{
+  heightMapsAmount = static_cast<std::uint32_t>(terrain_bindings.size() - 1);
+  ETNA_VERIFYF(
+    heightMapsAmount <= HEIGHT_BOUNDS_MAX_CASCADES,
+    "Too many height map cascades for height bounds - {}, maximum is {}",
+    heightMapsAmount,
+    HEIGHT_BOUNDS_MAX_CASCADES);
+
+  streamedHeightMap = false;
+  streamedBoundsBinding.reset();
+
+  createHeightMapsResources(std::move(terrain_bindings));
+}
+
+void TerrainManager::loadStreamedHeightMap(
+  std::vector<etna::Binding> streamed_bindings, etna::Binding source_bounds)
+{
+  heightMapsAmount = 1;
+  streamedHeightMap = true;
+  streamedBoundsBinding = source_bounds;
+
+  createHeightMapsResources(std::move(streamed_bindings));
+}
+
+void TerrainManager::createHeightMapsResources(std::vector<etna::Binding> bindings)
+{
+  auto shaderInfo = etna::get_shader_program(
+    streamedHeightMap ? "clipmap_height_bounds_streamed" : "clipmap_height_bounds");
+  heightMapsSet =
+    std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0), bindings, true));
+
+  auto commandBuffer = oneShotCommands->start();
+  ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
+  {
+    heightMapsSet->processBarriers(commandBuffer);
+  }
+  ETNA_CHECK_VK_RESULT(commandBuffer.end());
+  oneShotCommands->submitAndWait(commandBuffer);
+
+  auto& ctx = etna::get_context();
+
+  // header is uint with 3 paddings and array of cascades
+  heightBoundsbuf = ctx.createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(glm::uvec4) + sizeof(HeightBoundsCascade) * HEIGHT_BOUNDS_MAX_CASCADES +
+        sizeof(glm::vec2) * HEIGHT_BOUNDS_TEXELS_PER_CASCADE * heightMapsAmount,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "heightBounds"});
+
+  heightBoundsOutdated = true;
+
+  levelMaps = ctx.createImage(
+    etna::Image::CreateInfo{
+      .extent =
+        vk::Extent3D{levelMapsWindowSize(), levelMapsWindowSize() * clipmapLevels, 1},
+      .name = "clipmapLevelMaps",
+      .format = vk::Format::eR32G32B32A32Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage});
+  // shaders only use texelFetch, filtering is done manually
+  levelMapsSampler = etna::Sampler(
+    etna::Sampler::CreateInfo{.filter = vk::Filter::eNearest, .name = "clipmapLevelMapsSampler"});
+
+  levelMapsOrigins.assign(clipmapLevels, std::nullopt);
+  levelMapsOutdated = true;
+}
+
+void TerrainManager::updateLevelMaps(vk::CommandBuffer cmd_buf, glm::vec3 camera_position)
+{
+  ZoneScoped;
+
+  if (!heightMapsSet)
+  {
+    return;
+  }
+
+  if (levelMapsOutdated)
+  {
+    levelMapsOrigins.assign(clipmapLevels, std::nullopt);
+    levelMapsOutdated = false;
+  }
+
+  struct Rect
+  {
+    std::uint32_t level;
+    glm::ivec2 origin;
+    glm::ivec2 size;
+  };
+
+  std::vector<Rect> rects;
+
+  glm::vec2 cameraHorizontalPosition = {camera_position.x, camera_position.z};
+  std::int32_t windowSize = static_cast<std::int32_t>(levelMapsWindowSize());
+
+  for (std::uint32_t level = 0; level < clipmapLevels; level++)
+  {
+    glm::ivec2 snappedTexel =
+      glm::ivec2(glm::floor(cameraHorizontalPosition / static_cast<float>(1u << level)));
+    glm::ivec2 origin = snappedTexel - windowSize / 2;
+
+    auto& previousOrigin = levelMapsOrigins[level];
+    if (previousOrigin == origin)
+    {
+      continue;
+    }
+
+    glm::ivec2 shift = previousOrigin.has_value() ? origin - *previousOrigin : glm::ivec2(0);
+
+    if (
+      !previousOrigin.has_value() || glm::abs(shift.x) >= windowSize ||
+      glm::abs(shift.y) >= windowSize)
+    {
+      rects.push_back({level, origin, glm::ivec2(windowSize)});
+    }
+    else
+    {
+      // columns that entered the window, then rows that entered it without those columns
+      glm::ivec2 exposed = glm::abs(shift);
+      std::int32_t keptColumnsStart = shift.x > 0 ? origin.x : origin.x + exposed.x;
+
+      if (exposed.x > 0)
+      {
+        std::int32_t columnsStart = shift.x > 0 ? origin.x + windowSize - exposed.x : origin.x;
+        rects.push_back({level, {columnsStart, origin.y}, {exposed.x, windowSize}});
+      }
+      if (exposed.y > 0)
+      {
+        std::int32_t rowsStart = shift.y > 0 ? origin.y + windowSize - exposed.y : origin.y;
+        rects.push_back(
+          {level, {keptColumnsStart, rowsStart}, {windowSize - exposed.x, exposed.y}});
+      }
+    }
+
+    previousOrigin = origin;
+  }
+
+  if (rects.empty())
+  {
+    return;
+  }
+
+  ETNA_PROFILE_GPU(cmd_buf, updateLevelMaps);
+
+  // rects never overlap, so dispatches need no barriers between each other
+  etna::set_state(
+    cmd_buf,
+    levelMaps.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  auto& pipeline = streamedHeightMap ? levelMapsStreamedPipeline : levelMapsPipeline;
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+
+  auto shaderInfo = etna::get_shader_program(
+    streamedHeightMap ? "clipmap_level_maps_streamed" : "clipmap_level_maps");
+  auto levelMapsSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(1),
+    cmd_buf,
+    {etna::Binding{0, levelMaps.genBinding(levelMapsSampler.get(), vk::ImageLayout::eGeneral)}});
+
+  std::array vkSets = {heightMapsSet->getVkSet(), levelMapsSet.getVkSet()};
+
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    pipeline.getVkPipelineLayout(),
+    0,
+    static_cast<uint32_t>(vkSets.size()),
+    vkSets.data(),
+    0,
+    nullptr);
+
+  for (const auto& rect : rects)
+  {
+    cmd_buf.pushConstants<LevelMapsPushConstants>(
+      pipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      {{.rectOrigin = rect.origin,
+        .rectSize = glm::uvec2(rect.size),
+        .level = rect.level,
+        .texturesAmount = heightMapsAmount}});
+
+    cmd_buf.dispatch((rect.size.x + 7) / 8, (rect.size.y + 7) / 8, 1);
+  }
+
+  // render pass can not contain barriers, so level maps are prepared for rendering right away
+  etna::set_state(
+    cmd_buf,
+    levelMaps.get(),
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+etna::Binding TerrainManager::genLevelMapsBinding(std::uint32_t binding)
+{
+  return etna::Binding{
+    binding,
+    levelMaps.genBinding(levelMapsSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)};
+}
+
+void TerrainManager::buildHeightBounds(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  if (!heightBoundsOutdated || !heightMapsSet)
+  {
+    return;
+  }
+
+  ETNA_PROFILE_GPU(cmd_buf, buildHeightBounds);
+
+  auto barrier = [&](vk::AccessFlags2 src_access, vk::AccessFlags2 dst_access) {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = src_access,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = dst_access,
+      .buffer = heightBoundsbuf.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  };
+
+  // previous culling passes could still read old bounds
+  barrier(vk::AccessFlagBits2::eShaderRead, vk::AccessFlagBits2::eShaderWrite);
+
+  auto& pipeline = streamedHeightMap ? heightBoundsStreamedPipeline : heightBoundsPipeline;
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+
+  std::vector<etna::Binding> boundsBindings = {etna::Binding{0, heightBoundsbuf.genBinding()}};
+  if (streamedBoundsBinding.has_value())
+  {
+    boundsBindings.push_back(*streamedBoundsBinding);
+  }
+
+  auto shaderInfo = etna::get_shader_program(
+    streamedHeightMap ? "clipmap_height_bounds_streamed" : "clipmap_height_bounds");
+  auto boundsSet =
+    etna::create_descriptor_set(shaderInfo.getDescriptorLayoutId(1), cmd_buf, boundsBindings);
+
+  std::array vkSets = {heightMapsSet->getVkSet(), boundsSet.getVkSet()};
+
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    pipeline.getVkPipelineLayout(),
+    0,
+    static_cast<uint32_t>(vkSets.size()),
+    vkSets.data(),
+    0,
+    nullptr);
+
+  for (std::uint32_t level = 0; level < HEIGHT_BOUNDS_LEVELS; level++)
+  {
+    cmd_buf.pushConstants<HeightBoundsPushConstants>(
+      pipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      {{.level = level, .texturesAmount = heightMapsAmount}});
+
+    std::uint32_t groupCount = ((HEIGHT_BOUNDS_SIZE >> level) + 7) / 8;
+    cmd_buf.dispatch(groupCount, groupCount, heightMapsAmount);
+
+    // next level reads this one, culling reads all of them
+    barrier(
+      vk::AccessFlagBits2::eShaderWrite,
+      vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+  }
+
+  heightBoundsOutdated = false;
+}
+
+void TerrainManager::placeLevelInstances(std::uint32_t level, glm::vec2 camera_horizontal_position)
+{
   std::size_t tileSize = vertexTileSize - 1;
 
   std::size_t crossMesh = 0;
@@ -1348,201 +2088,284 @@ void TerrainManager::moveClipmap(glm::vec3 camera_position)
   std::size_t trimMesh = 3;
   std::size_t seamMesh = 4;
 
-  glm::vec2 scale = {};
-  glm::vec2 snappedPosition = {};
+  glm::vec2 scale = glm::vec2(static_cast<float>(1u << level));
+  glm::vec2 snappedPosition = glm::floor(camera_horizontal_position / scale) * scale;
 
-  glm::vec2 tileExtent = {};
-  glm::vec2 base = {};
+  glm::vec2 nextScale = glm::vec2(static_cast<float>(1u << (level + 1)));
+  glm::vec2 nextSnappedPosition = glm::floor(camera_horizontal_position / nextScale) * nextScale;
 
   glm::vec2 newPosition = {};
 
   // cross
+  if (level == 0)
   {
-    snappedPosition = glm::floor(cameraHorizontalPosition);
+    std::uint32_t meshOffset = 0;
 
-    instanceMatrices[meshOffset][3].x = snappedPosition.x;
-    instanceMatrices[meshOffset][3].y = 0;
-    instanceMatrices[meshOffset][3].z = snappedPosition.y;
+    instances[meshOffset].offset = snappedPosition;
 
     ETNA_VERIFYF(
       instanceMeshes[meshOffset] == crossMesh,
       "Displacing wrong model, current - {}, needed - {}",
       instanceMeshes[meshOffset],
       crossMesh);
-
-    meshOffset++;
   }
 
   // square tiles
   {
-    glm::vec2 fillerSkip = {};
-    for (uint32_t level = 0; level < clipmapLevels; level++)
-    {
-      scale = glm::vec2(static_cast<float>(1u << level));
-      snappedPosition = glm::floor(cameraHorizontalPosition / scale) * scale;
+    std::uint32_t meshOffset = squareInstancesOffset(level);
 
-      tileExtent = glm::vec2(static_cast<float>(tileSize << level));
-      base = snappedPosition - glm::vec2(static_cast<float>((tileSize) << (level + 1)));
+    glm::vec2 tileExtent = glm::vec2(static_cast<float>(tileSize << level));
+    glm::vec2 base = snappedPosition - glm::vec2(static_cast<float>((tileSize) << (level + 1)));
+
+    glm::vec2 fillerSkip = {};
 
-      for (uint32_t x = 0; x < 4; x++)
+    for (uint32_t x = 0; x < 4; x++)
+    {
+      for (uint32_t z = 0; z < 4; z++)
       {
-        for (uint32_t z = 0; z < 4; z++)
+        if (level != 0 && (x == 1 || x == 2) && (z == 1 || z == 2))
         {
-          if (level != 0 && (x == 1 || x == 2) && (z == 1 || z == 2))
-          {
-            continue;
-          }
+          continue;
+        }
 
-          fillerSkip = glm::vec2(x < 2 ? 0 : 1, z < 2 ? 0 : 1) * scale;
+        fillerSkip = glm::vec2(x < 2 ? 0 : 1, z < 2 ? 0 : 1) * scale;
 
-          newPosition = base + glm::vec2(x, z) * tileExtent + fillerSkip;
+        newPosition = base + glm::vec2(x, z) * tileExtent + fillerSkip;
 
-          instanceMatrices[meshOffset][3].x = newPosition.x;
-          instanceMatrices[meshOffset][3].y = 0;
-          instanceMatrices[meshOffset][3].z = newPosition.y;
+        instances[meshOffset].offset = newPosition;
 
-          ETNA_VERIFYF(
-            instanceMeshes[meshOffset] == squareMesh,
-            "Displacing wrong model, current - {}, needed - {}",
-            instanceMeshes[meshOffset],
-            squareMesh);
+        ETNA_VERIFYF(
+          instanceMeshes[meshOffset] == squareMesh,
+          "Displacing wrong model, current - {}, needed - {}",
+          instanceMeshes[meshOffset],
+          squareMesh);
 
-          meshOffset++;
-        }
+        meshOffset++;
       }
     }
   }
 
-  if (clipmapLevels == 0)
+  // filler mesh
   {
-    auto& currentInstanceMatricesBuffer = unifiedInstanceMatricesbuf->get();
-    currentInstanceMatricesBuffer.map();
-    std::memcpy(
-      currentInstanceMatricesBuffer.data(),
-      instanceMatrices.data(),
-      instanceMatrices.size() * sizeof(glm::mat4x4));
-    currentInstanceMatricesBuffer.unmap();
+    std::uint32_t meshOffset = fillerInstanceOffset(level);
 
-    return;
+    newPosition = snappedPosition;
+
+    instances[meshOffset].offset = newPosition;
+
+    ETNA_VERIFYF(
+      instanceMeshes[meshOffset] == fillerMesh,
+      "Displacing wrong model, current - {}, needed - {}",
+      instanceMeshes[meshOffset],
+      fillerMesh);
   }
 
-  // filler meshes
+  // trim mesh
   {
-    for (uint32_t level = 0; level < clipmapLevels; level++)
-    {
-      scale = glm::vec2(static_cast<float>(1u << level));
-      snappedPosition = glm::floor(cameraHorizontalPosition / scale) * scale;
+    std::uint32_t meshOffset = trimInstanceOffset(level);
 
-      newPosition = snappedPosition;
+    glm::vec2 tileCenter = snappedPosition + scale * glm::vec2(0.5);
 
-      instanceMatrices[meshOffset][3].x = newPosition.x;
-      instanceMatrices[meshOffset][3].y = 0;
-      instanceMatrices[meshOffset][3].z = newPosition.y;
+    glm::vec2 diff = camera_horizontal_position - nextSnappedPosition;
 
-      ETNA_VERIFYF(
-        instanceMeshes[meshOffset] == fillerMesh,
-        "Displacing wrong model, current - {}, needed - {}",
-        instanceMeshes[meshOffset],
-        fillerMesh);
+    // 00 - 0 degrees (0), 01 - 90 degrees(1), 10 - 270 degrees (2), 11 - 180 degrees(3)
+    uint32_t index = 0;
+    index |= (diff.x < scale.x ? 2 : 0);
+    index |= (diff.y < scale.y ? 1 : 0);
 
-      meshOffset++;
-    }
+    newPosition = tileCenter;
+
+    instances[meshOffset].offset = newPosition;
+    instances[meshOffset].rotation = index;
+
+    ETNA_VERIFYF(
+      instanceMeshes[meshOffset] == trimMesh,
+      "Displacing wrong model, current - {}, needed - {}",
+      instanceMeshes[meshOffset],
+      trimMesh);
   }
 
-  glm::vec2 nextScale = {};
-  glm::vec2 nextSnappedPosition = {};
-  // trim meshes
+  // seam mesh
   {
-    glm::vec2 tileCenter = {};
-    glm::vec2 diff = {};
+    std::uint32_t meshOffset = seamInstanceOffset(level);
 
-    // 00 - 0 degrees (0), 01 - 90 degrees(1), 10 - 270 degrees (2), 11 - 180 degrees(3)
-    glm::mat4x4 rotationMatrices[] = {
-      glm::identity<glm::mat4x4>(),
-      glm::mat4x4(0, 0, -1, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1),
-      glm::mat4x4(0, 0, 1, 0, 0, 1, 0, 0, -1, 0, 0, 0, 0, 0, 0, 1),
-      glm::mat4x4(-1, 0, 0, 0, 0, 1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 1)};
+    glm::vec2 nextBase =
+      nextSnappedPosition - glm::vec2(static_cast<float>((tileSize) << (level + 1)));
 
-    for (uint32_t level = 0; level < clipmapLevels; level++)
-    {
-      scale = glm::vec2(static_cast<float>(1u << level));
-      snappedPosition = glm::floor(cameraHorizontalPosition / scale) * scale;
+    newPosition = nextBase;
 
-      nextScale = glm::vec2(static_cast<float>(1u << (level + 1)));
-      nextSnappedPosition = glm::floor(cameraHorizontalPosition / nextScale) * nextScale;
+    instances[meshOffset].offset = newPosition;
 
-      tileCenter = snappedPosition + scale * glm::vec2(0.5);
+    ETNA_VERIFYF(
+      instanceMeshes[meshOffset] == seamMesh,
+      "Displacing wrong model, current - {}, needed - {}",
+      instanceMeshes[meshOffset],
+      seamMesh);
+  }
+}
 
-      diff = cameraHorizontalPosition - nextSnappedPosition;
+void TerrainManager::moveClipmap(glm::vec3 camera_position)
+{
+  ZoneScopedN("moveClipmap");
+  glm::vec2 cameraHorizontalPosition = glm::vec2(camera_position.x, camera_position.z);
 
-      uint32_t index = 0;
-      index |= (diff.x < scale.x ? 2 : 0);
-      index |= (diff.y < scale.y ? 1 : 0);
+  if (clipmapLevels == 0)
+  {
+    glm::vec2 snappedPosition = glm::floor(cameraHorizontalPosition);
 
-      newPosition = tileCenter;
+    instances[0].offset = snappedPosition;
 
-      instanceMatrices[meshOffset] = rotationMatrices[index] *
-        glm::scale(glm::identity<glm::mat4x4>(), glm::vec3(scale.x, 0, scale.x));
+    auto& currentInstances = unifiedInstancesbuf->get();
+    std::memcpy(
+      currentInstances.buffer.data(),
+      instances.data(),
+      instances.size() * sizeof(ClipmapInstanceGLSLCompat));
 
-      instanceMatrices[meshOffset][3].x = newPosition.x;
-      instanceMatrices[meshOffset][3].y = 0;
-      instanceMatrices[meshOffset][3].z = newPosition.y;
+    return;
+  }
 
-      ETNA_VERIFYF(
-        instanceMeshes[meshOffset] == trimMesh,
-        "Displacing wrong model, current - {}, needed - {}",
-        instanceMeshes[meshOffset],
-        trimMesh);
+  // every instance of a level (and the cross for level 0) depends only on the camera position
+  // snapped to this level grid, so the level is recomputed only when it crosses a grid line
+  for (uint32_t level = 0; level < clipmapLevels; level++)
+  {
+    glm::vec2 scale = glm::vec2(static_cast<float>(1u << level));
+    glm::vec2 snappedPosition = glm::floor(cameraHorizontalPosition / scale) * scale;
 
-      meshOffset++;
+    if (levelPositions[level] == snappedPosition)
+    {
+      continue;
     }
+
+    levelPositions[level] = snappedPosition;
+    placeLevelInstances(level, cameraHorizontalPosition);
   }
 
-  // seam meshes
+  // every frame in flight has its own copy, it is compared with the levels it was last written with
+  auto& currentInstances = unifiedInstancesbuf->get();
+
+  std::vector<InstanceRange> dirtyRanges;
+  dirtyRanges.reserve(4 * clipmapLevels);
+
+  for (uint32_t level = 0; level < clipmapLevels; level++)
   {
-    glm::vec2 nextBase = {};
+    if (currentInstances.levelPositions[level] == levelPositions[level])
+    {
+      continue;
+    }
+
+    currentInstances.levelPositions[level] = levelPositions[level];
 
-    for (uint32_t level = 0; level < clipmapLevels; level++)
+    if (level == 0)
     {
-      scale = glm::vec2(static_cast<float>(1u << level));
-      nextScale = glm::vec2(static_cast<float>(1u << (level + 1)));
-      nextSnappedPosition = glm::floor(cameraHorizontalPosition / nextScale) * nextScale;
+      // cross and all 16 squares of the first level
+      dirtyRanges.push_back({.first = 0, .count = squareInstancesOffset(0) + 16});
+    }
+    else
+    {
+      dirtyRanges.push_back({.first = squareInstancesOffset(level), .count = 12});
+    }
+    dirtyRanges.push_back({.first = fillerInstanceOffset(level), .count = 1});
+    dirtyRanges.push_back({.first = trimInstanceOffset(level), .count = 1});
+    dirtyRanges.push_back({.first = seamInstanceOffset(level), .count = 1});
+  }
 
-      nextBase = nextSnappedPosition - glm::vec2(static_cast<float>((tileSize) << (level + 1)));
+  if (dirtyRanges.empty())
+  {
+    return;
+  }
 
-      newPosition = nextBase;
+  std::sort(
+    dirtyRanges.begin(), dirtyRanges.end(), [](const InstanceRange& a, const InstanceRange& b) {
+      return a.first < b.first;
+    });
 
-      instanceMatrices[meshOffset][3].x = newPosition.x;
-      instanceMatrices[meshOffset][3].y = 0;
-      instanceMatrices[meshOffset][3].z = newPosition.y;
+  // fillers, trims and seams of neighbouring levels are adjacent, so merge them into single copies
+  InstanceRange currentRange = dirtyRanges.front();
+  for (std::size_t i = 1; i <= dirtyRanges.size(); i++)
+  {
+    if (i < dirtyRanges.size() && dirtyRanges[i].first == currentRange.first + currentRange.count)
+    {
+      currentRange.count += dirtyRanges[i].count;
+      continue;
+    }
 
-      ETNA_VERIFYF(
-        instanceMeshes[meshOffset] == seamMesh,
-        "Displacing wrong model, current - {}, needed - {}",
-        instanceMeshes[meshOffset],
-        seamMesh);
+    std::memcpy(
+      currentInstances.buffer.data() + currentRange.first * sizeof(ClipmapInstanceGLSLCompat),
+      instances.data() + currentRange.first,
+      currentRange.count * sizeof(ClipmapInstanceGLSLCompat));
 
-      meshOffset++;
+    if (i < dirtyRanges.size())
+    {
+      currentRange = dirtyRanges[i];
     }
   }
-
-  auto& currentInstanceMatricesBuffer = unifiedInstanceMatricesbuf->get();
-  currentInstanceMatricesBuffer.map();
-  std::memcpy(
-    currentInstanceMatricesBuffer.data(),
-    instanceMatrices.data(),
-    instanceMatrices.size() * sizeof(glm::mat4x4));
-  currentInstanceMatricesBuffer.unmap();
 }
 
-etna::VertexByteStreamFormatDescription TerrainManager::getVertexFormatDescription()
+void TerrainManager::placeClipmap(vk::CommandBuffer cmd_buf, glm::vec3 camera_position)
 {
-  return etna::VertexByteStreamFormatDescription{
-    .stride = sizeof(Vertex),
-    .attributes = {
-      etna::VertexByteStreamFormatDescription::Attribute{
-        .format = vk::Format::eR32G32Sfloat,
-        .offset = 0,
-      },
-    }};
+  ZoneScoped;
+
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask =
+        vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eVertexShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+      .buffer = gpuInstancesbuf.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, placementPipeline.getVkPipeline());
+
+  auto shaderInfo = etna::get_shader_program("clipmap_placement");
+  auto set = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, gpuInstancesbuf.genBinding()}});
+  auto vkSet = set.getVkSet();
+
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    placementPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+
+  cmd_buf.pushConstants<PlacementPushConstants>(
+    placementPipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    {{.cameraHorizontalPosition = glm::vec2(camera_position.x, camera_position.z),
+      .clipmapLevels = clipmapLevels,
+      .tileSize = vertexTileSize - 1}});
+
+  cmd_buf.dispatch((clipmapLevels + 31) / 32, 1, 1);
+
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+      .dstStageMask =
+        vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eVertexShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+      .buffer = gpuInstancesbuf.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
 }
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <initializer_list>
+#include <optional>
 #include <span>
 
 #include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
 #include <etna/BlockingTransferHelper.hpp>
-#include <etna/VertexInput.hpp>
 #include <etna/GpuSharedResource.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
 
 #include "RenderStructs.hpp"
 
@@ -16,11 +21,43 @@ public:
   TerrainManager(uint32_t levels, uint32_t vertex_grid_size);
 
   void loadTerrain();
+  void loadShaders();
+  void setupPipelines();
 
   void moveClipmap(glm::vec3 camera_position);
+  // Records placement of all instances on GPU, used instead of moveClipmap in GPU placement mode
+  void placeClipmap(vk::CommandBuffer cmd_buf, glm::vec3 camera_position);
 
-  // Every instance is a mesh drawn with a certain transform
-  std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
+  // Height maps bindings are the same as for terrain rendering: cascades array and their infos
+  void loadHeightMaps(std::vector<etna::Binding> terrain_bindings);
+  // Used instead of loadHeightMaps, bindings are streamed tiles pool, info and page table, source
+  // bounds are min/max of the whole source for the finest height bounds level,
+  // see terrain_source.glsl
+  void loadStreamedHeightMap(
+    std::vector<etna::Binding> streamed_bindings, etna::Binding source_bounds);
+  // Records rebuilding of min/max height pyramids, does nothing if height maps did not change
+  void buildHeightBounds(vk::CommandBuffer cmd_buf);
+  // Records writing of level maps texels exposed since the last call, level maps are rewritten
+  // entirely after height maps were changed
+  void updateLevelMaps(vk::CommandBuffer cmd_buf, glm::vec3 camera_position);
+  // Should be called after height maps or their infos were regenerated
+  void updateHeightMaps()
+  {
+    heightBoundsOutdated = true;
+    levelMapsOutdated = true;
+  }
+  // Should be called after resident tiles of the streamed height map changed
+  void invalidateLevelMaps() { levelMapsOutdated = true; }
+
+  // Records compaction of visible culling pairs into draw commands, visibility buffer should be
+  // filled with 0 or 1 for every culling pair before that
+  void compactDraws(vk::CommandBuffer cmd_buf);
+
+  void setGpuPlacement(bool enabled) { gpuPlacement = enabled; }
+  bool isGpuPlacementEnabled() const { return gpuPlacement; }
+
+  // Every instance is a mesh drawn with a certain offset, scale and rotation
+  std::span<const ClipmapInstanceGLSLCompat> getInstances() { return instances; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
 
   // Every mesh is a collection of relems
@@ -31,19 +68,33 @@ public:
 
   std::span<const Bounds> getRenderElementsBounds() { return renderElementsBounds; }
 
-  vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
+  // Every culling pair is an instance index and a relem index, pairs of a relem are contiguous
+  std::uint32_t getCullingPairsCount() const { return cullingPairsCount; }
+
+  // There is no vertex buffer, vertex shaders pull positions from relem layouts
   vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
+  vk::IndexType getIndexType() const { return indexType; }
 
   etna::Buffer& getRelemsBuffer() { return unifiedRelemsbuf; }
   etna::Buffer& getBoundsBuffer() { return unifiedBoundsbuf; }
+  etna::Buffer& getRelemLayoutsBuffer() { return unifiedRelemLayoutsbuf; }
   etna::Buffer& getMeshesBuffer() { return unifiedMeshesbuf; }
   etna::Buffer& getInstanceMeshesBuffer() { return unifiedInstanceMeshesbuf; }
-  etna::Buffer& getInstanceMatricesBuffer() { return unifiedInstanceMatricesbuf->get(); }
+  etna::Buffer& getInstancesBuffer()
+  {
+    return gpuPlacement ? gpuInstancesbuf : unifiedInstancesbuf->get().buffer;
+  }
   etna::Buffer& getRelemInstanceOffsetsBuffer() { return unifiedRelemInstanceOffsetsbuf; }
+  etna::Buffer& getCullingPairsBuffer() { return unifiedCullingPairsbuf; }
+  etna::Buffer& getVisibilityBuffer() { return cullingVisibilitybuf; }
   etna::Buffer& getDrawInstanceIndicesBuffer() { return unifiedDrawRelemsInstanceIndicesbuf; }
+  // Draw commands are compacted, relem of every draw is stored in draw relems buffer
   etna::Buffer& getDrawCommandsBuffer() { return unifiedDrawCommandsbuf; }
-
-  etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  etna::Buffer& getDrawRelemsBuffer() { return unifiedDrawRelemsbuf; }
+  etna::Buffer& getDrawCountBuffer() { return unifiedDrawCountbuf; }
+  etna::Buffer& getHeightBoundsBuffer() { return heightBoundsbuf; }
+  // Heights and normals of every clipmap level, see level_maps.glsl
+  etna::Binding genLevelMapsBinding(std::uint32_t binding);
 
 private:
   struct Vertex
@@ -58,7 +109,7 @@ private:
 
   struct ProcessedInstances
   {
-    std::vector<glm::mat4x4> matrices;
+    std::vector<ClipmapInstanceGLSLCompat> instances;
     std::vector<std::uint32_t> meshes;
   };
 
@@ -69,13 +120,90 @@ private:
     std::vector<RenderElement> relems;
     std::vector<Mesh> meshes;
     std::vector<Bounds> bounds;
+    std::vector<ClipmapRelemLayoutGLSLCompat> layouts;
   };
 
+  struct InstancesBuffer
+  {
+    etna::Buffer buffer;
+    // snapped level positions this copy was last written with
+    std::vector<std::optional<glm::vec2>> levelPositions;
+  };
+
+  struct InstanceRange
+  {
+    std::uint32_t first;
+    std::uint32_t count;
+  };
+
+  struct HeightBoundsPushConstants
+  {
+    std::uint32_t level;
+    std::uint32_t texturesAmount;
+  };
+
+  struct LevelMapsPushConstants
+  {
+    glm::ivec2 rectOrigin;
+    glm::uvec2 rectSize;
+    std::uint32_t level;
+    std::uint32_t texturesAmount;
+  };
+
+  struct PlacementPushConstants
+  {
+    glm::vec2 cameraHorizontalPosition;
+    std::uint32_t clipmapLevels;
+    std::uint32_t tileSize;
+  };
+
+  // must match COMPACTION_GROUP_SIZE in compaction.glsl
+  static constexpr std::uint32_t COMPACTION_GROUP_SIZE = 256;
+
+  std::uint32_t compactionGroupsCount() const
+  {
+    return (cullingPairsCount + COMPACTION_GROUP_SIZE - 1) / COMPACTION_GROUP_SIZE;
+  }
+
+  // level covers vertices from -(vertexGridSize - 1) / 2 to (vertexGridSize + 1) / 2 texels
+  // around the snapped camera position, window adds a small margin to that
+  std::uint32_t levelMapsWindowSize() const { return vertexGridSize + 5; }
+
+  void compactionBarrier(vk::CommandBuffer cmd_buf, std::initializer_list<vk::Buffer> buffers);
+
   uint32_t positionToIndex(uint32_t x, uint32_t y, uint32_t size) const { return y * size + x; };
 
+  // instances are laid out as cross, 16 squares of level 0, 12 squares for every next level,
+  // then one filler, one trim and one seam per level
+  std::uint32_t squareInstancesOffset(std::uint32_t level) const
+  {
+    return level == 0 ? 1 : 5 + 12 * level;
+  }
+  std::uint32_t fillerInstanceOffset(std::uint32_t level) const
+  {
+    return 5 + 12 * clipmapLevels + level;
+  }
+  std::uint32_t trimInstanceOffset(std::uint32_t level) const
+  {
+    return 5 + 13 * clipmapLevels + level;
+  }
+  std::uint32_t seamInstanceOffset(std::uint32_t level) const
+  {
+    return 5 + 14 * clipmapLevels + level;
+  }
+
+  glm::vec2 pullVertexPosition(
+    const ClipmapRelemLayoutGLSLCompat& layout, std::uint32_t vertex_index) const;
+
+  void createHeightMapsResources(std::vector<etna::Binding> bindings);
+
+  void placeLevelInstances(std::uint32_t level, glm::vec2 camera_horizontal_position);
+
   ProcessedInstances processInstances() const;
   ProcessedMeshes initializeMeshes() const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+  // reorders triangles of every relem for vertex cache reuse
+  void optimizeIndices(std::span<std::uint32_t> indices) const;
+  void uploadData(std::span<const std::uint32_t> indices);
 
 private:
   uint32_t clipmapLevels;
@@ -87,23 +215,64 @@ private:
 
   std::vector<RenderElement> renderElements;
   std::vector<Mesh> meshes;
-  std::vector<glm::mat4x4> instanceMatrices;
+  std::vector<ClipmapInstanceGLSLCompat> instances;
   std::vector<std::uint32_t> instanceMeshes;
   std::vector<Bounds> renderElementsBounds;
+  std::vector<ClipmapRelemLayoutGLSLCompat> renderElementsLayouts;
 
-  etna::Buffer unifiedVbuf;
   etna::Buffer unifiedIbuf;
+  vk::IndexType indexType = vk::IndexType::eUint32;
 
   etna::Buffer unifiedRelemsbuf;
   etna::Buffer unifiedBoundsbuf;
+  etna::Buffer unifiedRelemLayoutsbuf;
   etna::Buffer unifiedMeshesbuf;
 
-  std::optional<etna::GpuSharedResource<etna::Buffer>> unifiedInstanceMatricesbuf;
+  // last snapped position of every level, levels that did not move are not recomputed
+  std::vector<std::optional<glm::vec2>> levelPositions;
+
+  std::optional<etna::GpuSharedResource<InstancesBuffer>> unifiedInstancesbuf;
+
+  // written only by the placement pass, so a single device local copy is enough
+  bool gpuPlacement = false;
+  etna::Buffer gpuInstancesbuf;
+  etna::ComputePipeline placementPipeline;
 
   etna::Buffer unifiedInstanceMeshesbuf;
   etna::Buffer unifiedRelemInstanceOffsetsbuf;
 
+  std::uint32_t cullingPairsCount = 0;
+  etna::Buffer unifiedCullingPairsbuf;
+  etna::Buffer cullingVisibilitybuf;
+  etna::Buffer cullingVisibilityScanbuf;
+  etna::Buffer cullingGroupSumsbuf;
+
   etna::Buffer unifiedDrawRelemsInstanceIndicesbuf;
 
   etna::Buffer unifiedDrawCommandsbuf;
+  etna::Buffer unifiedDrawRelemsbuf;
+  etna::Buffer unifiedDrawCountbuf;
+
+  etna::ComputePipeline compactionScanPipeline;
+  etna::ComputePipeline compactionScanGroupsPipeline;
+  etna::ComputePipeline compactionInstancesPipeline;
+  etna::ComputePipeline compactionDrawsPipeline;
+
+  // header with cascade infos followed by min/max pyramids, see HeightBounds.h
+  std::unique_ptr<etna::PersistentDescriptorSet> heightMapsSet;
+  std::uint32_t heightMapsAmount = 0;
+  bool streamedHeightMap = false;
+  std::optional<etna::Binding> streamedBoundsBinding;
+  bool heightBoundsOutdated = false;
+  etna::Buffer heightBoundsbuf;
+  etna::ComputePipeline heightBoundsPipeline;
+  etna::ComputePipeline heightBoundsStreamedPipeline;
+
+  // origin of the window every level was last written with, in texels of that level
+  std::vector<std::optional<glm::ivec2>> levelMapsOrigins;
+  bool levelMapsOutdated = false;
+  etna::Image levelMaps;
+  etna::Sampler levelMapsSampler;
+  etna::ComputePipeline levelMapsPipeline;
+  etna::ComputePipeline levelMapsStreamedPipeline;
 };
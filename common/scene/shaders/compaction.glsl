@@ -0,0 +1,32 @@
+#ifndef COMPACTION_GLSL_INCLUDED
+#define COMPACTION_GLSL_INCLUDED
+
+// every culling pair is one instance of one relem, pairs of a relem are stored contiguously
+#define COMPACTION_GROUP_SIZE 256
+
+shared uint scanData[COMPACTION_GROUP_SIZE];
+
+// exclusive prefix sum over the workgroup, must be reached by all invocations
+uint workgroupExclusiveScan(uint value, out uint total)
+{
+  uint localIdx = gl_LocalInvocationID.x;
+  scanData[localIdx] = value;
+  barrier();
+
+  for (uint offset = 1; offset < COMPACTION_GROUP_SIZE; offset <<= 1)
+  {
+    uint addition = localIdx >= offset ? scanData[localIdx - offset] : 0;
+    barrier();
+    scanData[localIdx] += addition;
+    barrier();
+  }
+
+  total = scanData[COMPACTION_GROUP_SIZE - 1];
+  uint result = scanData[localIdx] - value;
+  barrier();
+
+  return result;
+}
+
+
+#endif // COMPACTION_GLSL_INCLUDED
@@ -0,0 +1,59 @@
+#define HEIGHT_BOUNDS_SET 1
+#define HEIGHT_BOUNDS_BINDING 0
+#include "/clipmap/height_bounds.glsl"
+
+// builds one level of min/max pyramids for all cascades, level 0 is reduced from the source
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(push_constant) uniform push_constant_t
+{
+  uint level;
+  uint texturesAmount;
+};
+
+#define TERRAIN_SOURCE_BOUNDS
+#include "terrain_source.glsl"
+
+
+void main()
+{
+  uint cascade = gl_GlobalInvocationID.z;
+  uvec2 texel = gl_GlobalInvocationID.xy;
+  uint size = HEIGHT_BOUNDS_SIZE >> level;
+
+  if (cascade >= texturesAmount || any(greaterThanEqual(texel, uvec2(size))))
+  {
+    return;
+  }
+
+  vec2 result;
+
+  if (level == 0)
+  {
+    if (all(equal(texel, uvec2(0))))
+    {
+      TerrainInfo info = infos[cascade];
+      heightBounds.cascades[cascade] =
+        HeightBoundsCascade(vec2(info.extent), info.heightOffset, info.heightAmplifier);
+      if (cascade == 0)
+      {
+        heightBounds.cascadesAmount = texturesAmount;
+      }
+    }
+
+    result = terrainSourceBounds(cascade, texel);
+  }
+  else
+  {
+    uvec2 source = texel * 2;
+    result = heightBounds.bounds[heightBoundsIndex(cascade, level - 1, source)];
+    result = mergeBounds(
+      result, heightBounds.bounds[heightBoundsIndex(cascade, level - 1, source + uvec2(1, 0))]);
+    result = mergeBounds(
+      result, heightBounds.bounds[heightBoundsIndex(cascade, level - 1, source + uvec2(0, 1))]);
+    result = mergeBounds(
+      result, heightBounds.bounds[heightBoundsIndex(cascade, level - 1, source + uvec2(1, 1))]);
+  }
+
+  heightBounds.bounds[heightBoundsIndex(cascade, level, texel)] = result;
+}
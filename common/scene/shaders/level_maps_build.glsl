@@ -0,0 +1,55 @@
+#define LEVEL_MAPS_SET 1
+#define LEVEL_MAPS_BINDING 0
+#define LEVEL_MAPS_WRITE
+#include "/clipmap/level_maps.glsl"
+
+// writes a rectangle of level texels, heights and normals are taken from the terrain source the
+// same way terrain shaders sampled heightmaps directly
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(push_constant) uniform push_constant_t
+{
+  ivec2 rectOrigin; // in texels of the level
+  uvec2 rectSize;
+  uint level;
+  uint texturesAmount;
+};
+
+#include "terrain_source.glsl"
+
+
+float terrainHeight(vec2 world_position, vec2 uv_offset)
+{
+  float height = 0;
+  for (uint i = 0; i < texturesAmount; i++)
+  {
+    vec2 texCoord = 0.5 * world_position / infos[i].extent + 0.5 + uv_offset;
+    height +=
+      (terrainSourceSample(i, texCoord) - infos[i].heightOffset) * infos[i].heightAmplifier;
+  }
+  return height;
+}
+
+void main()
+{
+  if (any(greaterThanEqual(gl_GlobalInvocationID.xy, rectSize)))
+  {
+    return;
+  }
+
+  ivec2 levelTexel = rectOrigin + ivec2(gl_GlobalInvocationID.xy);
+  vec2 worldPosition = vec2(levelTexel) * float(1u << level);
+
+  float height = terrainHeight(worldPosition, vec2(0));
+
+  float eps = 1 / float(terrainSourceSize(0).x);
+
+  float left = terrainHeight(worldPosition, vec2(-eps, 0));
+  float right = terrainHeight(worldPosition, vec2(eps, 0));
+  float up = terrainHeight(worldPosition, vec2(0, eps));
+  float down = terrainHeight(worldPosition, vec2(0, -eps));
+
+  vec3 normal = normalize(vec3(left - right, 2.0 * eps, down - up));
+
+  imageStore(levelMaps, levelMapsTexel(levelTexel, level), vec4(height, normal));
+}
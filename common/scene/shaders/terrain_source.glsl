@@ -0,0 +1,96 @@
+#ifndef TERRAIN_SOURCE_GLSL_INCLUDED
+#define TERRAIN_SOURCE_GLSL_INCLUDED
+
+#include "/clipmap/HeightBounds.h"
+
+// heights terrain manager passes are built from, either whole heightmap cascades or a single
+// streamed heightmap, both are sampled with the same texture coordinates;
+// set 0 is the same for every pass, so they share one descriptor set
+struct TerrainInfo
+{
+  ivec2 extent;
+  float heightOffset;
+  float heightAmplifier;
+};
+
+layout(set = 0, binding = 1) readonly buffer infos_t
+{
+  TerrainInfo infos[];
+};
+
+vec2 mergeBounds(vec2 a, vec2 b)
+{
+  return vec2(min(a.x, b.x), max(a.y, b.y));
+}
+
+#ifdef TERRAIN_SOURCE_STREAMED
+
+#define STREAMED_HEIGHT_MAP_POOL_BINDING 0
+#define STREAMED_HEIGHT_MAP_TABLE_BINDING 2
+#include "/streaming/streamed_height_map.glsl"
+
+ivec2 terrainSourceSize(uint cascade)
+{
+  return streamedHeightMapSize();
+}
+
+float terrainSourceSample(uint cascade, vec2 tex_coord)
+{
+  return sampleStreamedHeight(tex_coord);
+}
+
+#ifdef TERRAIN_SOURCE_BOUNDS
+// min/max of the source over every texel of the finest height bounds level, computed when the
+// heightmap was split into tiles, as most of it is not resident
+layout(set = 1, binding = 1) readonly buffer streamed_bounds_t
+{
+  vec2 streamedBounds[];
+};
+
+vec2 terrainSourceBounds(uint cascade, uvec2 texel)
+{
+  return streamedBounds[texel.y * HEIGHT_BOUNDS_SIZE + texel.x];
+}
+#endif
+
+#else
+
+layout(set = 0, binding = 0) uniform sampler2D heightMaps[32];
+
+ivec2 terrainSourceSize(uint cascade)
+{
+  return textureSize(heightMaps[cascade], 0);
+}
+
+float terrainSourceSample(uint cascade, vec2 tex_coord)
+{
+  return texture(heightMaps[cascade], tex_coord).x;
+}
+
+vec2 terrainSourceBounds(uint cascade, uvec2 texel)
+{
+  // bilinear filtering also reaches one texel around the footprint, which is wrapped
+  // differently by repeat and mirrored repeat samplers, so both neighbours are taken
+  ivec2 mapSize = textureSize(heightMaps[cascade], 0);
+  ivec2 first = ivec2(texel) * mapSize / HEIGHT_BOUNDS_SIZE - 1;
+  ivec2 last = max((ivec2(texel) + 1) * mapSize / HEIGHT_BOUNDS_SIZE, first + 2);
+
+  vec2 result = vec2(texelFetch(heightMaps[cascade], clamp(first, ivec2(0), mapSize - 1), 0).x);
+  for (int y = first.y; y <= last.y; y++)
+  {
+    for (int x = first.x; x <= last.x; x++)
+    {
+      ivec2 wrapped = (ivec2(x, y) + mapSize) % mapSize;
+      ivec2 clamped = clamp(ivec2(x, y), ivec2(0), mapSize - 1);
+      result = mergeBounds(result, vec2(texelFetch(heightMaps[cascade], wrapped, 0).x));
+      result = mergeBounds(result, vec2(texelFetch(heightMaps[cascade], clamped, 0).x));
+    }
+  }
+
+  return result;
+}
+
+#endif
+
+
+#endif // TERRAIN_SOURCE_GLSL_INCLUDED
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "CBT/CBTReference.hpp"
+#include "BisectorPool/BisectorPoolReference.hpp"
+
+
+// Subdivides a square CBT on the CPU the way terrain shaders do, checks that every reduction
+// path produces the same heap and measures them, no device is needed. Then does the same with
+// a bisector pool, which goes deeper than a CBT can
+
+static double measure_ms(std::int32_t iterations, const std::function<void()>& work)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (std::int32_t i = 0; i < iterations; i++)
+  {
+    work();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+// refines around a moving point the way terrain LOD does, split and merge passes alternate
+// and every pass is followed by a reduction, as in the renderer
+static void subdivide(cbt_reference::Heap& heap, std::int32_t passes, std::mt19937& random)
+{
+  std::uniform_real_distribution<float> step(-0.02f, 0.02f);
+  glm::vec3 xPos = glm::vec3(0.0f, 0.0f, 1.0f);
+  glm::vec3 zPos = glm::vec3(1.0f, 0.0f, 0.0f);
+
+  float focusX = 0.5f;
+  float focusZ = 0.5f;
+  for (std::int32_t pass = 0; pass < passes; pass++)
+  {
+    focusX = std::clamp(focusX + step(random), 0.0f, 1.0f);
+    focusZ = std::clamp(focusZ + step(random), 0.0f, 1.0f);
+    bool merge = (pass & 1) != 0;
+
+    std::vector<cbt_reference::Node> leaves(heap.nodeCount());
+    for (std::uint32_t code = 0; code < leaves.size(); code++)
+    {
+      leaves[code] = heap.decode(code);
+    }
+
+    for (cbt_reference::Node leaf : leaves)
+    {
+      glm::vec3 x = cbt_reference::leb_square_decode_attribute(leaf, xPos);
+      glm::vec3 z = cbt_reference::leb_square_decode_attribute(leaf, zPos);
+      float dx = (x[0] + x[1] + x[2]) / 3.0f - focusX;
+      float dz = (z[0] + z[1] + z[2]) / 3.0f - focusZ;
+
+      float targetDepth =
+        static_cast<float>(heap.getMaxDepth()) * (1.0f - 2.0f * std::sqrt(dx * dx + dz * dz));
+      float depth = static_cast<float>(leaf.depth);
+
+      if (!merge && depth < targetDepth)
+      {
+        cbt_reference::leb_square_split(heap, leaf);
+      }
+      else if (merge && depth > targetDepth + 2.0f)
+      {
+        cbt_reference::leb_square_merge(
+          heap, leaf, cbt_reference::leb_square_diamond_parent_decode(leaf));
+      }
+    }
+
+    heap.reduct();
+  }
+}
+
+// refinement with classification and update passes of BisectorPool, links are validated after
+// every pass. Target depth grows by two per halving of the focus distance as with a screen space
+// error, so the max depth is reached with a bounded number of bisectors
+static bool subdivide_pool(
+  bisector_pool_reference::Pool& pool, std::int32_t passes, std::mt19937& random)
+{
+  // deep bisectors are tiny, focus drifts slowly enough for them to follow
+  std::uniform_real_distribution<float> step(-0.0002f, 0.0002f);
+  glm::vec3 xPos = glm::vec3(0.0f, 0.0f, 1.0f);
+  glm::vec3 zPos = glm::vec3(1.0f, 0.0f, 0.0f);
+
+  float focusX = 0.5f;
+  float focusZ = 0.5f;
+  for (std::int32_t pass = 0; pass < passes; pass++)
+  {
+    focusX = std::clamp(focusX + step(random), 0.0f, 1.0f);
+    focusZ = std::clamp(focusZ + step(random), 0.0f, 1.0f);
+    bool merge = (pass & 1) != 0;
+
+    for (std::uint32_t slot : pool.getActive())
+    {
+      glm::vec3 x = pool.decodeAttribute(slot, xPos);
+      glm::vec3 z = pool.decodeAttribute(slot, zPos);
+      float dx = (x[0] + x[1] + x[2]) / 3.0f - focusX;
+      float dz = (z[0] + z[1] + z[2]) / 3.0f - focusZ;
+
+      float targetDepth = std::min(
+        static_cast<float>(pool.getMaxDepth()),
+        8.0f - std::log2(std::max(dx * dx + dz * dz, 1e-30f)));
+      float depth = static_cast<float>(pool.getDepth(slot));
+
+      if (!merge && depth < targetDepth)
+      {
+        pool.requestSplit(slot);
+      }
+      else if (merge && depth > targetDepth + 2.0f)
+      {
+        pool.requestMerge(slot);
+      }
+    }
+
+    pool.update(merge);
+
+    if (!pool.validate())
+    {
+      std::printf("bisector pool links are broken after pass %d\n", pass);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Words of the depth 6 heap CBTree::load starts every tree from, the two triangles of the
+// square after a reduction. Guards the heap layout shared with cbt.glsl, which the reductions
+// above only compare against each other
+static constexpr std::array<std::uint32_t, 8> kInitialHeapWords = {
+  0x10410440u,
+  0x00010040u,
+  0x00010001u,
+  0x00000100u,
+  0x00000001u,
+  0x00000001u,
+  0x00000001u,
+  0x00000001u,
+};
+
+static bool check_initial_heap()
+{
+  cbt_reference::Heap initial(6);
+  initial.writeBitfield({.index = 2u, .depth = 1}, 1u);
+  initial.writeBitfield({.index = 3u, .depth = 1}, 1u);
+
+  cbt_reference::Heap naive = initial;
+  cbt_reference::Heap prepass = initial;
+  cbt_reference::Heap popcount = initial;
+  naive.reductNaive();
+  prepass.reduct();
+  popcount.reductPopcount();
+
+  return std::ranges::equal(naive.getWords(), kInitialHeapWords) &&
+    std::ranges::equal(prepass.getWords(), kInitialHeapWords) &&
+    std::ranges::equal(popcount.getWords(), kInitialHeapWords);
+}
+
+int main(int argc, char** argv)
+{
+  std::int32_t maxDepth = argc > 1 ? std::atoi(argv[1]) : 20;
+  std::int32_t iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+  std::int32_t poolDepth = argc > 3 ? std::atoi(argv[3]) : 40;
+  std::uint32_t poolCapacity = argc > 4 ? static_cast<std::uint32_t>(std::atoi(argv[4])) : 1u << 16;
+
+  if (!check_initial_heap())
+  {
+    std::printf("initial heap differs from the known words\n");
+    return 1;
+  }
+
+  cbt_reference::Heap heap(maxDepth);
+  heap.writeBitfield({.index = 2u, .depth = 1}, 1u);
+  heap.writeBitfield({.index = 3u, .depth = 1}, 1u);
+  heap.reduct();
+
+  std::mt19937 random(42);
+  double subdivisionMs = measure_ms(1, [&]() { subdivide(heap, 4 * maxDepth, random); });
+
+  std::uint32_t nodeCount = heap.nodeCount();
+  std::printf(
+    "depth %d, %u leaves, %zu heap bytes, subdivided in %.3f ms, %zu reduction dispatches\n",
+    maxDepth,
+    nodeCount,
+    heap.getByteSize(),
+    subdivisionMs,
+    cbt_reference::reduction_dispatches(maxDepth).size());
+
+  if (heap.isDirty())
+  {
+    std::printf("heap is still dirty after a reduction\n");
+    return 1;
+  }
+
+  cbt_reference::Heap naive = heap;
+  cbt_reference::Heap prepass = heap;
+  cbt_reference::Heap popcount = heap;
+  naive.reductNaive();
+  prepass.reduct();
+  popcount.reductPopcount();
+
+  std::span<const std::uint32_t> expected = naive.getWords();
+  if (
+    !std::ranges::equal(expected, prepass.getWords()) ||
+    !std::ranges::equal(expected, popcount.getWords()))
+  {
+    std::printf("reductions produced different heaps\n");
+    return 1;
+  }
+
+  for (std::uint32_t code = 0; code < nodeCount; code++)
+  {
+    cbt_reference::Node node = heap.decode(code);
+    if (!heap.isLeaf(node) || heap.encode(node) != code)
+    {
+      std::printf("node code %u does not survive decode and encode\n", code);
+      return 1;
+    }
+  }
+
+  for (std::uint32_t code = 0; code < nodeCount; code++)
+  {
+    cbt_reference::Node node = heap.decode(code);
+    glm::mat3 expectedTransform = cbt_reference::leb_square_decode_transformation(node);
+    glm::mat3 tableTransform = cbt_reference::leb_square_decode_transformation_table(node);
+    for (std::int32_t column = 0; column < 3; column++)
+    {
+      for (std::int32_t row = 0; row < 3; row++)
+      {
+        if (expectedTransform[column][row] != tableTransform[column][row])
+        {
+          std::printf("table leb decode differs for node code %u\n", code);
+          return 1;
+        }
+      }
+    }
+  }
+
+  // budgeted refinement reserves split costs up front, they have to match the leaves made
+  for (std::uint32_t code = 0; code < nodeCount; code += 97)
+  {
+    cbt_reference::Node node = heap.decode(code);
+    cbt_reference::Heap split = heap;
+    std::uint32_t cost = cbt_reference::leb_square_split_cost(split, node);
+    cbt_reference::leb_square_split(split, node);
+    split.reduct();
+    if (split.nodeCount() != nodeCount + cost)
+    {
+      std::printf(
+        "split cost of node code %u is %u, split added %u\n",
+        code,
+        cost,
+        split.nodeCount() - nodeCount);
+      return 1;
+    }
+  }
+
+  std::printf("reduction, naive:    %8.3f ms\n", measure_ms(iterations, [&]() {
+                naive.reductNaive();
+              }));
+  std::printf("reduction, prepass:  %8.3f ms\n", measure_ms(iterations, [&]() {
+                prepass.reduct();
+              }));
+  std::printf("reduction, popcount: %8.3f ms\n", measure_ms(iterations, [&]() {
+                popcount.reductPopcount();
+              }));
+
+  std::vector<cbt_reference::Node> leaves(nodeCount);
+  std::uint32_t checksum = 0;
+  double decodeMs = measure_ms(iterations, [&]() {
+    for (std::uint32_t code = 0; code < nodeCount; code++)
+    {
+      leaves[code] = heap.decode(code);
+      checksum += leaves[code].index;
+    }
+  });
+  double encodeMs = measure_ms(iterations, [&]() {
+    for (cbt_reference::Node leaf : leaves)
+    {
+      checksum += heap.encode(leaf);
+    }
+  });
+  double transformMs = measure_ms(iterations, [&]() {
+    for (cbt_reference::Node leaf : leaves)
+    {
+      glm::mat3 transform = cbt_reference::leb_square_decode_transformation(leaf);
+      checksum += static_cast<std::uint32_t>(transform[0][0] * 1024.0f);
+    }
+  });
+
+  double tableTransformMs = measure_ms(iterations, [&]() {
+    for (cbt_reference::Node leaf : leaves)
+    {
+      glm::mat3 transform = cbt_reference::leb_square_decode_transformation_table(leaf);
+      checksum += static_cast<std::uint32_t>(transform[0][0] * 1024.0f);
+    }
+  });
+
+  std::printf("node decode:         %8.3f ns per leaf\n", decodeMs * 1e6 / nodeCount);
+  std::printf("node encode:         %8.3f ns per leaf\n", encodeMs * 1e6 / nodeCount);
+  std::printf("leb square decode:   %8.3f ns per leaf\n", transformMs * 1e6 / nodeCount);
+  std::printf("leb table decode:    %8.3f ns per leaf\n", tableTransformMs * 1e6 / nodeCount);
+  // keeps the measured loops from being optimized away
+  std::printf("checksum %u\n", checksum);
+
+  bisector_pool_reference::Pool pool(poolCapacity, poolDepth);
+  std::int32_t poolDeepest = 0;
+  bool poolValid = true;
+  double poolMs =
+    measure_ms(1, [&]() { poolValid = subdivide_pool(pool, 4 * poolDepth, random); });
+  if (!poolValid)
+  {
+    return 1;
+  }
+  for (std::uint32_t slot : pool.getActive())
+  {
+    poolDeepest = std::max(poolDeepest, pool.getDepth(slot));
+  }
+
+  // bisector, command, active list pair and free list entries
+  std::size_t poolBytes = static_cast<std::size_t>(poolCapacity) *
+    (sizeof(bisector_pool_reference::Bisector) + sizeof(bisector_pool_reference::Command) +
+     3u * sizeof(std::uint32_t));
+  std::printf(
+    "bisector pool depth %d, %u of %u slots active, deepest %d, %zu bytes, subdivided and "
+    "validated in %.3f ms\n",
+    poolDepth,
+    pool.getActiveCount(),
+    poolCapacity,
+    poolDeepest,
+    poolBytes,
+    poolMs);
+
+  return 0;
+}
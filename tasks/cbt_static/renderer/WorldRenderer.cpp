@@ -59,6 +59,7 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 6});
 
   lightModule.allocateResources();
+  depthPyramid.allocateResources(resolution);
   terrainGeneratorModule.allocateResources();
   terrainRenderModule.allocateResources();
 }
@@ -97,6 +98,7 @@ void WorldRenderer::loadScene()
 void WorldRenderer::loadShaders()
 {
   lightModule.loadShaders();
+  depthPyramid.loadShaders();
   terrainGeneratorModule.loadShaders();
   terrainRenderModule.loadShaders();
 
@@ -109,6 +111,7 @@ void WorldRenderer::loadShaders()
 void WorldRenderer::setupRenderPipelines()
 {
   lightModule.setupPipelines();
+  depthPyramid.setupPipelines();
   terrainGeneratorModule.setupPipelines();
   terrainRenderModule.setupPipelines(wireframeEnabled, renderTargetFormat);
 
@@ -272,6 +275,13 @@ void WorldRenderer::drawGui()
 
   terrainGeneratorModule.drawGui();
   terrainRenderModule.drawGui();
+  depthPyramid.drawGui();
+
+  if (terrainMapsVersion != terrainGeneratorModule.getMapsVersion())
+  {
+    terrainMapsVersion = terrainGeneratorModule.getMapsVersion();
+    terrainRenderModule.updateHeightMaps();
+  }
 
   ImGui::SeparatorText("General Settings");
 
@@ -342,7 +352,8 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
         cmd_buf,
         resolution,
         gBuffer->genColorAttachmentParams(),
-        gBuffer->genDepthAttachmentParams());
+        gBuffer->genDepthAttachmentParams(),
+        depthPyramid.getBuffer());
     }
 
     etna::set_state(
@@ -370,6 +381,9 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
       deferredShading(cmd_buf, currentConstants, deferredShadingPipeline.getVkPipelineLayout());
     }
 
+    // depth of this frame is used for occlusion culling in the next one
+    depthPyramid.execute(cmd_buf, params.projView, gBuffer->genDepthBinding(0));
+
     etna::set_state(
       cmd_buf,
       renderTarget.get(),
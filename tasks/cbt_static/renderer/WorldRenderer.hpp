@@ -14,6 +14,7 @@
 #include "wsi/Keyboard.hpp"
 
 #include "modules/Light/LightModule.hpp"
+#include "modules/DepthPyramid/DepthPyramid.hpp"
 #include "modules/TerrainGenerator/TerrainGeneratorModule.hpp"
 #include "local_modules/TerrainRenderCBT/TerrainRenderModule.hpp"
 
@@ -49,6 +50,7 @@ private:
 
 private:
   LightModule lightModule;
+  DepthPyramid depthPyramid;
   TerrainGeneratorModule terrainGeneratorModule;
   TerrainRenderModule terrainRenderModule;
 
@@ -71,6 +73,8 @@ private:
 
   bool wireframeEnabled;
 
+  uint32_t terrainMapsVersion = 0;
+
   std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
   std::unique_ptr<etna::BlockingTransferHelper> transferHelper;
 
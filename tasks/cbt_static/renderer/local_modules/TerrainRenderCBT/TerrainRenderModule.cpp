@@ -1,5 +1,11 @@
 #include "TerrainRenderModule.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <span>
+#include <vector>
+
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/quaternion_geometric.hpp>
 #include <tracy/Tracy.hpp>
@@ -8,19 +14,41 @@
 
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
+#include <etna/BlockingTransferHelper.hpp>
+#include <etna/OneShotCmdMgr.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
 
 #include "shaders/SubdivisionParams.h"
+#include "shaders/BisectorCache.h"
+#include "shaders/RefinementBudget.h"
 
 
 TerrainRenderModule::TerrainRenderModule()
   : cbt(std::make_unique<CBTree>(25))
+  // deeper than the CBT, memory follows the leaf count instead of the depth
+  , bisectorPool(std::make_unique<BisectorPool>(BISECTOR_CACHE_CAPACITY, 32))
+  // up to 128 segments per edge
+  , patchMesh(7)
   , displayParams(
       {.pixelsPerEdge = 15.0f,
        .subdivision = 3,
-       .displacementVariance = 0.01f,
-       .resolution = 65536.0f})
+       .displacementError = 1.0f,
+       .resolution = 65536.0f,
+       .adaptiveTessellation = true,
+       .instancedPatches = false})
+  , updateParams(
+      {.splitAndMerge = true,
+       .maxIterations = 4,
+       .catchUpDistance = 64.0f,
+       .leafBudget = false,
+       .maxLeafCount = BISECTOR_CACHE_CAPACITY,
+       .evaluationPeriod = 1,
+       .bisectorPool = false})
+  , updateIterations(1)
+  , evaluationFrame(0)
+  , tessellationStats({})
+  , cameraPosition(0.0f)
   , merge(false)
 {
 }
@@ -36,152 +64,189 @@ void TerrainRenderModule::allocateResources()
         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
       .name = "subdivisionParams"});
 
-  oneShotCommands = etna::get_context().createOneShotCmdMgr();
+  static_assert(sizeof(BisectorCacheEntry) == 64);
+  bisectorCacheBuffer = etna::get_context().createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = BISECTOR_CACHE_CAPACITY * sizeof(BisectorCacheEntry),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "bisectorCache"});
+
+  refinementBudgetBuffer = etna::get_context().createBuffer(
+    etna::Buffer::CreateInfo{
+      .size = sizeof(RefinementBudget),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "refinementBudget"});
+
+  auto& ctx = etna::get_context();
+  tessellationStatsBuffer.emplace(ctx.getMainWorkCount(), [&](std::size_t i) {
+    auto buffer = ctx.createBuffer(
+      etna::Buffer::CreateInfo{
+        .size = sizeof(TessellationStats),
+        .bufferUsage =
+          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+        .allocationCreate =
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .name = fmt::format("terrainTessellationStats{}", i)});
+
+    buffer.map();
+    std::memset(buffer.data(), 0, sizeof(TessellationStats));
+    buffer.unmap();
+
+    return buffer;
+  });
+
+  tessellatedRenderTimer.allocateResources();
+  instancedRenderTimer.allocateResources();
 
   cbt->allocateResources();
+  bisectorPool->allocateResources();
+  patchMesh.allocateResources();
+  heightComposite.allocateResources();
 }
 
 void TerrainRenderModule::loadShaders()
 {
   etna::create_program(
-    "subdivision_split",
+    "subdivision_split", {TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_split.comp.spv"});
+  etna::create_program(
+    "subdivision_merge", {TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_merge.comp.spv"});
+  etna::create_program(
+    "bisector_cache", {TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "bisector_cache.comp.spv"});
+  etna::create_program(
+    "bisector_pool_split",
+    {TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "bisector_pool_split.comp.spv"});
+  etna::create_program(
+    "bisector_pool_merge",
+    {TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "bisector_pool_merge.comp.spv"});
+
+  etna::create_program(
+    "terrain_render_cbt",
     {
       TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "decoy.vert.spv",
-      TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_split.tesc.spv",
+      TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "terrain.tesc.spv",
       TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "process.tese.spv",
       TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "terrain.frag.spv",
     });
 
   etna::create_program(
-    "subdivision_merge",
+    "terrain_render_cbt_pool",
     {
       TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "decoy.vert.spv",
-      TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_merge.tesc.spv",
+      TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "terrain_pool.tesc.spv",
       TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "process.tese.spv",
       TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "terrain.frag.spv",
     });
 
+  etna::create_program(
+    "terrain_render_cbt_patches",
+    {
+      TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "terrain_patch.vert.spv",
+      TERRAIN_RENDER_CBT_MODULE_SHADERS_ROOT "terrain.frag.spv",
+    });
+
   cbt->loadShaders();
+  bisectorPool->loadShaders();
+  heightComposite.loadShaders();
 }
 
 void TerrainRenderModule::setupPipelines(bool wireframe_enabled, vk::Format render_target_format)
 {
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  subdivisionSplitPipeline = pipelineManager.createGraphicsPipeline(
-    "subdivision_split",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .tessellationConfig = {.patchControlPoints = 1},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .blendingConfig =
-        {
-          .attachments =
-            {{
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             },
-             {
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             },
-             {
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             }},
-          .logicOpEnable = false,
-          .logicOp = {},
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats =
-            {render_target_format, vk::Format::eR8G8B8A8Snorm, vk::Format::eR8G8B8A8Unorm},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
-
-  subdivisionMergePipeline = pipelineManager.createGraphicsPipeline(
-    "subdivision_merge",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .tessellationConfig = {.patchControlPoints = 1},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .blendingConfig =
-        {
-          .attachments =
-            {{
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             },
-             {
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             },
-             {
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             }},
-          .logicOpEnable = false,
-          .logicOp = {},
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats =
-            {render_target_format, vk::Format::eR8G8B8A8Snorm, vk::Format::eR8G8B8A8Unorm},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
+  subdivisionSplitPipeline = pipelineManager.createComputePipeline("subdivision_split", {});
+  subdivisionMergePipeline = pipelineManager.createComputePipeline("subdivision_merge", {});
+  bisectorCachePipeline = pipelineManager.createComputePipeline("bisector_cache", {});
+  bisectorPoolSplitPipeline = pipelineManager.createComputePipeline("bisector_pool_split", {});
+  bisectorPoolMergePipeline = pipelineManager.createComputePipeline("bisector_pool_merge", {});
+
+  etna::GraphicsPipeline::CreateInfo pipelineInfo = {
+    .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
+    .tessellationConfig = {.patchControlPoints = 1},
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .blendingConfig =
+      {
+        .attachments =
+          {{
+             .blendEnable = vk::False,
+             .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+               vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+           },
+           {
+             .blendEnable = vk::False,
+             .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+               vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+           },
+           {
+             .blendEnable = vk::False,
+             .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+               vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+           }},
+        .logicOpEnable = false,
+        .logicOp = {},
+      },
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats =
+          {render_target_format, vk::Format::eR8G8B8A8Snorm, vk::Format::eR8G8B8A8Unorm},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+  };
+
+  terrainRenderPipeline =
+    pipelineManager.createGraphicsPipeline("terrain_render_cbt", pipelineInfo);
+  terrainPoolRenderPipeline =
+    pipelineManager.createGraphicsPipeline("terrain_render_cbt_pool", pipelineInfo);
+
+  pipelineInfo.inputAssemblyConfig.topology = vk::PrimitiveTopology::eTriangleList;
+  pipelineInfo.tessellationConfig = {};
+  terrainPatchRenderPipeline =
+    pipelineManager.createGraphicsPipeline("terrain_render_cbt_patches", pipelineInfo);
 
   cbt->setupPipelines();
+  bisectorPool->setupPipelines();
+  heightComposite.setupPipelines();
 }
 
 void TerrainRenderModule::loadMaps(std::vector<etna::Binding> terrain_bindings)
 {
-  auto splitShaderInfo = etna::get_shader_program("subdivision_split");
-  terrainSplitSet =
-    std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
-      splitShaderInfo.getDescriptorLayoutId(1), terrain_bindings, true));
-  auto mergeShaderInfo = etna::get_shader_program("subdivision_merge");
-  terrainMergeSet =
-    std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
-      mergeShaderInfo.getDescriptorLayoutId(1), terrain_bindings, true));
-
-  auto commandBuffer = oneShotCommands->start();
-  ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
-  {
-    terrainSplitSet->processBarriers(commandBuffer);
-    terrainMergeSet->processBarriers(commandBuffer);
-  }
-  ETNA_CHECK_VK_RESULT(commandBuffer.end());
-  oneShotCommands->submitAndWait(commandBuffer);
-
-  params.texturesAmount = static_cast<uint32_t>(terrain_bindings.size() - 1);
+  heightComposite.loadMaps(std::move(terrain_bindings));
 
   cbt->load();
+  bisectorPool->load();
+  patchMesh.load();
+
+  // split passes of the first frame find no candidates counted
+  {
+    RefinementBudget emptyBudget = {};
+    auto oneShotCommands = etna::get_context().createOneShotCmdMgr();
+    etna::BlockingTransferHelper transferHelper(
+      etna::BlockingTransferHelper::CreateInfo{.stagingSize = sizeof(RefinementBudget)});
+    transferHelper.uploadBuffer(
+      *oneShotCommands, refinementBudgetBuffer, 0, std::as_bytes(std::span(&emptyBudget, 1)));
+  }
 }
 
 void TerrainRenderModule::update(const RenderPacket& packet, float camera_fovy, float window_height)
 {
   ZoneScoped;
 
+  // far camera jumps take several update iterations to reach the target subdivision
+  float cameraShift = glm::length(packet.cameraWorldPosition - cameraPosition);
+  updateIterations = std::min(
+    1u + static_cast<std::uint32_t>(cameraShift / updateParams.catchUpDistance),
+    updateParams.maxIterations);
+  cameraPosition = packet.cameraWorldPosition;
+
   params.world = glm::scale(
     glm::translate(
       glm::identity<glm::mat4>(),
@@ -214,9 +279,18 @@ void TerrainRenderModule::update(const RenderPacket& packet, float camera_fovy,
 
   params.lodFactor = getLodFactor(camera_fovy, window_height);
 
-  params.varianceFactor =
-    (displayParams.displacementVariance / 64.0f) * (displayParams.displacementVariance / 64.0f);
+  // height deviation in pixels turned into one per unit of camera distance
+  params.varianceFactor = displayParams.displacementError * 2.0f *
+    glm::tan(glm::radians(camera_fovy) / 2.0f) / window_height;
   params.tesselationFactor = 1u << displayParams.subdivision;
+  params.adaptiveTessellation = displayParams.adaptiveTessellation ? 1u : 0u;
+  params.tessellationLengthFactor = window_height /
+    (2.0f * glm::tan(glm::radians(camera_fovy) / 2.0f) * displayParams.pixelsPerEdge);
+
+  params.maxLeafCount = updateParams.leafBudget ? updateParams.maxLeafCount : 0u;
+  params.evaluationPeriod = updateParams.evaluationPeriod;
+  params.evaluationPhase = evaluationFrame % updateParams.evaluationPeriod;
+  evaluationFrame++;
 
   paramsBuffer.map();
   std::memcpy(paramsBuffer.data(), &params, sizeof(SubdivisionParams));
@@ -227,43 +301,52 @@ void TerrainRenderModule::execute(
   vk::CommandBuffer cmd_buf,
   glm::uvec2 extent,
   std::vector<etna::RenderTargetState::AttachmentParams> color_attachment_params,
-  etna::RenderTargetState::AttachmentParams depth_attachment_params)
+  etna::RenderTargetState::AttachmentParams depth_attachment_params,
+  const etna::Buffer& depth_pyramid)
 {
+  // the fence of this frame was waited for before recording, so the timestamps and counts of
+  // the draw mainWorkCount frames ago are complete
+  tessellatedRenderTimer.readback();
+  instancedRenderTimer.readback();
+
   {
-    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
-      .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-      .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-      .buffer = cbt->getDrawIndirectBuffer().get(),
-      .size = vk::WholeSize}};
+    auto& stats = tessellationStatsBuffer->get();
+    stats.map();
+    std::memcpy(&tessellationStats, stats.data(), sizeof(TessellationStats));
+    stats.unmap();
+  }
 
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
+  heightComposite.execute(cmd_buf, cameraPosition);
 
-    cmd_buf.pipelineBarrier2(dependencyInfo);
+  // tree is updated before the draw, so the frame shows the subdivision made for it
+  if (updateParams.bisectorPool)
+  {
+    updateBisectorPool(cmd_buf, depth_pyramid);
+  }
+  else
+  {
+    updateCBT(cmd_buf, depth_pyramid);
   }
 
-  cbt->prepareIndirect(cmd_buf);
+  bool instancedPatches = displayParams.instancedPatches && !updateParams.bisectorPool;
+  if (instancedPatches)
+  {
+    patchMesh.prepareDraw(cmd_buf, *cbt, displayParams.subdivision);
+  }
+
+  GpuTimer& renderTimer = instancedPatches ? instancedRenderTimer : tessellatedRenderTimer;
+  // counted from zero by the control shaders of this frame
+  cmd_buf.fillBuffer(tessellationStatsBuffer->get().get(), 0, vk::WholeSize, 0);
 
   {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .buffer = cbt->getDrawIndirectBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-        .buffer = cbt->getCBTBuffer().get(),
-        .size = vk::WholeSize}};
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+      .buffer = tessellationStatsBuffer->get().get(),
+      .size = vk::WholeSize}};
 
     vk::DependencyInfo dependencyInfo = {
       .dependencyFlags = vk::DependencyFlagBits::eByRegion,
@@ -273,50 +356,34 @@ void TerrainRenderModule::execute(
     cmd_buf.pipelineBarrier2(dependencyInfo);
   }
 
-  if (!merge)
-  {
-    ETNA_PROFILE_GPU(cmd_buf, renderSplitTerrain);
-    etna::RenderTargetState renderTargets(
-      cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
-
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eGraphics, subdivisionSplitPipeline.getVkPipeline());
-    splitTerrain(cmd_buf, subdivisionSplitPipeline.getVkPipelineLayout());
-  }
-  else
+  renderTimer.start(cmd_buf);
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderMergeTerrain);
+    ETNA_PROFILE_GPU(cmd_buf, renderTerrain);
     etna::RenderTargetState renderTargets(
       cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
 
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eGraphics, subdivisionMergePipeline.getVkPipeline());
-    mergeTerrain(cmd_buf, subdivisionMergePipeline.getVkPipelineLayout());
+    const etna::GraphicsPipeline& pipeline = instancedPatches
+      ? terrainPatchRenderPipeline
+      : (updateParams.bisectorPool ? terrainPoolRenderPipeline : terrainRenderPipeline);
+    renderTerrain(cmd_buf, pipeline, depth_pyramid, instancedPatches, updateParams.bisectorPool);
   }
-
-  merge = !merge;
+  renderTimer.stop(cmd_buf);
 
   {
     std::array bufferBarriers = {vk::BufferMemoryBarrier2{
       .srcStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
       .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-      .buffer = cbt->getCBTBuffer().get(),
+      .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+      .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+      .buffer = tessellationStatsBuffer->get().get(),
       .size = vk::WholeSize}};
 
     vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
       .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
       .pBufferMemoryBarriers = bufferBarriers.data()};
 
     cmd_buf.pipelineBarrier2(dependencyInfo);
   }
-
-  {
-    ETNA_PROFILE_GPU(cmd_buf, reductCBT);
-    cbt->reduct(cmd_buf);
-  }
 }
 
 void TerrainRenderModule::drawGui()
@@ -331,8 +398,53 @@ void TerrainRenderModule::drawGui()
     ImGui::DragFloat("Pixels Per Edge", &pixelsPerEdge, 0.01f, 0.5f, 64.0f);
     int subdivision = static_cast<int>(displayParams.subdivision);
     ImGui::DragInt("Subdivision Scale", &subdivision, 1.0f, 1, 10);
-    float displacementVariance = displayParams.displacementVariance;
-    ImGui::DragFloat("Displacement Variance", &displacementVariance, 0.01f, 0.0f, 64.0f);
+    float displacementError = displayParams.displacementError;
+    ImGui::DragFloat("Displacement Error Pixels", &displacementError, 0.01f, 0.0f, 64.0f);
+
+    ImGui::SeparatorText("Tessellation");
+    bool instancedPatches = displayParams.instancedPatches;
+    ImGui::Checkbox("Instanced Patches Instead Of Tessellation", &instancedPatches);
+    ImGui::Text(
+      "Draw: tessellated %.3f ms, instanced patches %.3f ms",
+      tessellatedRenderTimer.getMilliseconds(),
+      instancedRenderTimer.getMilliseconds());
+    bool adaptiveTessellation = displayParams.adaptiveTessellation;
+    ImGui::Checkbox("Adaptive Tessellation", &adaptiveTessellation);
+    ImGui::Text("Visible patches: %u", tessellationStats.patches);
+    ImGui::Text(
+      "Tessellated vertices: %u of %u uniform, %.1f%% saved",
+      tessellationStats.vertices,
+      tessellationStats.uniformVertices,
+      tessellationStats.uniformVertices > 0
+        ? 100.0 * (1.0 - static_cast<double>(tessellationStats.vertices) /
+                     static_cast<double>(tessellationStats.uniformVertices))
+        : 0.0);
+
+    ImGui::SeparatorText("Subdivision Update");
+    ImGui::Checkbox("Bisector Pool Instead Of CBT", &updateParams.bisectorPool);
+    if (updateParams.bisectorPool)
+    {
+      ImGui::Text(
+        "Pool of %u slots, leaves are tessellated and evaluated every frame",
+        bisectorPool->getCapacity());
+    }
+    ImGui::Checkbox("Split And Merge Every Frame", &updateParams.splitAndMerge);
+    int maxIterations = static_cast<int>(updateParams.maxIterations);
+    ImGui::DragInt("Max Update Iterations", &maxIterations, 1.0f, 1, 16);
+    updateParams.maxIterations = static_cast<std::uint32_t>(maxIterations);
+    ImGui::DragFloat(
+      "Camera Shift Per Iteration", &updateParams.catchUpDistance, 1.0f, 1.0f, 4096.0f);
+    ImGui::Text("Update iterations: %u", updateIterations);
+
+    ImGui::SeparatorText("Refinement Budget");
+    ImGui::Checkbox("Cap Leaf Count", &updateParams.leafBudget);
+    int maxLeafCount = static_cast<int>(updateParams.maxLeafCount);
+    ImGui::DragInt(
+      "Max Leaves", &maxLeafCount, 256.0f, 1024, static_cast<int>(BISECTOR_CACHE_CAPACITY));
+    updateParams.maxLeafCount = static_cast<std::uint32_t>(maxLeafCount);
+    int evaluationPeriod = static_cast<int>(updateParams.evaluationPeriod);
+    ImGui::DragInt("LOD Evaluation Period", &evaluationPeriod, 0.1f, 1, 16);
+    updateParams.evaluationPeriod = static_cast<std::uint32_t>(evaluationPeriod);
 
     ImGui::SeparatorText("Terrain Map Params");
     float resolution = displayParams.resolution;
@@ -341,45 +453,325 @@ void TerrainRenderModule::drawGui()
     displayParams = {
       .pixelsPerEdge = pixelsPerEdge,
       .subdivision = static_cast<std::uint32_t>(subdivision),
-      .displacementVariance = displacementVariance,
-      .resolution = resolution};
+      .displacementError = displacementError,
+      .resolution = resolution,
+      .adaptiveTessellation = adaptiveTessellation,
+      .instancedPatches = instancedPatches};
   }
   ImGui::End();
+
+  heightComposite.drawGui();
+}
+
+void TerrainRenderModule::updateCBT(vk::CommandBuffer cmd_buf, const etna::Buffer& depth_pyramid)
+{
+  cbt->beginUpdate(cmd_buf);
+
+  // Leaf order changes with every reduction, so split and merge decode leaves in place and the
+  // cache is built once for the draw
+  for (std::uint32_t i = 0; i < updateIterations; i++)
+  {
+    if (updateParams.splitAndMerge || !merge)
+    {
+      // histogram is kept, only leaves taken by the previous pass are returned
+      clearRefinementBudget(cmd_buf, sizeof(RefinementBudget::reserved));
+      {
+        ETNA_PROFILE_GPU(cmd_buf, splitTerrain);
+        updateTerrain(
+          cmd_buf, subdivisionSplitPipeline, "subdivision_split", depth_pyramid, true);
+      }
+      {
+        ETNA_PROFILE_GPU(cmd_buf, reductCBT);
+        cbt->endUpdatePass(cmd_buf);
+      }
+    }
+
+    // merge decodes leaves made by the split above, so their bits never conflict
+    if (updateParams.splitAndMerge || merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, mergeTerrain);
+        updateTerrain(
+          cmd_buf, subdivisionMergePipeline, "subdivision_merge", depth_pyramid, false);
+      }
+      {
+        ETNA_PROFILE_GPU(cmd_buf, reductCBT);
+        cbt->endUpdatePass(cmd_buf);
+      }
+    }
+
+    merge = !merge;
+  }
+
+  cacheBisectors(cmd_buf, depth_pyramid);
 }
 
-void TerrainRenderModule::splitTerrain(
-  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout)
+void TerrainRenderModule::updateBisectorPool(
+  vk::CommandBuffer cmd_buf, const etna::Buffer& depth_pyramid)
 {
-  auto shaderInfo = etna::get_shader_program("subdivision_split");
+  bisectorPool->beginUpdate(cmd_buf);
+
+  // leaves are classified by their active list index, which changes with every commit
+  for (std::uint32_t i = 0; i < updateIterations; i++)
+  {
+    if (updateParams.splitAndMerge || !merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, splitTerrain);
+        classifyBisectors(
+          cmd_buf, bisectorPoolSplitPipeline, "bisector_pool_split", depth_pyramid);
+      }
+      {
+        ETNA_PROFILE_GPU(cmd_buf, commitBisectorPool);
+        bisectorPool->endUpdatePass(cmd_buf, false);
+      }
+    }
+
+    if (updateParams.splitAndMerge || merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, mergeTerrain);
+        classifyBisectors(
+          cmd_buf, bisectorPoolMergePipeline, "bisector_pool_merge", depth_pyramid);
+      }
+      {
+        ETNA_PROFILE_GPU(cmd_buf, commitBisectorPool);
+        bisectorPool->endUpdatePass(cmd_buf, true);
+      }
+    }
+
+    merge = !merge;
+  }
+}
+
+void TerrainRenderModule::updateTerrain(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program_name,
+  const etna::Buffer& depth_pyramid,
+  bool refinement_budget)
+{
+  std::vector<etna::Binding> bindings = {
+    etna::Binding{0, cbt->getCBTBuffer().genBinding()},
+    etna::Binding{1, paramsBuffer.genBinding()},
+    etna::Binding{2, depth_pyramid.genBinding()},
+    etna::Binding{3, bisectorCacheBuffer.genBinding()}};
+  if (refinement_budget)
+  {
+    bindings.push_back(etna::Binding{4, refinementBudgetBuffer.genBinding()});
+  }
+
+  auto shaderInfo = etna::get_shader_program(program_name);
+  auto set = etna::create_descriptor_set(shaderInfo.getDescriptorLayoutId(0), cmd_buf, bindings);
+
+  auto terrainSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(1),
+    cmd_buf,
+    {heightComposite.genBinding(0),
+     heightComposite.genParamsBinding(1),
+     heightComposite.genVarianceBinding(3)});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    pipeline.getVkPipelineLayout(),
+    0,
+    {set.getVkSet(), terrainSet.getVkSet()},
+    {});
+
+  cmd_buf.dispatchIndirect(cbt->getDispatchIndirectBuffer().get(), 0);
+}
+
+void TerrainRenderModule::classifyBisectors(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program_name,
+  const etna::Buffer& depth_pyramid)
+{
+  auto shaderInfo = etna::get_shader_program(program_name);
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
     {etna::Binding{0, cbt->getCBTBuffer().genBinding()},
-     etna::Binding{1, paramsBuffer.genBinding()}});
+     etna::Binding{1, paramsBuffer.genBinding()},
+     etna::Binding{2, depth_pyramid.genBinding()}});
 
-  auto vkSet = set.getVkSet();
+  auto terrainSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(1),
+    cmd_buf,
+    {heightComposite.genBinding(0),
+     heightComposite.genParamsBinding(1),
+     heightComposite.genVarianceBinding(3)});
+
+  // see bisector_pool_leaf.glsl
+  auto poolSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(2), cmd_buf, bisectorPool->genBindings());
 
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
   cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet, terrainSplitSet->getVkSet()}, {});
+    vk::PipelineBindPoint::eCompute,
+    pipeline.getVkPipelineLayout(),
+    0,
+    {set.getVkSet(), terrainSet.getVkSet(), poolSet.getVkSet()},
+    {});
 
-  cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  cmd_buf.dispatchIndirect(bisectorPool->getDispatchIndirectBuffer().get(), 0);
 }
 
-void TerrainRenderModule::mergeTerrain(
-  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout)
+void TerrainRenderModule::cacheBisectors(
+  vk::CommandBuffer cmd_buf, const etna::Buffer& depth_pyramid)
 {
-  auto shaderInfo = etna::get_shader_program("subdivision_merge");
-  auto set = etna::create_descriptor_set(
-    shaderInfo.getDescriptorLayoutId(0),
+  ETNA_PROFILE_GPU(cmd_buf, cacheBisectors);
+
+  // draw of the previous frame may still read the cache
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader |
+        vk::PipelineStageFlagBits2::eTessellationControlShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .buffer = bisectorCacheBuffer.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  // candidates are counted anew for the split passes of the next frame
+  clearRefinementBudget(cmd_buf, vk::WholeSize);
+
+  updateTerrain(cmd_buf, bisectorCachePipeline, "bisector_cache", depth_pyramid, true);
+
+  // the histogram is made visible to the split passes by clearRefinementBudget
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader |
+        vk::PipelineStageFlagBits2::eTessellationControlShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+      .buffer = bisectorCacheBuffer.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+}
+
+void TerrainRenderModule::clearRefinementBudget(vk::CommandBuffer cmd_buf, vk::DeviceSize size)
+{
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .buffer = refinementBudgetBuffer.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+
+  cmd_buf.fillBuffer(refinementBudgetBuffer.get(), 0, size, 0);
+
+  {
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+      .buffer = refinementBudgetBuffer.get(),
+      .size = vk::WholeSize}};
+
+    vk::DependencyInfo dependencyInfo = {
+      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+      .pBufferMemoryBarriers = bufferBarriers.data()};
+
+    cmd_buf.pipelineBarrier2(dependencyInfo);
+  }
+}
+
+void TerrainRenderModule::renderTerrain(
+  vk::CommandBuffer cmd_buf,
+  const etna::GraphicsPipeline& pipeline,
+  const etna::Buffer& depth_pyramid,
+  bool instanced_patches,
+  bool bisector_pool)
+{
+  std::vector<etna::Binding> bindings = {
+    etna::Binding{0, cbt->getCBTBuffer().genBinding()},
+    etna::Binding{1, paramsBuffer.genBinding()},
+    etna::Binding{2, depth_pyramid.genBinding()}};
+  if (!bisector_pool)
+  {
+    bindings.push_back(etna::Binding{3, bisectorCacheBuffer.genBinding()});
+  }
+  if (instanced_patches)
+  {
+    bindings.push_back(patchMesh.genVerticesBinding(6));
+  }
+  else
+  {
+    bindings.push_back(etna::Binding{5, tessellationStatsBuffer->get().genBinding()});
+  }
+
+  const char* programName = instanced_patches ? "terrain_render_cbt_patches"
+    : bisector_pool                           ? "terrain_render_cbt_pool"
+                                              : "terrain_render_cbt";
+  auto shaderInfo = etna::get_shader_program(programName);
+  auto set = etna::create_descriptor_set(shaderInfo.getDescriptorLayoutId(0), cmd_buf, bindings);
+
+  auto terrainSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(1),
     cmd_buf,
-    {etna::Binding{0, cbt->getCBTBuffer().genBinding()},
-     etna::Binding{1, paramsBuffer.genBinding()}});
-  auto vkSet = set.getVkSet();
+    {heightComposite.genBinding(0),
+     heightComposite.genParamsBinding(1),
+     heightComposite.genNormalsBinding(2),
+     heightComposite.genVarianceBinding(3)});
 
+  std::vector<vk::DescriptorSet> vkSets = {set.getVkSet(), terrainSet.getVkSet()};
+  if (bisector_pool)
+  {
+    // see bisector_pool_leaf.glsl
+    auto poolSet = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(2), cmd_buf, bisectorPool->genBindings());
+    vkSets.push_back(poolSet.getVkSet());
+  }
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
   cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet, terrainMergeSet->getVkSet()}, {});
+    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, vkSets, {});
 
-  cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  if (bisector_pool)
+  {
+    // a patch per active bisector
+    cmd_buf.drawIndirect(bisectorPool->getDrawIndirectBuffer().get(), 0, 1, 0);
+  }
+  else if (instanced_patches)
+  {
+    patchMesh.draw(cmd_buf);
+  }
+  else
+  {
+    cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  }
 }
 
 float TerrainRenderModule::getLodFactor(float camera_fovy, float window_height)
@@ -390,5 +782,3 @@ float TerrainRenderModule::getLodFactor(float camera_fovy, float window_height)
 
   return -2.0f * glm::log2(targetSize) + 2.0f;
 }
-
-void TerrainRenderModule::updateParams() {}
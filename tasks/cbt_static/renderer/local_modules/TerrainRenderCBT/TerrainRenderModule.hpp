@@ -1,16 +1,25 @@
 #pragma once
 
+#include <optional>
+
 #include <etna/ComputePipeline.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/DescriptorSet.hpp>
-#include <etna/OneShotCmdMgr.hpp>
+#include <etna/GpuSharedResource.hpp>
 
 #include "modules/RenderPacket.hpp"
+#include "render_utils/GpuTimer.hpp"
 #include "CBT/CBTree.hpp"
+#include "CBT/BisectorPatchMesh.hpp"
+#include "BisectorPool/BisectorPool.hpp"
+#include "HeightComposite/HeightComposite.hpp"
+#include "subdivision/TessellationStats.h"
 #include "shaders/SubdivisionParams.h"
+#include "shaders/BisectorCache.h"
+#include "shaders/RefinementBudget.h"
 
 
 class TerrainRenderModule
@@ -22,6 +31,8 @@ public:
   void loadShaders();
   void setupPipelines(bool wireframe_enabled, vk::Format render_target_format);
   void loadMaps(std::vector<etna::Binding> terrain_bindings);
+  // Should be called when terrain maps are regenerated
+  void updateHeightMaps() { heightComposite.updateHeightMaps(); }
 
   void update(const RenderPacket& packet, float camera_fovy, float window_height);
 
@@ -29,41 +40,107 @@ public:
     vk::CommandBuffer cmd_buf,
     glm::uvec2 extent,
     std::vector<etna::RenderTargetState::AttachmentParams> color_attachment_params,
-    etna::RenderTargetState::AttachmentParams depth_attachment_params);
+    etna::RenderTargetState::AttachmentParams depth_attachment_params,
+    const etna::Buffer& depth_pyramid);
 
   void drawGui();
 
 private:
-  void splitTerrain(vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void mergeTerrain(vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
+  // Split and merge passes of the frame, followed by the bisector cache for the draw
+  void updateCBT(vk::CommandBuffer cmd_buf, const etna::Buffer& depth_pyramid);
+  // Same passes over the bisector pool, the draw decodes its leaves on its own
+  void updateBisectorPool(vk::CommandBuffer cmd_buf, const etna::Buffer& depth_pyramid);
+  // Splits or merges every leaf with a thread per leaf, does not depend on rasterization.
+  // Refinement budget is bound for the programs that include refinement_budget.glsl
+  void updateTerrain(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const char* program_name,
+    const etna::Buffer& depth_pyramid,
+    bool refinement_budget);
+  // Decodes every leaf of the updated tree once for the draw, counts split candidates for the
+  // refinement budget of the next frame
+  void cacheBisectors(vk::CommandBuffer cmd_buf, const etna::Buffer& depth_pyramid);
+  // Zeroes the first size bytes of the refinement budget between compute passes
+  void clearRefinementBudget(vk::CommandBuffer cmd_buf, vk::DeviceSize size);
+  // Requests splits or merges of every active bisector of the pool
+  void classifyBisectors(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const char* program_name,
+    const etna::Buffer& depth_pyramid);
+  // Leaves are either tessellated patches or instances of the patch mesh, leaves of the bisector
+  // pool are always tessellated
+  void renderTerrain(
+    vk::CommandBuffer cmd_buf,
+    const etna::GraphicsPipeline& pipeline,
+    const etna::Buffer& depth_pyramid,
+    bool instanced_patches,
+    bool bisector_pool);
 
   float getLodFactor(float camera_fovy, float window_height);
 
-  void updateParams();
-
 private:
   struct SubdivisionDisplayParams
   {
     float pixelsPerEdge;
     std::uint32_t subdivision;
-    float displacementVariance;
+    // bisectors with smaller height deviation on screen are not refined
+    float displacementError;
     float resolution;
+    // edges get as many segments as they need up to the subdivision scale
+    bool adaptiveTessellation;
+    // leaves are drawn as instances of a mesh of the subdivision scale, without tessellation
+    bool instancedPatches;
+  };
+
+  struct SubdivisionUpdateParams
+  {
+    // otherwise split and merge frames alternate
+    bool splitAndMerge;
+    std::uint32_t maxIterations;
+    // camera shift since the last frame that takes one more update iteration
+    float catchUpDistance;
+    // caps leaf count, splits with the largest screen space error go first
+    bool leafBudget;
+    std::uint32_t maxLeafCount;
+    // frames it takes to evaluate level of detail of every leaf
+    std::uint32_t evaluationPeriod;
+    // leaves are kept in a fixed pool of slots instead of the CBT, see BisectorPool
+    bool bisectorPool;
   };
 
 private:
   std::unique_ptr<CBTree> cbt;
+  std::unique_ptr<BisectorPool> bisectorPool;
+  BisectorPatchMesh patchMesh;
 
   SubdivisionParams params;
   SubdivisionDisplayParams displayParams;
+  SubdivisionUpdateParams updateParams;
+  std::uint32_t updateIterations;
+  std::uint32_t evaluationFrame;
   etna::Buffer paramsBuffer;
-
-  etna::GraphicsPipeline subdivisionSplitPipeline;
-  etna::GraphicsPipeline subdivisionMergePipeline;
-
-  std::unique_ptr<etna::PersistentDescriptorSet> terrainSplitSet;
-  std::unique_ptr<etna::PersistentDescriptorSet> terrainMergeSet;
+  etna::Buffer bisectorCacheBuffer;
+  etna::Buffer refinementBudgetBuffer;
+  // written by the draw and read back by the host when the frame comes around again
+  std::optional<etna::GpuSharedResource<etna::Buffer>> tessellationStatsBuffer;
+  TessellationStats tessellationStats;
+
+  etna::ComputePipeline subdivisionSplitPipeline;
+  etna::ComputePipeline subdivisionMergePipeline;
+  etna::ComputePipeline bisectorCachePipeline;
+  etna::ComputePipeline bisectorPoolSplitPipeline;
+  etna::ComputePipeline bisectorPoolMergePipeline;
+  etna::GraphicsPipeline terrainRenderPipeline;
+  etna::GraphicsPipeline terrainPatchRenderPipeline;
+  etna::GraphicsPipeline terrainPoolRenderPipeline;
+
+  GpuTimer tessellatedRenderTimer;
+  GpuTimer instancedRenderTimer;
+
+  HeightComposite heightComposite;
+  glm::vec3 cameraPosition;
 
   bool merge;
-
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
 };
@@ -0,0 +1,23 @@
+#ifndef BISECTOR_CACHE_H_INCLUDED
+#define BISECTOR_CACHE_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// leaves past the capacity are decoded by every pass on its own
+#define BISECTOR_CACHE_CAPACITY (1u << 20)
+
+// Leaf as bisector_cache.comp decodes it for the current tree and camera
+struct BisectorCacheEntry
+{
+  // world space, heights are displaced
+  shader_vec4 vertices[3];
+  shader_uint nodeIndex;
+  shader_uint nodeDepth;
+  // zero for invisible bisectors, see levelOfDetail
+  shader_float lod;
+  shader_uint visible;
+};
+
+
+#endif // BISECTOR_CACHE_H_INCLUDED
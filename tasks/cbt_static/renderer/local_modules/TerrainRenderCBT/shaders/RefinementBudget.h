@@ -0,0 +1,21 @@
+#ifndef REFINEMENT_BUDGET_H_INCLUDED
+#define REFINEMENT_BUDGET_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// split candidates are counted by level of detail in buckets of this width above 1,
+// the last one takes everything coarser
+#define REFINEMENT_BUDGET_BUCKET_COUNT 64
+#define REFINEMENT_BUDGET_BUCKET_WIDTH 0.25
+
+// Leaf cap state, cleared before the bisector cache is built
+struct RefinementBudget
+{
+  // leaves taken by splits of the pass so far, cleared before every split pass
+  shader_uint reserved;
+  shader_uint histogram[REFINEMENT_BUDGET_BUCKET_COUNT];
+};
+
+
+#endif // REFINEMENT_BUDGET_H_INCLUDED
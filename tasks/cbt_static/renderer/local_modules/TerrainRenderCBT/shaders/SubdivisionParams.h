@@ -16,9 +16,19 @@ struct SubdivisionParams
   shader_vec4 frustumPlanes[6];
 
   shader_float lodFactor;
+  // screen space height deviation threshold per unit of camera distance
   shader_float varianceFactor;
   shader_uint tesselationFactor;
-  shader_uint texturesAmount;
+  // zero for tesselationFactor on every edge, see terrain.tesc
+  shader_uint adaptiveTessellation;
+  // segments per unit of edge length over camera distance
+  shader_float tessellationLengthFactor;
+
+  // zero for no cap on leaf count, see refinement_budget.glsl
+  shader_uint maxLeafCount;
+  // a leaf gets its level of detail evaluated in one of this many frames, the phase one
+  shader_uint evaluationPeriod;
+  shader_uint evaluationPhase;
 };
 
 
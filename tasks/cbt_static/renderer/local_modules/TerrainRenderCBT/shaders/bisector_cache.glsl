@@ -0,0 +1,45 @@
+#ifndef BISECTOR_CACHE_GLSL_INCLUDED
+#define BISECTOR_CACHE_GLSL_INCLUDED
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "subdivision_lod.glsl"
+#include "BisectorCache.h"
+
+// leaves decoded once after the last tree update of the frame, indexed the same way as
+// cbtNodeDecode
+
+layout(std430, set = 0, binding = 3) buffer bisector_cache_t
+{
+  BisectorCacheEntry bisectorCache[];
+};
+
+
+BisectorCacheEntry makeBisectorCacheEntry(CBTNode node)
+{
+  vec4 triangleVertices[3] = decodeTriangleVertices(node);
+  // leaves waiting for their evaluation are neither split nor merged, but still culled
+  vec2 targetLOD = isLodEvaluated(node)
+    ? levelOfDetail(triangleVertices)
+    : vec2(1.0, float(isVisible(triangleVertices)));
+
+  return BisectorCacheEntry(
+    triangleVertices, node.index, uint(node.depth), targetLOD.x, uint(targetLOD.y));
+}
+
+BisectorCacheEntry loadBisector(uint leaf_index)
+{
+  if (leaf_index < BISECTOR_CACHE_CAPACITY)
+  {
+    return bisectorCache[leaf_index];
+  }
+
+  return makeBisectorCacheEntry(cbtNodeDecode(leaf_index));
+}
+
+CBTNode bisectorNode(BisectorCacheEntry bisector)
+{
+  return CBTNode(bisector.nodeIndex, int(bisector.nodeDepth));
+}
+
+#endif // BISECTOR_CACHE_GLSL_INCLUDED
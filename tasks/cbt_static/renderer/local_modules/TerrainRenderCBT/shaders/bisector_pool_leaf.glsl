@@ -0,0 +1,25 @@
+#ifndef BISECTOR_POOL_LEAF_GLSL_INCLUDED
+#define BISECTOR_POOL_LEAF_GLSL_INCLUDED
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "subdivision_lod.glsl"
+
+// set 0 holds the subdivision params as for the CBT backend, set 1 the height composite
+#define BISECTOR_POOL_SET 2
+#include "/subdivision/bisector_pool.glsl"
+
+// leaves of the bisector pool backend, decoded the same way as decodeTriangleVertices
+
+
+vec4[3] decodePoolBisectorVertices(uint slot)
+{
+  return displaceTriangleVertices(bisectorPoolDecodeAttribute(slot, kSquareRootPositions));
+}
+
+vec4[3] decodePoolParentVertices(uint slot)
+{
+  return displaceTriangleVertices(bisectorPoolDecodeParentAttribute(slot, kSquareRootPositions));
+}
+
+#endif // BISECTOR_POOL_LEAF_GLSL_INCLUDED
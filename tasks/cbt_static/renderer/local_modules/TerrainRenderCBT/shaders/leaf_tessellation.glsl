@@ -0,0 +1,79 @@
+#ifndef LEAF_TESSELLATION_GLSL_INCLUDED
+#define LEAF_TESSELLATION_GLSL_INCLUDED
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "subdivision_lod.glsl"
+
+#define TESSELLATION_STATS_BINDING 5
+#include "/subdivision/tessellation_factors.glsl"
+
+// a patch per leaf, shared by the control shaders of both subdivision backends
+
+layout(vertices = 1) out;
+
+layout(location = 0) out triangleData
+{
+  vec2 texCoord[3];
+}
+data[];
+
+
+// segments seen on screen, no more than height deviation around the edge in displacement errors
+float edgeFactor(vec4 first, vec4 second)
+{
+  vec3 firstView = (params.view * first).xyz;
+  vec3 secondView = (params.view * second).xyz;
+  vec4 middle = 0.5 * (first + second);
+
+  float lengthSegments =
+    edgeLengthSegments(firstView, secondView, params.tessellationLengthFactor);
+
+  float deviation = sampleHeightCompositeDeviation(middle.xz, distance(first.xz, second.xz));
+  float cameraDistance = length((params.view * middle).xyz);
+  float errorSegments = deviation / max(params.varianceFactor * cameraDistance, 1e-6);
+
+  return edgeTessellationFactor(
+    lengthSegments, errorSegments, float(params.tesselationFactor));
+}
+
+void tessellateLeaf(vec4[3] triangle_vertices, bool visible)
+{
+  if (visible)
+  {
+    data[gl_InvocationID].texCoord = vec2[3](
+      triangle_vertices[0].xz, triangle_vertices[1].xz, triangle_vertices[2].xz);
+
+    float uniformFactor = float(params.tesselationFactor);
+    vec3 outer = vec3(uniformFactor);
+    float inner = uniformFactor;
+
+    // outer levels are for the edges opposite to the first, second and third tese weights,
+    // which are the third, first and second vertex, see process.tese
+    if (params.adaptiveTessellation != 0u)
+    {
+      outer = vec3(
+        edgeFactor(triangle_vertices[0], triangle_vertices[1]),
+        edgeFactor(triangle_vertices[1], triangle_vertices[2]),
+        edgeFactor(triangle_vertices[2], triangle_vertices[0]));
+      inner = innerTessellationFactor(outer);
+    }
+
+    gl_TessLevelInner[0] = inner;
+    gl_TessLevelOuter[0] = outer.x;
+    gl_TessLevelOuter[1] = outer.y;
+    gl_TessLevelOuter[2] = outer.z;
+
+    countTessellatedVertices(outer, inner, uniformFactor);
+  }
+  else
+  {
+    gl_TessLevelInner[0] = 0.0;
+    gl_TessLevelInner[1] = 0.0;
+    gl_TessLevelOuter[0] = 0.0;
+    gl_TessLevelOuter[1] = 0.0;
+    gl_TessLevelOuter[2] = 0.0;
+  }
+}
+
+#endif // LEAF_TESSELLATION_GLSL_INCLUDED
@@ -0,0 +1,85 @@
+#ifndef REFINEMENT_BUDGET_GLSL_INCLUDED
+#define REFINEMENT_BUDGET_GLSL_INCLUDED
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "subdivision_lod.glsl"
+#include "RefinementBudget.h"
+
+// Hard cap on leaf count. bisector_cache.comp counts split candidates by level of detail for the
+// drawn tree, split passes of the next frame take the ones with the largest screen space error
+// first. The count is one frame old, but every split reserves the exact number of leaves it adds,
+// so the cap is never exceeded
+
+layout(std430, set = 0, binding = 4) buffer refinement_budget_t
+{
+  RefinementBudget budget;
+};
+
+
+bool isRefinementBudgeted()
+{
+  return params.maxLeafCount != 0u;
+}
+
+uint refinementBudgetAvailable()
+{
+  uint nodeCount = cbtNodeCount();
+  return params.maxLeafCount > nodeCount ? params.maxLeafCount - nodeCount : 0u;
+}
+
+void countSplitCandidate(float lod)
+{
+  if (!isRefinementBudgeted() || lod <= 1.0)
+  {
+    return;
+  }
+
+  int bucket = int(clamp(
+    (lod - 1.0) / REFINEMENT_BUDGET_BUCKET_WIDTH, 0.0, float(REFINEMENT_BUDGET_BUCKET_COUNT - 1)));
+  atomicAdd(budget.histogram[bucket], 1u);
+}
+
+// Buckets from the coarsest one down while their candidates fit, two leaves per split as for a
+// split together with its longest edge neighbour. The first bucket that does not fit competes
+// for what is left
+float splitLodThreshold()
+{
+  if (!isRefinementBudgeted())
+  {
+    return 1.0;
+  }
+
+  uint available = refinementBudgetAvailable();
+  uint expected = 0u;
+  for (int bucket = REFINEMENT_BUDGET_BUCKET_COUNT - 1; bucket > 0; bucket--)
+  {
+    expected += 2u * budget.histogram[bucket];
+    if (expected > available)
+    {
+      return 1.0 + float(bucket) * REFINEMENT_BUDGET_BUCKET_WIDTH;
+    }
+  }
+
+  return 1.0;
+}
+
+bool reserveSplit(CBTNode node, float lod, float lod_threshold)
+{
+  if (!isRefinementBudgeted())
+  {
+    return true;
+  }
+  if (lod < lod_threshold)
+  {
+    return false;
+  }
+
+  // leaves shared with other splits of the pass are paid for twice
+  uint cost = lebSquareNodeSplitCost(node);
+  uint reserved = atomicAdd(budget.reserved, cost);
+
+  return reserved + cost <= refinementBudgetAvailable();
+}
+
+#endif // REFINEMENT_BUDGET_GLSL_INCLUDED
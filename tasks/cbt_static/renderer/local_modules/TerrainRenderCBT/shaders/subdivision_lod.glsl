@@ -0,0 +1,119 @@
+#ifndef SUBDIVISION_LOD_GLSL_INCLUDED
+#define SUBDIVISION_LOD_GLSL_INCLUDED
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "/subdivision/cbt.glsl"
+#include "/subdivision/leb.glsl"
+#include "SubdivisionParams.h"
+
+#define DEPTH_PYRAMID_BINDING 2
+#include "/occlusion/depth_pyramid.glsl"
+
+#define HEIGHT_COMPOSITE_SET 1
+#define HEIGHT_COMPOSITE_BINDING 0
+#define HEIGHT_COMPOSITE_PARAMS_BINDING 1
+#define HEIGHT_COMPOSITE_VARIANCE_BINDING 3
+#include "/composite/height_composite.glsl"
+
+// level of detail shared by the subdivision update and the terrain draw
+
+layout(set = 0, binding = 1) uniform params_t
+{
+  SubdivisionParams params;
+};
+
+
+// Leaves keep their level of detail between evaluations, so that large trees spread the cost
+// over several frames. Heap index changes with every split or merge, which brings new leaves in
+bool isLodEvaluated(CBTNode node)
+{
+  return (node.index % params.evaluationPeriod) == params.evaluationPhase;
+}
+
+// unit square positions of the root triangle vertices, decoded into the ones of a leaf
+const mat2x3 kSquareRootPositions = mat2x3(vec3(0, 0, 1), vec3(1, 0, 0));
+
+// positions decoded from kSquareRootPositions by any node storage
+vec4[3] displaceTriangleVertices(mat2x3 pos)
+{
+  vec4 first = params.world * vec4(pos[0][0], 0.0, pos[1][0], 1.0);
+  vec4 second = params.world * vec4(pos[0][1], 0.0, pos[1][1], 1.0);
+  vec4 third = params.world * vec4(pos[0][2], 0.0, pos[1][2], 1.0);
+
+  first.y += sampleHeightComposite(first.xz);
+  second.y += sampleHeightComposite(second.xz);
+  third.y += sampleHeightComposite(third.xz);
+
+  return vec4[3](first, second, third);
+}
+
+vec4[3] decodeTriangleVertices(CBTNode node)
+{
+  return displaceTriangleVertices(lebSquareNodeDecodeAttribute(node, kSquareRootPositions));
+}
+
+float triangleLOD(vec4[3] triangle_vertices)
+{
+  vec3 first = (params.view * triangle_vertices[0]).xyz;
+  vec3 third = (params.view * triangle_vertices[1]).xyz;
+
+  float squaredLengthSum = dot(first, first) + dot(third, third);
+  float bumpToSquare = 2.0 * dot(first, third);
+
+  float distanceToEdgeSqr = squaredLengthSum + bumpToSquare;
+  float edgeLengthSqr = squaredLengthSum - bumpToSquare;
+
+  return params.lodFactor + log2(edgeLengthSqr / distanceToEdgeSqr);
+}
+
+bool isVisible(vec4[3] triangle_vertices)
+{
+  vec3 boxMin =
+    min(min(triangle_vertices[0].xyz, triangle_vertices[1].xyz), triangle_vertices[2].xyz);
+  vec3 boxMax =
+    max(max(triangle_vertices[0].xyz, triangle_vertices[1].xyz), triangle_vertices[2].xyz);
+
+  float a = 1.0;
+
+  for (int i = 0; i < 6 && a >= 0.0; i++)
+  {
+    bvec3 isInside = greaterThan(params.frustumPlanes[i].xyz, vec3(0));
+    vec3 negative = mix(boxMin, boxMax, isInside);
+
+    a = dot(vec4(negative, 1.0), params.frustumPlanes[i]);
+  }
+
+  // occluded bisectors are coarsened the same way as the ones outside of the frustum
+  return (a >= 0.0) && !isOccluded(boxMin, boxMax);
+}
+
+// height deviation under the bisector seen from the camera, flat bisectors are not refined
+bool displacementVariance(vec4[3] triangle_vertices)
+{
+  vec3 center =
+    (triangle_vertices[0].xyz + triangle_vertices[1].xyz + triangle_vertices[2].xyz) / 3.0;
+  float footprint = distance(triangle_vertices[0].xz, triangle_vertices[2].xz);
+
+  float deviation = sampleHeightCompositeDeviation(center.xz, footprint);
+  float cameraDistance = length((params.view * vec4(center, 1.0)).xyz);
+
+  return (deviation >= params.varianceFactor * cameraDistance);
+}
+
+vec2 levelOfDetail(vec4[3] triangle_vertices)
+{
+  if (!isVisible(triangle_vertices))
+  {
+    return vec2(0.0, 0.0);
+  }
+
+  if (!displacementVariance(triangle_vertices))
+  {
+    return vec2(0.0, 1.0);
+  }
+
+  return vec2(triangleLOD(triangle_vertices), 1.0);
+}
+
+#endif // SUBDIVISION_LOD_GLSL_INCLUDED
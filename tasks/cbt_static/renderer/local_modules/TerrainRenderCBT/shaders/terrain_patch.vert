@@ -0,0 +1,43 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "bisector_cache.glsl"
+
+#define BISECTOR_PATCH_BINDING 6
+#include "/subdivision/bisector_patch.glsl"
+
+layout(location = 0) out VS_OUT
+{
+  vec4 pos;
+  vec2 texCoord;
+};
+
+
+vec2 interpolate(vec2 tex_coords[3], vec3 factor)
+{
+  return tex_coords[1] + factor.x * (tex_coords[2] - tex_coords[1]) +
+    factor.y * (tex_coords[0] - tex_coords[1]);
+}
+
+// Leaf of the instance placed as terrain.tesc and process.tese place the patch, without
+// tessellation shaders. Culled leaves collapse outside of the clip volume
+void main()
+{
+  BisectorCacheEntry bisector = loadBisector(gl_InstanceIndex);
+
+  if (bisector.visible == 0u)
+  {
+    gl_Position = vec4(-2.0, -2.0, -2.0, 1.0);
+    return;
+  }
+
+  vec2 texCoords[3] =
+    vec2[3](bisector.vertices[0].xz, bisector.vertices[1].xz, bisector.vertices[2].xz);
+  vec2 worldPosition = interpolate(texCoords, bisectorPatchWeights());
+
+  pos = vec4(worldPosition.x, sampleHeightComposite(worldPosition), worldPosition.y, 1.0);
+  texCoord = worldPosition;
+
+  gl_Position = params.projView * pos;
+}
@@ -68,6 +68,7 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 16});
 
   lightModule.allocateResources();
+  depthPyramid.allocateResources(resolution);
   terrainRenderModule.allocateResources();
 
   heightMapTexture = render_utility::load_texture(
@@ -130,6 +131,7 @@ void WorldRenderer::loadScene()
 void WorldRenderer::loadShaders()
 {
   lightModule.loadShaders();
+  depthPyramid.loadShaders();
   terrainRenderModule.loadShaders();
 
   // etna::create_program(
@@ -146,6 +148,7 @@ void WorldRenderer::loadShaders()
 void WorldRenderer::setupRenderPipelines()
 {
   lightModule.setupPipelines();
+  depthPyramid.setupPipelines();
   terrainRenderModule.setupPipelines(wireframeEnabled, renderTargetFormat);
 
   auto& pipelineManager = etna::get_context().getPipelineManager();
@@ -337,6 +340,7 @@ void WorldRenderer::drawGui()
   }
 
   terrainRenderModule.drawGui();
+  depthPyramid.drawGui();
 
   ImGui::SeparatorText("General Settings");
 
@@ -406,7 +410,8 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
         cmd_buf,
         resolution,
         gBuffer->genColorAttachmentParams(),
-        gBuffer->genDepthAttachmentParams());
+        gBuffer->genDepthAttachmentParams(),
+        depthPyramid.getBuffer());
     }
 
     etna::set_state(
@@ -434,6 +439,9 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
       deferredShading(cmd_buf, currentConstants, deferredShadingPipeline.getVkPipelineLayout());
     }
 
+    // depth of this frame is used for occlusion culling in the next one
+    depthPyramid.execute(cmd_buf, params.projView, gBuffer->genDepthBinding(0));
+
     etna::set_state(
       cmd_buf,
       renderTarget.get(),
@@ -14,6 +14,7 @@
 #include "wsi/Keyboard.hpp"
 
 #include "modules/Light/LightModule.hpp"
+#include "modules/DepthPyramid/DepthPyramid.hpp"
 #include "local_modules/TerrainRenderCBT/TerrainRenderModule.hpp"
 
 #include "modules/RenderPacket.hpp"
@@ -56,6 +57,7 @@ private:
 
 private:
   LightModule lightModule;
+  DepthPyramid depthPyramid;
   TerrainRenderModule terrainRenderModule;
 
   vk::Format renderTargetFormat;
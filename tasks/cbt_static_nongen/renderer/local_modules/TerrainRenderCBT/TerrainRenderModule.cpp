@@ -1,5 +1,7 @@
 #include "TerrainRenderModule.hpp"
 
+#include <algorithm>
+
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/quaternion_geometric.hpp>
 #include <tracy/Tracy.hpp>
@@ -21,6 +23,9 @@ TerrainRenderModule::TerrainRenderModule()
        .subdivision = 4,
        .displacementVariance = 0.01f,
        .resolution = 65536.0f})
+  , updateParams({.splitAndMerge = true, .maxIterations = 4, .catchUpDistance = 64.0f})
+  , updateIterations(1)
+  , cameraPosition(0.0f)
   , merge(false)
 {
 }
@@ -45,35 +50,24 @@ void TerrainRenderModule::loadShaders()
 {
   etna::create_program(
     "subdivision_split",
-    {
-      TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "decoy.vert.spv",
-      TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "subdivision_split.tesc.spv",
-      TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "process.tese.spv",
-      TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "terrain.frag.spv",
-    });
-
+    {TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "subdivision_split.comp.spv"});
   etna::create_program(
     "subdivision_merge",
+    {TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "subdivision_merge.comp.spv"});
+
+  etna::create_program(
+    "terrain_render_cbt",
     {
       TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "decoy.vert.spv",
-      TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "subdivision_merge.tesc.spv",
+      TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "terrain.tesc.spv",
       TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "process.tese.spv",
       TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "terrain.frag.spv",
     });
   // etna::create_program(
-  //   "subdivision_split",
+  //   "terrain_render_cbt",
   //   {
   //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "decoy.vert.spv",
-  //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "subdivision_split.tesc.spv",
-  //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "process_contrast.tese.spv",
-  //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "terrain_contrast.frag.spv",
-  //   });
-
-  // etna::create_program(
-  //   "subdivision_merge",
-  //   {
-  //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "decoy.vert.spv",
-  //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "subdivision_merge.tesc.spv",
+  //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "terrain.tesc.spv",
   //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "process_contrast.tese.spv",
   //     TERRAIN_RENDER_CBT_NONGEN_MODULE_SHADERS_ROOT "terrain_contrast.frag.spv",
   //   });
@@ -85,49 +79,11 @@ void TerrainRenderModule::setupPipelines(bool wireframe_enabled, vk::Format rend
 {
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  subdivisionSplitPipeline = pipelineManager.createGraphicsPipeline(
-    "subdivision_split",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .tessellationConfig = {.patchControlPoints = 1},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .blendingConfig =
-        {
-          .attachments =
-            {{
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             },
-             {
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             },
-             {
-               .blendEnable = vk::False,
-               .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                 vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-             }},
-          .logicOpEnable = false,
-          .logicOp = {},
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats =
-            {render_target_format, vk::Format::eR8G8B8A8Snorm, vk::Format::eR8G8B8A8Unorm},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
+  subdivisionSplitPipeline = pipelineManager.createComputePipeline("subdivision_split", {});
+  subdivisionMergePipeline = pipelineManager.createComputePipeline("subdivision_merge", {});
 
-  subdivisionMergePipeline = pipelineManager.createGraphicsPipeline(
-    "subdivision_merge",
+  terrainRenderPipeline = pipelineManager.createGraphicsPipeline(
+    "terrain_render_cbt",
     etna::GraphicsPipeline::CreateInfo{
       .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
       .tessellationConfig = {.patchControlPoints = 1},
@@ -180,12 +136,17 @@ void TerrainRenderModule::loadMaps(std::vector<etna::Binding> terrain_bindings)
   terrainMergeSet =
     std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
       mergeShaderInfo.getDescriptorLayoutId(1), terrain_bindings, true));
+  auto renderShaderInfo = etna::get_shader_program("terrain_render_cbt");
+  terrainRenderSet =
+    std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
+      renderShaderInfo.getDescriptorLayoutId(1), terrain_bindings, true));
 
   auto commandBuffer = oneShotCommands->start();
   ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
   {
     terrainSplitSet->processBarriers(commandBuffer);
     terrainMergeSet->processBarriers(commandBuffer);
+    terrainRenderSet->processBarriers(commandBuffer);
   }
   ETNA_CHECK_VK_RESULT(commandBuffer.end());
   oneShotCommands->submitAndWait(commandBuffer);
@@ -199,6 +160,13 @@ void TerrainRenderModule::update(const RenderPacket& packet, float camera_fovy,
 {
   ZoneScoped;
 
+  // far camera jumps take several update iterations to reach the target subdivision
+  float cameraShift = glm::length(packet.cameraWorldPosition - cameraPosition);
+  updateIterations = std::min(
+    1u + static_cast<std::uint32_t>(cameraShift / updateParams.catchUpDistance),
+    updateParams.maxIterations);
+  cameraPosition = packet.cameraWorldPosition;
+
   params.world = glm::scale(
     glm::translate(
       glm::identity<glm::mat4>(),
@@ -244,95 +212,47 @@ void TerrainRenderModule::execute(
   vk::CommandBuffer cmd_buf,
   glm::uvec2 extent,
   std::vector<etna::RenderTargetState::AttachmentParams> color_attachment_params,
-  etna::RenderTargetState::AttachmentParams depth_attachment_params)
+  etna::RenderTargetState::AttachmentParams depth_attachment_params,
+  const etna::Buffer& depth_pyramid)
 {
-  {
-    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
-      .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-      .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-      .buffer = cbt->getDrawIndirectBuffer().get(),
-      .size = vk::WholeSize}};
-
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
-
-    cmd_buf.pipelineBarrier2(dependencyInfo);
-  }
-
-  cbt->prepareIndirect(cmd_buf);
+  cbt->beginUpdate(cmd_buf);
 
+  // tree is updated before the draw, so the frame shows the subdivision made for it
+  for (std::uint32_t i = 0; i < updateIterations; i++)
   {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .buffer = cbt->getDrawIndirectBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-        .buffer = cbt->getCBTBuffer().get(),
-        .size = vk::WholeSize}};
-
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
-
-    cmd_buf.pipelineBarrier2(dependencyInfo);
-  }
+    if (updateParams.splitAndMerge || !merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, splitTerrain);
+        updateTerrain(
+          cmd_buf, subdivisionSplitPipeline, *terrainSplitSet, "subdivision_split", depth_pyramid);
+      }
+      ETNA_PROFILE_GPU(cmd_buf, reductCBT);
+      cbt->endUpdatePass(cmd_buf);
+    }
 
-  if (!merge)
-  {
-    ETNA_PROFILE_GPU(cmd_buf, renderSplitTerrain);
-    etna::RenderTargetState renderTargets(
-      cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
+    // merge decodes leaves made by the split above, so their bits never conflict
+    if (updateParams.splitAndMerge || merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, mergeTerrain);
+        updateTerrain(
+          cmd_buf, subdivisionMergePipeline, *terrainMergeSet, "subdivision_merge", depth_pyramid);
+      }
+      ETNA_PROFILE_GPU(cmd_buf, reductCBT);
+      cbt->endUpdatePass(cmd_buf);
+    }
 
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eGraphics, subdivisionSplitPipeline.getVkPipeline());
-    splitTerrain(cmd_buf, subdivisionSplitPipeline.getVkPipelineLayout());
+    merge = !merge;
   }
-  else
+
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderMergeTerrain);
+    ETNA_PROFILE_GPU(cmd_buf, renderTerrain);
     etna::RenderTargetState renderTargets(
       cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
 
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eGraphics, subdivisionMergePipeline.getVkPipeline());
-    mergeTerrain(cmd_buf, subdivisionMergePipeline.getVkPipelineLayout());
-  }
-
-  merge = !merge;
-
-  {
-    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
-      .srcStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
-      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-      .buffer = cbt->getCBTBuffer().get(),
-      .size = vk::WholeSize}};
-
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
-
-    cmd_buf.pipelineBarrier2(dependencyInfo);
-  }
-
-  {
-    ETNA_PROFILE_GPU(cmd_buf, reductCBT);
-    cbt->reduct(cmd_buf);
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainRenderPipeline.getVkPipeline());
+    renderTerrain(cmd_buf, terrainRenderPipeline.getVkPipelineLayout(), depth_pyramid);
   }
 }
 
@@ -351,6 +271,15 @@ void TerrainRenderModule::drawGui()
     float displacementVariance = displayParams.displacementVariance;
     ImGui::DragFloat("Displacement Variance", &displacementVariance, 0.01f, 0.0f, 64.0f);
 
+    ImGui::SeparatorText("Subdivision Update");
+    ImGui::Checkbox("Split And Merge Every Frame", &updateParams.splitAndMerge);
+    int maxIterations = static_cast<int>(updateParams.maxIterations);
+    ImGui::DragInt("Max Update Iterations", &maxIterations, 1.0f, 1, 16);
+    updateParams.maxIterations = static_cast<std::uint32_t>(maxIterations);
+    ImGui::DragFloat(
+      "Camera Shift Per Iteration", &updateParams.catchUpDistance, 1.0f, 1.0f, 4096.0f);
+    ImGui::Text("Update iterations: %u", updateIterations);
+
     ImGui::SeparatorText("Terrain Map Params");
     float resolution = displayParams.resolution;
     ImGui::DragFloat("Resolution", &resolution, 10.0f, 1.0f, 131072.0f);
@@ -364,37 +293,53 @@ void TerrainRenderModule::drawGui()
   ImGui::End();
 }
 
-void TerrainRenderModule::splitTerrain(
-  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout)
+void TerrainRenderModule::updateTerrain(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const etna::PersistentDescriptorSet& terrain_set,
+  const char* program_name,
+  const etna::Buffer& depth_pyramid)
 {
-  auto shaderInfo = etna::get_shader_program("subdivision_split");
+  auto shaderInfo = etna::get_shader_program(program_name);
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
     {etna::Binding{0, cbt->getCBTBuffer().genBinding()},
-     etna::Binding{1, paramsBuffer.genBinding()}});
+     etna::Binding{1, paramsBuffer.genBinding()},
+     etna::Binding{2, depth_pyramid.genBinding()}});
 
   auto vkSet = set.getVkSet();
 
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
   cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet, terrainSplitSet->getVkSet()}, {});
+    vk::PipelineBindPoint::eCompute,
+    pipeline.getVkPipelineLayout(),
+    0,
+    {vkSet, terrain_set.getVkSet()},
+    {});
 
-  cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  cmd_buf.dispatchIndirect(cbt->getDispatchIndirectBuffer().get(), 0);
 }
 
-void TerrainRenderModule::mergeTerrain(
-  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout)
+void TerrainRenderModule::renderTerrain(
+  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, const etna::Buffer& depth_pyramid)
 {
-  auto shaderInfo = etna::get_shader_program("subdivision_merge");
+  auto shaderInfo = etna::get_shader_program("terrain_render_cbt");
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
     {etna::Binding{0, cbt->getCBTBuffer().genBinding()},
-     etna::Binding{1, paramsBuffer.genBinding()}});
+     etna::Binding{1, paramsBuffer.genBinding()},
+     etna::Binding{2, depth_pyramid.genBinding()}});
+
   auto vkSet = set.getVkSet();
 
   cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet, terrainMergeSet->getVkSet()}, {});
+    vk::PipelineBindPoint::eGraphics,
+    pipeline_layout,
+    0,
+    {vkSet, terrainRenderSet->getVkSet()},
+    {});
 
   cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
 }
@@ -407,5 +352,3 @@ float TerrainRenderModule::getLodFactor(float camera_fovy, float window_height)
 
   return -2.0f * glm::log2(targetSize) + 2.0f;
 }
-
-void TerrainRenderModule::updateParams() {}
@@ -29,18 +29,26 @@ public:
     vk::CommandBuffer cmd_buf,
     glm::uvec2 extent,
     std::vector<etna::RenderTargetState::AttachmentParams> color_attachment_params,
-    etna::RenderTargetState::AttachmentParams depth_attachment_params);
+    etna::RenderTargetState::AttachmentParams depth_attachment_params,
+    const etna::Buffer& depth_pyramid);
 
   void drawGui();
 
 private:
-  void splitTerrain(vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void mergeTerrain(vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
+  // Splits or merges every leaf with a thread per leaf, does not depend on rasterization
+  void updateTerrain(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const etna::PersistentDescriptorSet& terrain_set,
+    const char* program_name,
+    const etna::Buffer& depth_pyramid);
+  void renderTerrain(
+    vk::CommandBuffer cmd_buf,
+    vk::PipelineLayout pipeline_layout,
+    const etna::Buffer& depth_pyramid);
 
   float getLodFactor(float camera_fovy, float window_height);
 
-  void updateParams();
-
 private:
   struct SubdivisionDisplayParams
   {
@@ -50,18 +58,33 @@ private:
     float resolution;
   };
 
+  struct SubdivisionUpdateParams
+  {
+    // otherwise split and merge frames alternate
+    bool splitAndMerge;
+    std::uint32_t maxIterations;
+    // camera shift since the last frame that takes one more update iteration
+    float catchUpDistance;
+  };
+
 private:
   std::unique_ptr<CBTree> cbt;
 
   SubdivisionParams params;
   SubdivisionDisplayParams displayParams;
+  SubdivisionUpdateParams updateParams;
+  std::uint32_t updateIterations;
   etna::Buffer paramsBuffer;
 
-  etna::GraphicsPipeline subdivisionSplitPipeline;
-  etna::GraphicsPipeline subdivisionMergePipeline;
+  etna::ComputePipeline subdivisionSplitPipeline;
+  etna::ComputePipeline subdivisionMergePipeline;
+  etna::GraphicsPipeline terrainRenderPipeline;
 
   std::unique_ptr<etna::PersistentDescriptorSet> terrainSplitSet;
   std::unique_ptr<etna::PersistentDescriptorSet> terrainMergeSet;
+  std::unique_ptr<etna::PersistentDescriptorSet> terrainRenderSet;
+
+  glm::vec3 cameraPosition;
 
   bool merge;
 
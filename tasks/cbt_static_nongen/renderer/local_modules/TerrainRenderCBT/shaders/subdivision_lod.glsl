@@ -1,4 +1,5 @@
-#version 460
+#ifndef SUBDIVISION_LOD_GLSL_INCLUDED
+#define SUBDIVISION_LOD_GLSL_INCLUDED
 
 #extension GL_GOOGLE_include_directive : require
 
@@ -6,6 +7,11 @@
 #include "/subdivision/leb.glsl"
 #include "SubdivisionParams.h"
 
+#define DEPTH_PYRAMID_BINDING 2
+#include "/occlusion/depth_pyramid.glsl"
+
+// level of detail shared by the subdivision update and the terrain draw
+
 struct TerrainInfo
 {
   ivec2 extent;
@@ -13,14 +19,6 @@ struct TerrainInfo
   float heightAmplifier;
 };
 
-layout(vertices = 1) out;
-
-layout(location = 0) out triangleData
-{
-  vec2 texCoord[3];
-}
-data[];
-
 layout(set = 0, binding = 1) uniform params_t
 {
   SubdivisionParams params;
@@ -89,7 +87,8 @@ bool isVisible(vec4[3] triangle_vertices)
     a = dot(vec4(negative, 1.0), params.frustumPlanes[i]);
   }
 
-  return (a >= 0.0);
+  // occluded bisectors are coarsened the same way as the ones outside of the frustum
+  return (a >= 0.0) && !isOccluded(boxMin, boxMax);
 }
 
 bool displacementVariance(vec4[3] triangle_vertices)
@@ -107,8 +106,8 @@ bool displacementVariance(vec4[3] triangle_vertices)
 
   for (uint i = 0; i < params.texturesAmount; i++)
   {
-     vec2 displacement = textureGrad(heightMaps[i], middle, dx, dz).xz;
-      variance += clamp(displacement.y - displacement.x * displacement.x, 0.0, 1.0);
+    vec2 displacement = textureGrad(heightMaps[i], middle, dx, dz).xz;
+    variance += clamp(displacement.y - displacement.x * displacement.x, 0.0, 1.0);
   }
 
   return (variance >= params.varianceFactor);
@@ -129,32 +128,4 @@ vec2 levelOfDetail(vec4[3] triangle_vertices)
   return vec2(triangleLOD(triangle_vertices), 1.0);
 }
 
-void main()
-{
-  CBTNode node = cbtNodeDecode(gl_PrimitiveID);
-  vec4 triangleVertices[3] = decodeTriangleVertices(node);
-
-  vec2 targetLOD = levelOfDetail(triangleVertices);
-
-  if (targetLOD.x > 1.0)
-  {
-    lebSquareNodeSplit(node);
-  }
-
-  if (targetLOD.y > 0.0)
-  {
-    data[gl_InvocationID].texCoord =
-      vec2[3](triangleVertices[0].xz, triangleVertices[1].xz, triangleVertices[2].xz);
-
-    gl_TessLevelInner[0] = gl_TessLevelOuter[0] = gl_TessLevelOuter[1] = gl_TessLevelOuter[2] =
-      params.tesselationFactor;
-  }
-  else
-  {
-    gl_TessLevelInner[0] = 0.0;
-    gl_TessLevelInner[1] = 0.0;
-    gl_TessLevelOuter[0] = 0.0;
-    gl_TessLevelOuter[1] = 0.0;
-    gl_TessLevelOuter[2] = 0.0;
-  }
-}
+#endif // SUBDIVISION_LOD_GLSL_INCLUDED
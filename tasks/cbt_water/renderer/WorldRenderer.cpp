@@ -282,7 +282,9 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
     etna::set_state(
       cmd_buf,
       waterGeneratorModule.getHeightMap().get(),
-      vk::PipelineStageFlagBits2::eTessellationControlShader |
+      vk::PipelineStageFlagBits2::eComputeShader |
+        vk::PipelineStageFlagBits2::eVertexShader |
+        vk::PipelineStageFlagBits2::eTessellationControlShader |
         vk::PipelineStageFlagBits2::eTessellationEvaluationShader |
         vk::PipelineStageFlagBits2::eFragmentShader,
       vk::AccessFlagBits2::eShaderSampledRead,
@@ -1,5 +1,9 @@
 #include "WaterRenderModule.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+
 #include <tracy/Tracy.hpp>
 
 #include <imgui.h>
@@ -21,11 +25,16 @@
 
 WaterRenderModule::WaterRenderModule()
   : cbt(std::make_unique<CBTree>(25))
+  // up to 128 segments per edge
+  , patchMesh(7)
   , displayParams(
       {.pixelsPerEdge = 15.0f,
        .subdivision = 5,
        .displacementVariance = 0.01f,
-       .resolution = 16384.0f})
+       .resolution = 16384.0f,
+       .adaptiveTessellation = true,
+       .tessellationError = 0.5f,
+       .instancedPatches = false})
   , waterParams({.extent = shader_uvec2(256), .heightOffset = shader_float(0.3)})
   , renderParams(
       {.scatterColor = shader_vec4(0.016, 0.0736, 0.16, 1),
@@ -37,17 +46,26 @@ WaterRenderModule::WaterRenderModule()
        .scatterStrength = shader_float(1),
        .scatterShadowStrength = shader_float(0.7),
        .bubbleDensity = shader_float(1.3)})
+  , updateParams({.splitAndMerge = true, .maxIterations = 4, .catchUpDistance = 64.0f})
+  , updateIterations(1)
+  , tessellationStats({})
+  , cameraPosition(0.0f)
   , merge(false)
 {
 }
 
 WaterRenderModule::WaterRenderModule(WaterParams par)
   : cbt(std::make_unique<CBTree>(25))
+  // up to 128 segments per edge
+  , patchMesh(7)
   , displayParams(
       {.pixelsPerEdge = 15.0f,
        .subdivision = 3,
        .displacementVariance = 0.01f,
-       .resolution = 65536.0f})
+       .resolution = 65536.0f,
+       .adaptiveTessellation = true,
+       .tessellationError = 0.5f,
+       .instancedPatches = false})
   , waterParams(par)
   , renderParams(
       {.scatterColor = shader_vec4(0.016, 0.0736, 0.16, 1),
@@ -59,6 +77,10 @@ WaterRenderModule::WaterRenderModule(WaterParams par)
        .scatterStrength = shader_float(1),
        .scatterShadowStrength = shader_float(0.7),
        .bubbleDensity = shader_float(1.3)})
+  , updateParams({.splitAndMerge = true, .maxIterations = 4, .catchUpDistance = 64.0f})
+  , updateIterations(1)
+  , tessellationStats({})
+  , cameraPosition(0.0f)
   , merge(false)
 {
 }
@@ -101,26 +123,52 @@ void WaterRenderModule::allocateResources()
   std::memcpy(renderParamsBuffer.data(), &renderParams, sizeof(WaterRenderParams));
   renderParamsBuffer.unmap();
 
+  auto& ctx = etna::get_context();
+  tessellationStatsBuffer.emplace(ctx.getMainWorkCount(), [&](std::size_t i) {
+    auto buffer = ctx.createBuffer(
+      etna::Buffer::CreateInfo{
+        .size = sizeof(TessellationStats),
+        .bufferUsage =
+          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+        .allocationCreate =
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .name = fmt::format("waterTessellationStats{}", i)});
+
+    buffer.map();
+    std::memset(buffer.data(), 0, sizeof(TessellationStats));
+    buffer.unmap();
+
+    return buffer;
+  });
+
+  tessellatedRenderTimer.allocateResources();
+  instancedRenderTimer.allocateResources();
+
   cbt->allocateResources();
+  patchMesh.allocateResources();
 }
 
 void WaterRenderModule::loadShaders()
 {
   etna::create_program(
-    "subdivision_split",
+    "subdivision_split", {WATER_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_split.comp.spv"});
+  etna::create_program(
+    "subdivision_merge", {WATER_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_merge.comp.spv"});
+
+  etna::create_program(
+    "water_render_cbt",
     {
       WATER_RENDER_CBT_MODULE_SHADERS_ROOT "decoy.vert.spv",
-      WATER_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_split.tesc.spv",
+      WATER_RENDER_CBT_MODULE_SHADERS_ROOT "water.tesc.spv",
       WATER_RENDER_CBT_MODULE_SHADERS_ROOT "process.tese.spv",
       WATER_RENDER_CBT_MODULE_SHADERS_ROOT "water.frag.spv",
     });
 
   etna::create_program(
-    "subdivision_merge",
+    "water_render_cbt_patches",
     {
-      WATER_RENDER_CBT_MODULE_SHADERS_ROOT "decoy.vert.spv",
-      WATER_RENDER_CBT_MODULE_SHADERS_ROOT "subdivision_merge.tesc.spv",
-      WATER_RENDER_CBT_MODULE_SHADERS_ROOT "process.tese.spv",
+      WATER_RENDER_CBT_MODULE_SHADERS_ROOT "water_patch.vert.spv",
       WATER_RENDER_CBT_MODULE_SHADERS_ROOT "water.frag.spv",
     });
 
@@ -131,63 +179,42 @@ void WaterRenderModule::setupPipelines(bool wireframe_enabled, vk::Format render
 {
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  subdivisionSplitPipeline = pipelineManager.createGraphicsPipeline(
-    "subdivision_split",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .tessellationConfig = {.patchControlPoints = 1},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .blendingConfig =
-        {
-          .attachments = {{
-            .blendEnable = vk::False,
-            .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-          }},
-          .logicOpEnable = false,
-          .logicOp = {},
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {render_target_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
-
-  subdivisionMergePipeline = pipelineManager.createGraphicsPipeline(
-    "subdivision_merge",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .tessellationConfig = {.patchControlPoints = 1},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .blendingConfig =
-        {
-          .attachments = {{
-            .blendEnable = vk::False,
-            .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-          }},
-          .logicOpEnable = false,
-          .logicOp = {},
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {render_target_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
+  subdivisionSplitPipeline = pipelineManager.createComputePipeline("subdivision_split", {});
+  subdivisionMergePipeline = pipelineManager.createComputePipeline("subdivision_merge", {});
+
+  etna::GraphicsPipeline::CreateInfo pipelineInfo = {
+    .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
+    .tessellationConfig = {.patchControlPoints = 1},
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .blendingConfig =
+      {
+        .attachments = {{
+          .blendEnable = vk::False,
+          .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+            vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+        }},
+        .logicOpEnable = false,
+        .logicOp = {},
+      },
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {render_target_format},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+  };
+
+  waterRenderPipeline = pipelineManager.createGraphicsPipeline("water_render_cbt", pipelineInfo);
+
+  pipelineInfo.inputAssemblyConfig.topology = vk::PrimitiveTopology::eTriangleList;
+  pipelineInfo.tessellationConfig = {};
+  waterPatchRenderPipeline =
+    pipelineManager.createGraphicsPipeline("water_render_cbt_patches", pipelineInfo);
 
   cbt->setupPipelines();
 }
@@ -195,12 +222,20 @@ void WaterRenderModule::setupPipelines(bool wireframe_enabled, vk::Format render
 void WaterRenderModule::loadMaps()
 {
   cbt->load();
+  patchMesh.load();
 }
 
 void WaterRenderModule::update(const RenderPacket& packet, float camera_fovy, float window_height)
 {
   ZoneScoped;
 
+  // far camera jumps take several update iterations to reach the target subdivision
+  float cameraShift = glm::length(packet.cameraWorldPosition - cameraPosition);
+  updateIterations = std::min(
+    1u + static_cast<std::uint32_t>(cameraShift / updateParams.catchUpDistance),
+    updateParams.maxIterations);
+  cameraPosition = packet.cameraWorldPosition;
+
   subdivisionParams.world = glm::scale(
     glm::translate(
       glm::identity<glm::mat4>(),
@@ -237,6 +272,10 @@ void WaterRenderModule::update(const RenderPacket& packet, float camera_fovy, fl
   subdivisionParams.varianceFactor =
     (displayParams.displacementVariance / 64.0f) * (displayParams.displacementVariance / 64.0f);
   subdivisionParams.tesselationFactor = 1u << displayParams.subdivision;
+  subdivisionParams.adaptiveTessellation = displayParams.adaptiveTessellation ? 1u : 0u;
+  float pixelsPerUnit = window_height / (2.0f * glm::tan(glm::radians(camera_fovy) / 2.0f));
+  subdivisionParams.tessellationLengthFactor = pixelsPerUnit / displayParams.pixelsPerEdge;
+  subdivisionParams.tessellationErrorFactor = displayParams.tessellationError / pixelsPerUnit;
 
   subdivisionParamsBuffer.map();
   std::memcpy(subdivisionParamsBuffer.data(), &subdivisionParams, sizeof(SubdivisionParams));
@@ -255,41 +294,68 @@ void WaterRenderModule::execute(
   const etna::Buffer& directional_lights_buffer,
   const etna::Image& cubemap)
 {
+  // the fence of this frame was waited for before recording, so the timestamps and counts of
+  // the draw mainWorkCount frames ago are complete
+  tessellatedRenderTimer.readback();
+  instancedRenderTimer.readback();
+
   {
-    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
-      .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-      .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-      .buffer = cbt->getDrawIndirectBuffer().get(),
-      .size = vk::WholeSize}};
+    auto& stats = tessellationStatsBuffer->get();
+    stats.map();
+    std::memcpy(&tessellationStats, stats.data(), sizeof(TessellationStats));
+    stats.unmap();
+  }
 
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
+  cbt->beginUpdate(cmd_buf);
 
-    cmd_buf.pipelineBarrier2(dependencyInfo);
+  // tree is updated before the draw, so the frame shows the subdivision made for it
+  for (std::uint32_t i = 0; i < updateIterations; i++)
+  {
+    if (updateParams.splitAndMerge || !merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, splitWater);
+        updateWater(
+          cmd_buf, subdivisionSplitPipeline, "subdivision_split", water_map, water_sampler);
+      }
+      ETNA_PROFILE_GPU(cmd_buf, reductCBT);
+      cbt->endUpdatePass(cmd_buf);
+    }
+
+    // merge decodes leaves made by the split above, so their bits never conflict
+    if (updateParams.splitAndMerge || merge)
+    {
+      {
+        ETNA_PROFILE_GPU(cmd_buf, mergeWater);
+        updateWater(
+          cmd_buf, subdivisionMergePipeline, "subdivision_merge", water_map, water_sampler);
+      }
+      ETNA_PROFILE_GPU(cmd_buf, reductCBT);
+      cbt->endUpdatePass(cmd_buf);
+    }
+
+    merge = !merge;
   }
 
-  cbt->prepareIndirect(cmd_buf);
+  if (displayParams.instancedPatches)
+  {
+    patchMesh.prepareDraw(cmd_buf, *cbt, displayParams.subdivision);
+  }
+
+  GpuTimer& renderTimer =
+    displayParams.instancedPatches ? instancedRenderTimer : tessellatedRenderTimer;
+  // counted from zero by the control shaders of this frame
+  cmd_buf.fillBuffer(tessellationStatsBuffer->get().get(), 0, vk::WholeSize, 0);
 
   {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .buffer = cbt->getDrawIndirectBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-        .buffer = cbt->getCBTBuffer().get(),
-        .size = vk::WholeSize}};
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+      .buffer = tessellationStatsBuffer->get().get(),
+      .size = vk::WholeSize}};
 
     vk::DependencyInfo dependencyInfo = {
       .dependencyFlags = vk::DependencyFlagBits::eByRegion,
@@ -299,35 +365,16 @@ void WaterRenderModule::execute(
     cmd_buf.pipelineBarrier2(dependencyInfo);
   }
 
-  if (!merge)
-  {
-    ETNA_PROFILE_GPU(cmd_buf, renderSplitTerrain);
-    etna::RenderTargetState renderTargets(
-      cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
-
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eGraphics, subdivisionSplitPipeline.getVkPipeline());
-    splitWater(
-      cmd_buf,
-      subdivisionSplitPipeline.getVkPipelineLayout(),
-      packet,
-      water_map,
-      water_normal_map,
-      water_sampler,
-      directional_lights_buffer,
-      cubemap);
-  }
-  else
+  renderTimer.start(cmd_buf);
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderMergeTerrain);
+    ETNA_PROFILE_GPU(cmd_buf, renderWater);
     etna::RenderTargetState renderTargets(
       cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
 
-    cmd_buf.bindPipeline(
-      vk::PipelineBindPoint::eGraphics, subdivisionMergePipeline.getVkPipeline());
-    mergeWater(
+    renderWater(
       cmd_buf,
-      subdivisionMergePipeline.getVkPipelineLayout(),
+      displayParams.instancedPatches ? waterPatchRenderPipeline : waterRenderPipeline,
+      displayParams.instancedPatches,
       packet,
       water_map,
       water_normal_map,
@@ -335,30 +382,23 @@ void WaterRenderModule::execute(
       directional_lights_buffer,
       cubemap);
   }
-
-  merge = !merge;
+  renderTimer.stop(cmd_buf);
 
   {
     std::array bufferBarriers = {vk::BufferMemoryBarrier2{
       .srcStageMask = vk::PipelineStageFlagBits2::eTessellationControlShader,
       .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
-      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-      .buffer = cbt->getCBTBuffer().get(),
+      .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+      .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+      .buffer = tessellationStatsBuffer->get().get(),
       .size = vk::WholeSize}};
 
     vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
       .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
       .pBufferMemoryBarriers = bufferBarriers.data()};
 
     cmd_buf.pipelineBarrier2(dependencyInfo);
   }
-
-  {
-    ETNA_PROFILE_GPU(cmd_buf, reductCBT);
-    cbt->reduct(cmd_buf);
-  }
 }
 
 void WaterRenderModule::drawGui()
@@ -436,6 +476,36 @@ void WaterRenderModule::drawGui()
     float displacementVariance = displayParams.displacementVariance;
     ImGui::DragFloat("Displacement Variance", &displacementVariance, 0.01f, 0.0f, 64.0f);
 
+    ImGui::SeparatorText("Tessellation");
+    bool instancedPatches = displayParams.instancedPatches;
+    ImGui::Checkbox("Instanced Patches Instead Of Tessellation", &instancedPatches);
+    ImGui::Text(
+      "Draw: tessellated %.3f ms, instanced patches %.3f ms",
+      tessellatedRenderTimer.getMilliseconds(),
+      instancedRenderTimer.getMilliseconds());
+    bool adaptiveTessellation = displayParams.adaptiveTessellation;
+    ImGui::Checkbox("Adaptive Tessellation", &adaptiveTessellation);
+    float tessellationError = displayParams.tessellationError;
+    ImGui::DragFloat("Tessellation Error Pixels", &tessellationError, 0.01f, 0.01f, 64.0f);
+    ImGui::Text("Patches: %u", tessellationStats.patches);
+    ImGui::Text(
+      "Tessellated vertices: %u of %u uniform, %.1f%% saved",
+      tessellationStats.vertices,
+      tessellationStats.uniformVertices,
+      tessellationStats.uniformVertices > 0
+        ? 100.0 * (1.0 - static_cast<double>(tessellationStats.vertices) /
+                     static_cast<double>(tessellationStats.uniformVertices))
+        : 0.0);
+
+    ImGui::SeparatorText("Subdivision Update");
+    ImGui::Checkbox("Split And Merge Every Frame", &updateParams.splitAndMerge);
+    int maxIterations = static_cast<int>(updateParams.maxIterations);
+    ImGui::DragInt("Max Update Iterations", &maxIterations, 1.0f, 1, 16);
+    updateParams.maxIterations = static_cast<std::uint32_t>(maxIterations);
+    ImGui::DragFloat(
+      "Camera Shift Per Iteration", &updateParams.catchUpDistance, 1.0f, 1.0f, 4096.0f);
+    ImGui::Text("Update iterations: %u", updateIterations);
+
     ImGui::SeparatorText("Water Map Params");
     float resolution = displayParams.resolution;
     ImGui::DragFloat("Resolution", &resolution, 10.0f, 1.0f, 131072.0f);
@@ -444,7 +514,10 @@ void WaterRenderModule::drawGui()
       .pixelsPerEdge = pixelsPerEdge,
       .subdivision = static_cast<std::uint32_t>(subdivision),
       .displacementVariance = displacementVariance,
-      .resolution = resolution};
+      .resolution = resolution,
+      .adaptiveTessellation = adaptiveTessellation,
+      .tessellationError = tessellationError,
+      .instancedPatches = instancedPatches};
   }
 
   if (renderParamsChanged)
@@ -458,50 +531,36 @@ void WaterRenderModule::drawGui()
   ImGui::End();
 }
 
-void WaterRenderModule::splitWater(
+void WaterRenderModule::updateWater(
   vk::CommandBuffer cmd_buf,
-  vk::PipelineLayout pipeline_layout,
-  const RenderPacket& packet,
+  const etna::ComputePipeline& pipeline,
+  const char* program_name,
   const etna::Image& water_map,
-  const etna::Image& water_normal_map,
-  const etna::Sampler& water_sampler,
-  const etna::Buffer& directional_lights_buffer,
-  const etna::Image& cubemap)
+  const etna::Sampler& water_sampler)
 {
-  auto shaderInfo = etna::get_shader_program("subdivision_split");
+  auto shaderInfo = etna::get_shader_program(program_name);
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
     {etna::Binding{0, cbt->getCBTBuffer().genBinding()},
      etna::Binding{1, subdivisionParamsBuffer.genBinding()},
      etna::Binding{2, waterParamsBuffer.genBinding()},
-     etna::Binding{3, renderParamsBuffer.genBinding()},
-     etna::Binding{
-       4, water_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
-     etna::Binding{
-       5,
-       water_normal_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
      etna::Binding{
-       6,
-       cubemap.genBinding(
-         water_sampler.get(),
-         vk::ImageLayout::eShaderReadOnlyOptimal,
-         {.type = vk::ImageViewType::eCube})},
-     etna::Binding{7, directional_lights_buffer.genBinding()}});
+       4, water_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
 
   auto vkSet = set.getVkSet();
 
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet}, {});
-
-  cmd_buf.pushConstants<RenderPacket>(
-    pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, {packet});
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {vkSet}, {});
 
-  cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  cmd_buf.dispatchIndirect(cbt->getDispatchIndirectBuffer().get(), 0);
 }
 
-void WaterRenderModule::mergeWater(
+void WaterRenderModule::renderWater(
   vk::CommandBuffer cmd_buf,
-  vk::PipelineLayout pipeline_layout,
+  const etna::GraphicsPipeline& pipeline,
+  bool instanced_patches,
   const RenderPacket& packet,
   const etna::Image& water_map,
   const etna::Image& water_normal_map,
@@ -509,34 +568,53 @@ void WaterRenderModule::mergeWater(
   const etna::Buffer& directional_lights_buffer,
   const etna::Image& cubemap)
 {
-  auto shaderInfo = etna::get_shader_program("subdivision_merge");
-  auto set = etna::create_descriptor_set(
-    shaderInfo.getDescriptorLayoutId(0),
-    cmd_buf,
-    {etna::Binding{0, cbt->getCBTBuffer().genBinding()},
-     etna::Binding{1, subdivisionParamsBuffer.genBinding()},
-     etna::Binding{2, waterParamsBuffer.genBinding()},
-     etna::Binding{3, renderParamsBuffer.genBinding()},
-     etna::Binding{
-       4, water_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
-     etna::Binding{
-       5,
-       water_normal_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
-     etna::Binding{
-       6,
-       cubemap.genBinding(
-         water_sampler.get(),
-         vk::ImageLayout::eShaderReadOnlyOptimal,
-         {.type = vk::ImageViewType::eCube})},
-     etna::Binding{7, directional_lights_buffer.genBinding()}});
+  std::vector<etna::Binding> bindings = {
+    etna::Binding{0, cbt->getCBTBuffer().genBinding()},
+    etna::Binding{1, subdivisionParamsBuffer.genBinding()},
+    etna::Binding{2, waterParamsBuffer.genBinding()},
+    etna::Binding{3, renderParamsBuffer.genBinding()},
+    etna::Binding{
+      4, water_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+    etna::Binding{
+      5,
+      water_normal_map.genBinding(water_sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+    etna::Binding{
+      6,
+      cubemap.genBinding(
+        water_sampler.get(),
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        {.type = vk::ImageViewType::eCube})},
+    etna::Binding{7, directional_lights_buffer.genBinding()}};
+  if (instanced_patches)
+  {
+    bindings.push_back(patchMesh.genVerticesBinding(9));
+  }
+  else
+  {
+    bindings.push_back(etna::Binding{8, tessellationStatsBuffer->get().genBinding()});
+  }
+
+  auto shaderInfo =
+    etna::get_shader_program(instanced_patches ? "water_render_cbt_patches" : "water_render_cbt");
+  auto set = etna::create_descriptor_set(shaderInfo.getDescriptorLayoutId(0), cmd_buf, bindings);
+
   auto vkSet = set.getVkSet();
 
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet}, {});
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, {vkSet}, {});
 
   cmd_buf.pushConstants<RenderPacket>(
-    pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, {packet});
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eFragment, 0, {packet});
 
-  cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  if (instanced_patches)
+  {
+    patchMesh.draw(cmd_buf);
+  }
+  else
+  {
+    cmd_buf.drawIndirect(cbt->getDrawIndirectBuffer().get(), 0, 1, 0);
+  }
 }
 
 float WaterRenderModule::getLodFactor(float camera_fovy, float window_height)
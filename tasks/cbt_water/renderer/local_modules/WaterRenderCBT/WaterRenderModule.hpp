@@ -1,15 +1,21 @@
 #pragma once
 
+#include <optional>
+
 #include <etna/ComputePipeline.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/DescriptorSet.hpp>
+#include <etna/GpuSharedResource.hpp>
 #include <etna/OneShotCmdMgr.hpp>
 
 #include "modules/RenderPacket.hpp"
+#include "render_utils/GpuTimer.hpp"
 #include "CBT/CBTree.hpp"
+#include "CBT/BisectorPatchMesh.hpp"
+#include "subdivision/TessellationStats.h"
 #include "shaders/SubdivisionParams.h"
 #include "shaders/WaterParams.h"
 #include "shaders/WaterRenderParams.h"
@@ -50,22 +56,37 @@ private:
     std::uint32_t subdivision;
     float displacementVariance;
     float resolution;
+    // edges get as many segments as they need up to the subdivision scale
+    bool adaptiveTessellation;
+    // wave height off a segment in pixels that is allowed
+    float tessellationError;
+    // leaves are drawn as instances of a mesh of the subdivision scale, without tessellation
+    bool instancedPatches;
+  };
+
+  struct SubdivisionUpdateParams
+  {
+    // otherwise split and merge frames alternate
+    bool splitAndMerge;
+    std::uint32_t maxIterations;
+    // camera shift since the last frame that takes one more update iteration
+    float catchUpDistance;
   };
 
 private:
-  void splitWater(
+  // Splits or merges every leaf with a thread per leaf, does not depend on rasterization
+  void updateWater(
     vk::CommandBuffer cmd_buf,
-    vk::PipelineLayout pipeline_layout,
-      const RenderPacket& packet,
+    const etna::ComputePipeline& pipeline,
+    const char* program_name,
     const etna::Image& water_map,
-    const etna::Image& water_normal_map,
-    const etna::Sampler& water_sampler,
-    const etna::Buffer& directional_lights_buffer,
-    const etna::Image& cubemap);
-  void mergeWater(
+    const etna::Sampler& water_sampler);
+  // Leaves are either tessellated patches or instances of the patch mesh
+  void renderWater(
     vk::CommandBuffer cmd_buf,
-    vk::PipelineLayout pipeline_layout,
-      const RenderPacket& packet,
+    const etna::GraphicsPipeline& pipeline,
+    bool instanced_patches,
+    const RenderPacket& packet,
     const etna::Image& water_map,
     const etna::Image& water_normal_map,
     const etna::Sampler& water_sampler,
@@ -74,17 +95,26 @@ private:
 
   float getLodFactor(float camera_fovy, float window_height);
 
-  void updateParams();
-
 private:
   std::unique_ptr<CBTree> cbt;
+  BisectorPatchMesh patchMesh;
 
   SubdivisionParams subdivisionParams;
   SubdivisionDisplayParams displayParams;
+  SubdivisionUpdateParams updateParams;
+  std::uint32_t updateIterations;
   etna::Buffer subdivisionParamsBuffer;
+  // written by the draw and read back by the host when the frame comes around again
+  std::optional<etna::GpuSharedResource<etna::Buffer>> tessellationStatsBuffer;
+  TessellationStats tessellationStats;
+
+  etna::ComputePipeline subdivisionSplitPipeline;
+  etna::ComputePipeline subdivisionMergePipeline;
+  etna::GraphicsPipeline waterRenderPipeline;
+  etna::GraphicsPipeline waterPatchRenderPipeline;
 
-  etna::GraphicsPipeline subdivisionSplitPipeline;
-  etna::GraphicsPipeline subdivisionMergePipeline;
+  GpuTimer tessellatedRenderTimer;
+  GpuTimer instancedRenderTimer;
 
   WaterParams waterParams;
   etna::Buffer waterParamsBuffer;
@@ -92,5 +122,7 @@ private:
   WaterRenderParams renderParams;
   etna::Buffer renderParamsBuffer;
 
+  glm::vec3 cameraPosition;
+
   bool merge;
 };
@@ -18,6 +18,12 @@ struct SubdivisionParams
   shader_float lodFactor;
   shader_float varianceFactor;
   shader_uint tesselationFactor;
+  // zero for tesselationFactor on every edge, see water.tesc
+  shader_uint adaptiveTessellation;
+  // segments per unit of edge length over camera distance
+  shader_float tessellationLengthFactor;
+  // height error per unit of camera distance that is seen as a pixel
+  shader_float tessellationErrorFactor;
   shader_uint texturesAmount;
 };
 
@@ -1,4 +1,5 @@
-#version 460
+#ifndef SUBDIVISION_LOD_GLSL_INCLUDED
+#define SUBDIVISION_LOD_GLSL_INCLUDED
 
 #extension GL_GOOGLE_include_directive : require
 
@@ -7,14 +8,7 @@
 #include "SubdivisionParams.h"
 #include "WaterParams.h"
 
-
-layout(vertices = 1) out;
-
-layout(location = 0) out triangleData
-{
-  vec2 texCoord[3];
-}
-data[];
+// level of detail shared by the subdivision update and the water draw
 
 layout(binding = 1) uniform params_t
 {
@@ -29,6 +23,11 @@ layout(binding = 2) uniform terrain_params_t
 layout(binding = 4) uniform sampler2D heightMap;
 
 
+float sampleWaterHeight(vec2 world_position)
+{
+  return texture(heightMap, 0.5 * (world_position / waterParams.extent) + 0.5).x;
+}
+
 vec4[3] decodeTriangleVertices(CBTNode node)
 {
   vec3 xPos = vec3(0, 0, 1);
@@ -38,9 +37,9 @@ vec4[3] decodeTriangleVertices(CBTNode node)
   vec4 second = subdivisionParams.world * vec4(pos[0][1], 0.0, pos[1][1], 1.0);
   vec4 third = subdivisionParams.world * vec4(pos[0][2], 0.0, pos[1][2], 1.0);
 
-  first.y = texture(heightMap, 0.5 * (first.xz / waterParams.extent) + 0.5).x;
-  second.y = texture(heightMap, 0.5 * (second.xz / waterParams.extent) + 0.5).x;
-  third.y = texture(heightMap, 0.5 * (third.xz / waterParams.extent) + 0.5).x;
+  first.y = sampleWaterHeight(first.xz);
+  second.y = sampleWaterHeight(second.xz);
+  third.y = sampleWaterHeight(third.xz);
 
   return vec4[3](first, second, third);
 }
@@ -116,32 +115,4 @@ vec2 levelOfDetail(vec4[3] triangle_vertices)
   return vec2(triangleLOD(triangle_vertices), 1.0);
 }
 
-void main()
-{
-  CBTNode node = cbtNodeDecode(gl_PrimitiveID);
-  vec4 triangleVertices[3] = decodeTriangleVertices(node);
-
-  vec2 targetLOD = levelOfDetail(triangleVertices);
-
-  if (targetLOD.x > 1.0)
-  {
-    lebSquareNodeSplit(node);
-  }
-
-  if (true)
-  {
-    data[gl_InvocationID].texCoord =
-      vec2[3](triangleVertices[0].xz, triangleVertices[1].xz, triangleVertices[2].xz);
-
-    gl_TessLevelInner[0] = gl_TessLevelOuter[0] = gl_TessLevelOuter[1] = gl_TessLevelOuter[2] =
-      subdivisionParams.tesselationFactor;
-  }
-  else
-  {
-    gl_TessLevelInner[0] = 0.0;
-    gl_TessLevelInner[1] = 0.0;
-    gl_TessLevelOuter[0] = 0.0;
-    gl_TessLevelOuter[1] = 0.0;
-    gl_TessLevelOuter[2] = 0.0;
-  }
-}
+#endif // SUBDIVISION_LOD_GLSL_INCLUDED
@@ -0,0 +1,44 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "subdivision_lod.glsl"
+
+#define BISECTOR_PATCH_BINDING 9
+#include "/subdivision/bisector_patch.glsl"
+
+layout(location = 0) out VS_OUT
+{
+  vec4 pos;
+  vec2 texCoord;
+};
+
+
+vec2 interpolate(vec2 tex_coords[3], vec3 factor)
+{
+  return tex_coords[1] + factor.x * (tex_coords[2] - tex_coords[1]) +
+    factor.y * (tex_coords[0] - tex_coords[1]);
+}
+
+// Leaf of the instance placed as water.tesc and process.tese place the patch, without
+// tessellation shaders
+void main()
+{
+  CBTNode node = cbtNodeDecode(gl_InstanceIndex);
+  vec4 triangleVertices[3] = decodeTriangleVertices(node);
+
+  if (!isVisible(triangleVertices))
+  {
+    gl_Position = vec4(-2.0, -2.0, -2.0, 1.0);
+    return;
+  }
+
+  vec2 texCoords[3] =
+    vec2[3](triangleVertices[0].xz, triangleVertices[1].xz, triangleVertices[2].xz);
+  vec2 worldPosition = interpolate(texCoords, bisectorPatchWeights());
+
+  pos = vec4(worldPosition.x, sampleWaterHeight(worldPosition), worldPosition.y, 1.0);
+  texCoord = worldPosition / waterParams.extent;
+
+  gl_Position = subdivisionParams.projView * pos;
+}
@@ -122,7 +122,7 @@ void GBuffer::prepareForRead(vk::CommandBuffer cmd_buf)
   etna::set_state(
     cmd_buf,
     depth.get(),
-    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
     vk::AccessFlagBits2::eShaderSampledRead,
     vk::ImageLayout::eShaderReadOnlyOptimal,
     vk::ImageAspectFlagBits::eDepth);
@@ -60,6 +60,7 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 6});
 
   lightModule.allocateResources();
+  depthPyramid.allocateResources(resolution);
   terrainGeneratorModule.allocateResources();
   terrainRenderModule.allocateResources();
 }
@@ -98,6 +99,7 @@ void WorldRenderer::loadScene()
 void WorldRenderer::loadShaders()
 {
   lightModule.loadShaders();
+  depthPyramid.loadShaders();
   terrainGeneratorModule.loadShaders();
   terrainRenderModule.loadShaders();
 
@@ -114,6 +116,7 @@ void WorldRenderer::loadShaders()
 void WorldRenderer::setupRenderPipelines()
 {
   lightModule.setupPipelines();
+  depthPyramid.setupPipelines();
   terrainGeneratorModule.setupPipelines();
   terrainRenderModule.setupPipelines(wireframeEnabled, renderTargetFormat);
 
@@ -280,6 +283,13 @@ void WorldRenderer::drawGui()
 
   terrainGeneratorModule.drawGui();
   terrainRenderModule.drawGui();
+  depthPyramid.drawGui();
+
+  if (terrainMapsVersion != terrainGeneratorModule.getMapsVersion())
+  {
+    terrainMapsVersion = terrainGeneratorModule.getMapsVersion();
+    terrainRenderModule.updateHeightMaps();
+  }
 
   ImGui::SeparatorText("General Settings");
 
@@ -352,7 +362,8 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
         renderPacket,
         resolution,
         gBuffer->genColorAttachmentParams(),
-        gBuffer->genDepthAttachmentParams());
+        gBuffer->genDepthAttachmentParams(),
+        depthPyramid.getBuffer());
     }
 
 
@@ -381,6 +392,9 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
       deferredShading(cmd_buf, currentConstants, deferredShadingPipeline.getVkPipelineLayout());
     }
 
+    // depth of this frame is used for occlusion culling in the next one
+    depthPyramid.execute(cmd_buf, params.projView, gBuffer->genDepthBinding(0));
+
     etna::set_state(
       cmd_buf,
       renderTarget.get(),
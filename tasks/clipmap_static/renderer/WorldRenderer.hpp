@@ -14,6 +14,7 @@
 #include "wsi/Keyboard.hpp"
 
 #include "modules/Light/LightModule.hpp"
+#include "modules/DepthPyramid/DepthPyramid.hpp"
 #include "modules/TerrainGenerator/TerrainGeneratorModule.hpp"
 #include "local_modules/TerrainRender/TerrainRenderModule.hpp"
 #include "modules/RenderPacket.hpp"
@@ -48,10 +49,12 @@ private:
 
 private:
   LightModule lightModule;
+  DepthPyramid depthPyramid;
   TerrainGeneratorModule terrainGeneratorModule;
   TerrainRenderModule terrainRenderModule;
 
   bool freezeClipmap;
+  uint32_t terrainMapsVersion = 0;
 
   vk::Format renderTargetFormat;
 
@@ -8,6 +8,7 @@ struct MeshesParams
 {
   shader_uint instancesCount;
   shader_uint relemsCount;
+  shader_uint pairsCount;
 };
 
 
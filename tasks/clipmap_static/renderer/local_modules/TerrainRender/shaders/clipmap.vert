@@ -1,40 +1,42 @@
 #version 460
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-struct TerrainInfo
+#include "/clipmap/clipmap_instance.glsl"
+#include "/clipmap/clipmap_vertex.glsl"
+
+#define LEVEL_MAPS_BINDING 4
+#include "/clipmap/level_maps.glsl"
+
+layout(binding = 0) readonly buffer instances_t
 {
-  ivec2 extent;
-  float heightOffset;
-  float heightAmplifier;
+  ClipmapInstance instances[];
 };
 
-layout(location = 0) in vec2 vPos;
-
-layout(set = 0, binding = 0) uniform sampler2D heightMaps[32];
-layout(set = 0, binding = 1) readonly buffer infos_t
+layout(binding = 1) readonly buffer draw_relems_instance_indices_t
 {
-  TerrainInfo infos[];
+  uint drawRelemsInstanceIndices[];
 };
 
-layout(std140, set = 1, binding = 0) readonly buffer instance_matrices_t
+layout(binding = 2) readonly buffer relem_layouts_t
 {
-  mat4 instanceMatrices[];
+  ClipmapRelemLayout relemLayouts[];
 };
 
-layout(set = 1, binding = 1) readonly buffer draw_relems_instance_indices_t
+layout(binding = 3) readonly buffer draw_relems_t
 {
-  uint drawRelemsInstanceIndices[];
+  uint drawRelems[];
 };
 
 layout(push_constant) uniform proj_view_t
 {
   mat4 projView;
-  uint texturesAmount;
 };
 
 layout(location = 0) out VS_OUT
 {
   vec3 wPos;
+  flat uint level;
 }
 vOut;
 
@@ -46,22 +48,19 @@ out gl_PerVertex
 
 void main(void)
 {
-  mat4 currentModelMatrix = instanceMatrices[drawRelemsInstanceIndices[gl_InstanceIndex]];
-
-  vec3 pos = (currentModelMatrix * vec4(vPos.x, 0, vPos.y, 1.0)).xyz;
+  // draws are compacted on GPU, so draw index goes through the visible relems list
+  ClipmapRelemLayout currentLayout = relemLayouts[drawRelems[gl_DrawID]];
+  vec2 vPos = pullClipmapVertex(currentLayout, uint(gl_VertexIndex) - currentLayout.vertexOffset);
 
-  float height = 0;
+  ClipmapInstance currentInstance = instances[drawRelemsInstanceIndices[gl_InstanceIndex]];
 
-  for (uint i = 0; i < texturesAmount; i++)
-  {
-    vec2 texCoord =  0.5 * pos.xz / infos[i].extent + 0.5;
-    height +=
-      (texture(heightMaps[i], texCoord).x - infos[i].heightOffset) * infos[i].heightAmplifier;
-  }
+  vec3 pos = vec3(toWorldPosition(currentInstance, vPos), 0).xzy;
 
-  pos.y = height;
+  // every vertex lies on the grid of its level, so its height is stored in level maps as is
+  pos.y = fetchLevelMaps(pos.xz, currentInstance.scaleExponent).x;
 
   vOut.wPos = pos;
+  vOut.level = currentInstance.scaleExponent;
 
   gl_Position = projView * vec4(vOut.wPos, 1.0);
 }
@@ -17,6 +17,7 @@ WorldRenderer::WorldRenderer()
   : lightModule()
   , terrainRenderModule()
   , freezeClipmap(false)
+  , heightMapResidencyVersion(0)
   , renderTargetFormat(vk::Format::eB10G11R11UfloatPack32)
   , wireframeEnabled(false)
 {
@@ -64,13 +65,12 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 6});
 
   lightModule.allocateResources();
+  depthPyramid.allocateResources(resolution);
   terrainRenderModule.allocateResources();
 
-  heightMapTexture = render_utility::load_texture(
-    *transferHelper,
-    *oneShotCommands,
-    GRAPHICS_COURSE_RESOURCES_ROOT "/textures/HeightMaps/4K/Heightmap_06_Canyons_blurred.png",
-    vk::Format::eR8G8B8A8Srgb);
+  // heightmap is never loaded whole, tiles visible terrain needs are streamed from disk
+  heightMapStreamer.allocateResources(
+    GRAPHICS_COURSE_RESOURCES_ROOT "/textures/HeightMaps/4K/Heightmap_06_Canyons_blurred.png");
 
   info = {.extent = glm::ivec2(4096), .heightOffset = 0.04f, .heightAmplifier = 10000.0f};
 
@@ -91,12 +91,11 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 // call only after loadShaders(...)
 void WorldRenderer::loadScene()
 {
-  terrainRenderModule.loadMaps(
-    {etna::Binding{
-       0,
-       heightMapTexture.genBinding(
-         heightMapSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
-     etna::Binding{1, terrainInfoBuffer.genBinding()}});
+  terrainRenderModule.loadStreamedMap(
+    {heightMapStreamer.genPoolBinding(0),
+     etna::Binding{1, terrainInfoBuffer.genBinding()},
+     heightMapStreamer.genPageTableBinding(2)},
+    heightMapStreamer.genBoundsBinding(1));
 
   lightModule.loadLights(
     {{.pos = {0, 27, 0}, .radius = 0, .worldPos = {}, .color = {1, 1, 1}, .intensity = 15},
@@ -116,10 +115,11 @@ void WorldRenderer::loadScene()
       .intensity = 1.0f,
       .color = glm::vec3{1, 0.694, 0.32}}});
 
+  // lights are displaced once, so the coarsest mip is precise enough
   lightModule.loadMaps(
     {etna::Binding{
        0,
-       heightMapTexture.genBinding(
+       heightMapStreamer.getOverviewTexture().genBinding(
          heightMapSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
      etna::Binding{1, terrainInfoBuffer.genBinding()}});
 
@@ -129,6 +129,7 @@ void WorldRenderer::loadScene()
 void WorldRenderer::loadShaders()
 {
   lightModule.loadShaders();
+  depthPyramid.loadShaders();
   terrainRenderModule.loadShaders();
 
   etna::create_program(
@@ -145,6 +146,7 @@ void WorldRenderer::loadShaders()
 void WorldRenderer::setupRenderPipelines()
 {
   lightModule.setupPipelines();
+  depthPyramid.setupPipelines();
   terrainRenderModule.setupPipelines(wireframeEnabled, renderTargetFormat);
 
   auto& pipelineManager = etna::get_context().getPipelineManager();
@@ -336,9 +338,12 @@ void WorldRenderer::drawGui()
     std::memcpy(terrainInfoBuffer.data(), &info, sizeof(TerrainInfo));
     terrainInfoBuffer.unmap();
     infosChanged = false;
+    terrainRenderModule.updateHeightMaps();
   }
 
   terrainRenderModule.drawGui();
+  depthPyramid.drawGui();
+  heightMapStreamer.drawGui();
 
   ImGui::SeparatorText("General Settings");
 
@@ -404,6 +409,13 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
 
     etna::flush_barriers(cmd_buf);
 
+    heightMapStreamer.execute(cmd_buf);
+    if (heightMapStreamer.getResidencyVersion() != heightMapResidencyVersion)
+    {
+      heightMapResidencyVersion = heightMapStreamer.getResidencyVersion();
+      terrainRenderModule.invalidateLevelMaps();
+    }
+
     {
       ETNA_PROFILE_GPU(cmd_buf, interestZoneRender);
       terrainRenderModule.execute(
@@ -411,9 +423,14 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
         renderPacket,
         resolution,
         gBuffer->genColorAttachmentParams(),
-        gBuffer->genDepthAttachmentParams());
+        gBuffer->genDepthAttachmentParams(),
+        depthPyramid.getBuffer(),
+        heightMapStreamer.getFeedbackBuffer());
     }
 
+    // tiles visible terrain asked for are loaded a few frames later
+    heightMapStreamer.readbackFeedback(cmd_buf);
+
     etna::set_state(
       cmd_buf,
       renderTarget.get(),
@@ -439,6 +456,9 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
       deferredShading(cmd_buf, currentConstants, deferredShadingPipeline.getVkPipelineLayout());
     }
 
+    // depth of this frame is used for occlusion culling in the next one
+    depthPyramid.execute(cmd_buf, params.projView, gBuffer->genDepthBinding(0));
+
     etna::set_state(
       cmd_buf,
       renderTarget.get(),
@@ -14,6 +14,8 @@
 #include "wsi/Keyboard.hpp"
 
 #include "modules/Light/LightModule.hpp"
+#include "modules/DepthPyramid/DepthPyramid.hpp"
+#include "modules/HeightMapStreaming/HeightMapStreamer.hpp"
 #include "modules/TerrainGenerator/TerrainGeneratorModule.hpp"
 #include "local_modules/TerrainRender/TerrainRenderModule.hpp"
 #include "modules/RenderPacket.hpp"
@@ -58,6 +60,8 @@ private:
 
 private:
   LightModule lightModule;
+  DepthPyramid depthPyramid;
+  HeightMapStreamer heightMapStreamer;
   TerrainRenderModule terrainRenderModule;
 
   bool freezeClipmap;
@@ -65,7 +69,8 @@ private:
   vk::Format renderTargetFormat;
 
   etna::Image cubemapTexture;
-    etna::Image heightMapTexture;
+  // level maps are rewritten when it differs from the one of the streamer
+  std::uint64_t heightMapResidencyVersion;
 
   TerrainInfo info;
   etna::Buffer terrainInfoBuffer;
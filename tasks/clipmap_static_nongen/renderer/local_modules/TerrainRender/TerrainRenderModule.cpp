@@ -40,17 +40,18 @@ void TerrainRenderModule::allocateResources()
 
   meshesParams = {
     .instancesCount = shader_uint(terrainMgr->getInstanceMeshes().size()),
-    .relemsCount = shader_uint(terrainMgr->getRenderElements().size())};
+    .relemsCount = shader_uint(terrainMgr->getRenderElements().size()),
+    .pairsCount = terrainMgr->getCullingPairsCount()};
 
   meshesParamsBuffer.map();
   std::memcpy(meshesParamsBuffer.data(), &meshesParams, sizeof(meshesParams));
   meshesParamsBuffer.unmap();
-
-  oneShotCommands = etna::get_context().createOneShotCmdMgr();
 }
 
 void TerrainRenderModule::loadShaders()
 {
+  terrainMgr->loadShaders();
+
   etna::create_program("culling_meshes", {TERRAIN_RENDER_NONGEN_MODULE_SHADERS_ROOT "culling.comp.spv"});
 
   // etna::create_program(
@@ -68,16 +69,9 @@ void TerrainRenderModule::setupPipelines(bool wireframe_enabled, vk::Format rend
 {
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = terrainMgr->getVertexFormatDescription(),
-    }},
-  };
-
   terrainRenderPipeline = pipelineManager.createGraphicsPipeline(
     "terrain_render",
     etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
           .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
@@ -115,29 +109,26 @@ void TerrainRenderModule::setupPipelines(bool wireframe_enabled, vk::Format rend
     });
 
   cullingPipeline = pipelineManager.createComputePipeline("culling_meshes", {});
+
+  terrainMgr->setupPipelines();
 }
 
-void TerrainRenderModule::loadMaps(std::vector<etna::Binding> terrain_bindings)
+void TerrainRenderModule::loadStreamedMap(
+  std::vector<etna::Binding> streamed_bindings, etna::Binding source_bounds)
 {
-  auto shaderInfo = etna::get_shader_program("terrain_render");
-  terrainSet =
-    std::make_unique<etna::PersistentDescriptorSet>(etna::create_persistent_descriptor_set(
-      shaderInfo.getDescriptorLayoutId(0), terrain_bindings, true));
-
-  auto commandBuffer = oneShotCommands->start();
-  ETNA_CHECK_VK_RESULT(commandBuffer.begin(vk::CommandBufferBeginInfo{}));
-  {
-    terrainSet->processBarriers(commandBuffer);
-  }
-  ETNA_CHECK_VK_RESULT(commandBuffer.end());
-  oneShotCommands->submitAndWait(commandBuffer);
-
-  texturesAmount = static_cast<uint32_t>(terrain_bindings.size() - 1);
+  // terrain is rendered from level maps, height map is only read by terrain manager
+  terrainMgr->loadStreamedHeightMap(std::move(streamed_bindings), source_bounds);
 }
 
 void TerrainRenderModule::update(const RenderPacket& packet)
 {
-  terrainMgr->moveClipmap(packet.cameraWorldPosition);
+  // update is skipped while the clipmap is frozen, so placement uses the position stored here
+  clipmapCameraPosition = packet.cameraWorldPosition;
+
+  if (!terrainMgr->isGpuPlacementEnabled())
+  {
+    terrainMgr->moveClipmap(packet.cameraWorldPosition);
+  }
 
   auto projView = packet.projView;
 
@@ -166,14 +157,36 @@ void TerrainRenderModule::execute(
   const RenderPacket& packet,
   glm::uvec2 extent,
   std::vector<etna::RenderTargetState::AttachmentParams> color_attachment_params,
-  etna::RenderTargetState::AttachmentParams depth_attachment_params)
+  etna::RenderTargetState::AttachmentParams depth_attachment_params,
+  const etna::Buffer& depth_pyramid,
+  const etna::Buffer& height_map_feedback)
 {
-  auto& matricesBuffer = terrainMgr->getInstanceMatricesBuffer();
+  if (terrainMgr->isGpuPlacementEnabled())
+  {
+    ETNA_PROFILE_GPU(cmd_buf, placeClipmap);
+    terrainMgr->placeClipmap(cmd_buf, clipmapCameraPosition);
+  }
+
+  terrainMgr->buildHeightBounds(cmd_buf);
+  terrainMgr->updateLevelMaps(cmd_buf, clipmapCameraPosition);
+
+  auto& instancesBuffer = terrainMgr->getInstancesBuffer();
 
   {
     ETNA_PROFILE_GPU(cmd_buf, cullTerrain);
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cullingPipeline.getVkPipeline());
-    cullTerrain(cmd_buf, cullingPipeline.getVkPipelineLayout(), packet, matricesBuffer);
+    cullTerrain(
+      cmd_buf,
+      cullingPipeline.getVkPipelineLayout(),
+      packet,
+      instancesBuffer,
+      depth_pyramid,
+      height_map_feedback);
+  }
+
+  {
+    ETNA_PROFILE_GPU(cmd_buf, compactDraws);
+    terrainMgr->compactDraws(cmd_buf);
   }
 
   {
@@ -182,7 +195,7 @@ void TerrainRenderModule::execute(
       cmd_buf, {{0, 0}, {extent.x, extent.y}}, color_attachment_params, depth_attachment_params);
 
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainRenderPipeline.getVkPipeline());
-    renderTerrain(cmd_buf, terrainRenderPipeline.getVkPipelineLayout(), packet, matricesBuffer);
+    renderTerrain(cmd_buf, terrainRenderPipeline.getVkPipelineLayout(), packet, instancesBuffer);
   }
 }
 
@@ -190,6 +203,15 @@ void TerrainRenderModule::drawGui()
 {
   ImGui::Begin("Application Settings");
 
+  if (ImGui::CollapsingHeader("Terrain Render"))
+  {
+    bool gpuPlacement = terrainMgr->isGpuPlacementEnabled();
+    if (ImGui::Checkbox("GPU clipmap placement", &gpuPlacement))
+    {
+      terrainMgr->setGpuPlacement(gpuPlacement);
+    }
+  }
+
   ImGui::End();
 }
 
@@ -197,25 +219,20 @@ void TerrainRenderModule::cullTerrain(
   vk::CommandBuffer cmd_buf,
   vk::PipelineLayout pipeline_layout,
   const RenderPacket& packet,
-  const etna::Buffer& matrices_buffer)
+  const etna::Buffer& instances_buffer,
+  const etna::Buffer& depth_pyramid,
+  const etna::Buffer& height_map_feedback)
 {
   ZoneScoped;
   {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
-        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .buffer = terrainMgr->getDrawInstanceIndicesBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .buffer = terrainMgr->getDrawCommandsBuffer().get(),
-        .size = vk::WholeSize}};
+    // compaction of the previous frame could still read visibility flags
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+      .buffer = terrainMgr->getVisibilityBuffer().get(),
+      .size = vk::WholeSize}};
 
     vk::DependencyInfo dependencyInfo = {
       .dependencyFlags = vk::DependencyFlagBits::eByRegion,
@@ -229,16 +246,15 @@ void TerrainRenderModule::cullTerrain(
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
-    {etna::Binding{0, terrainMgr->getRelemsBuffer().genBinding()},
+    {etna::Binding{0, terrainMgr->getCullingPairsBuffer().genBinding()},
      etna::Binding{1, terrainMgr->getBoundsBuffer().genBinding()},
-     etna::Binding{2, terrainMgr->getMeshesBuffer().genBinding()},
-     etna::Binding{3, terrainMgr->getInstanceMeshesBuffer().genBinding()},
-     etna::Binding{4, matrices_buffer.genBinding()},
-     etna::Binding{5, terrainMgr->getRelemInstanceOffsetsBuffer().genBinding()},
-     etna::Binding{6, terrainMgr->getDrawInstanceIndicesBuffer().genBinding()},
-     etna::Binding{7, terrainMgr->getDrawCommandsBuffer().genBinding()},
-     etna::Binding{8, meshesParamsBuffer.genBinding()},
-     etna::Binding{9, frustumPlanesBuffer.genBinding()}});
+     etna::Binding{2, instances_buffer.genBinding()},
+     etna::Binding{3, terrainMgr->getVisibilityBuffer().genBinding()},
+     etna::Binding{4, meshesParamsBuffer.genBinding()},
+     etna::Binding{5, frustumPlanesBuffer.genBinding()},
+     etna::Binding{6, terrainMgr->getHeightBoundsBuffer().genBinding()},
+     etna::Binding{7, depth_pyramid.genBinding()},
+     etna::Binding{8, height_map_feedback.genBinding()}});
   auto vkSet = set.getVkSet();
 
   cmd_buf.bindDescriptorSets(
@@ -248,73 +264,48 @@ void TerrainRenderModule::cullTerrain(
     pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, {packet.projView});
 
 
-  cmd_buf.dispatch(
-    (static_cast<uint32_t>(terrainMgr->getInstanceMeshes().size()) + 127) / 128, 1, 1);
-
-  {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
-        .buffer = terrainMgr->getDrawInstanceIndicesBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .buffer = terrainMgr->getDrawCommandsBuffer().get(),
-        .size = vk::WholeSize}};
-
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
-
-    cmd_buf.pipelineBarrier2(dependencyInfo);
-  }
+  cmd_buf.dispatch((terrainMgr->getCullingPairsCount() + 127) / 128, 1, 1);
 }
 
 void TerrainRenderModule::renderTerrain(
   vk::CommandBuffer cmd_buf,
   vk::PipelineLayout pipeline_layout,
   const RenderPacket& packet,
-  const etna::Buffer& matrices_buffer)
+  const etna::Buffer& instances_buffer)
 {
   ZoneScoped;
-  if (!terrainMgr->getVertexBuffer())
+  if (!terrainMgr->getIndexBuffer())
   {
     return;
   }
 
-  cmd_buf.bindVertexBuffers(0, {terrainMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(terrainMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  cmd_buf.bindIndexBuffer(terrainMgr->getIndexBuffer(), 0, terrainMgr->getIndexType());
 
   auto shaderInfo = etna::get_shader_program("terrain_render");
   auto set = etna::create_descriptor_set(
-    shaderInfo.getDescriptorLayoutId(1),
+    shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
     {
-      etna::Binding{0, matrices_buffer.genBinding()},
+      etna::Binding{0, instances_buffer.genBinding()},
       etna::Binding{1, terrainMgr->getDrawInstanceIndicesBuffer().genBinding()},
+      etna::Binding{2, terrainMgr->getRelemLayoutsBuffer().genBinding()},
+      etna::Binding{3, terrainMgr->getDrawRelemsBuffer().genBinding()},
+      terrainMgr->genLevelMapsBinding(4),
     });
 
   auto vkSet = set.getVkSet();
 
-  cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {terrainSet->getVkSet(), vkSet}, {});
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {vkSet}, {});
 
   cmd_buf.pushConstants<PushConstants>(
-    pipeline_layout,
-    vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
-    0,
-    {{.projView = packet.projView, .texturesAmount = texturesAmount}});
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {{.projView = packet.projView}});
 
-  cmd_buf.drawIndexedIndirect(
+  // relems without visible instances are compacted away, so only the draw count is read
+  cmd_buf.drawIndexedIndirectCountKHR(
     terrainMgr->getDrawCommandsBuffer().get(),
     0,
+    terrainMgr->getDrawCountBuffer().get(),
+    0,
     static_cast<uint32_t>(terrainMgr->getRenderElements().size()),
     sizeof(vk::DrawIndexedIndirectCommand));
 }
@@ -23,7 +23,12 @@ public:
   void allocateResources();
   void loadShaders();
   void setupPipelines(bool wireframe_enabled, vk::Format render_target_format);
-  void loadMaps(std::vector<etna::Binding> terrain_bindings);
+  // Terrain is built from a streamed height map, see TerrainManager::loadStreamedHeightMap
+  void loadStreamedMap(std::vector<etna::Binding> streamed_bindings, etna::Binding source_bounds);
+  // Culling bounds and level maps are rebuilt from height maps on the next frame
+  void updateHeightMaps() { terrainMgr->updateHeightMaps(); }
+  // Level maps are rewritten on the next frame, bounds are kept
+  void invalidateLevelMaps() { terrainMgr->invalidateLevelMaps(); }
 
   void update(const RenderPacket& packet);
 
@@ -32,7 +37,9 @@ public:
     const RenderPacket& packet,
     glm::uvec2 extent,
     std::vector<etna::RenderTargetState::AttachmentParams> color_attachment_params,
-    etna::RenderTargetState::AttachmentParams depth_attachment_params);
+    etna::RenderTargetState::AttachmentParams depth_attachment_params,
+    const etna::Buffer& depth_pyramid,
+    const etna::Buffer& height_map_feedback);
 
   void drawGui();
 
@@ -41,23 +48,25 @@ private:
     vk::CommandBuffer cmd_buf,
     vk::PipelineLayout pipeline_layout,
     const RenderPacket& packet,
-    const etna::Buffer& matrices_buffer);
+    const etna::Buffer& instances_buffer,
+    const etna::Buffer& depth_pyramid,
+    const etna::Buffer& height_map_feedback);
 
   void renderTerrain(
     vk::CommandBuffer cmd_buf,
     vk::PipelineLayout pipeline_layout,
     const RenderPacket& packet,
-    const etna::Buffer& matrices_buffer);
+    const etna::Buffer& instances_buffer);
 
 private:
   struct PushConstants
   {
     glm::mat4x4 projView;
-    uint32_t texturesAmount;
   };
 
 private:
   std::unique_ptr<TerrainManager> terrainMgr;
+  glm::vec3 clipmapCameraPosition = {};
 
   MeshesParams meshesParams;
 
@@ -66,10 +75,4 @@ private:
 
   etna::GraphicsPipeline terrainRenderPipeline;
   etna::ComputePipeline cullingPipeline;
-
-  std::unique_ptr<etna::PersistentDescriptorSet> terrainSet;
-
-  uint32_t texturesAmount;
-
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
 };
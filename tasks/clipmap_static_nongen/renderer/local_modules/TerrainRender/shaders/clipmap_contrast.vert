@@ -1,5 +1,9 @@
 #version 460
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "/clipmap/clipmap_instance.glsl"
+#include "/clipmap/clipmap_vertex.glsl"
 
 struct TerrainInfo
 {
@@ -8,17 +12,15 @@ struct TerrainInfo
   float heightAmplifier;
 };
 
-layout(location = 0) in vec2 vPos;
-
 layout(set = 0, binding = 0) uniform sampler2D heightMaps[32];
 layout(set = 0, binding = 1) readonly buffer infos_t
 {
   TerrainInfo infos[];
 };
 
-layout(std140, set = 1, binding = 0) readonly buffer instance_matrices_t
+layout(set = 1, binding = 0) readonly buffer instances_t
 {
-  mat4 instanceMatrices[];
+  ClipmapInstance instances[];
 };
 
 layout(set = 1, binding = 1) readonly buffer draw_relems_instance_indices_t
@@ -26,6 +28,16 @@ layout(set = 1, binding = 1) readonly buffer draw_relems_instance_indices_t
   uint drawRelemsInstanceIndices[];
 };
 
+layout(set = 1, binding = 2) readonly buffer relem_layouts_t
+{
+  ClipmapRelemLayout relemLayouts[];
+};
+
+layout(set = 1, binding = 3) readonly buffer draw_relems_t
+{
+  uint drawRelems[];
+};
+
 layout(push_constant) uniform proj_view_t
 {
   mat4 projView;
@@ -72,9 +84,13 @@ vec3 generateNormal(ivec2 heightMapSize, vec3 pos)
 
 void main(void)
 {
-  mat4 currentModelMatrix = instanceMatrices[drawRelemsInstanceIndices[gl_InstanceIndex]];
+  // draws are compacted on GPU, so draw index goes through the visible relems list
+  ClipmapRelemLayout currentLayout = relemLayouts[drawRelems[gl_DrawID]];
+  vec2 vPos = pullClipmapVertex(currentLayout, uint(gl_VertexIndex) - currentLayout.vertexOffset);
+
+  ClipmapInstance currentInstance = instances[drawRelemsInstanceIndices[gl_InstanceIndex]];
 
-  vec3 pos = (currentModelMatrix * vec4(vPos.x, 0, vPos.y, 1.0)).xyz;
+  vec3 pos = vec3(toWorldPosition(currentInstance, vPos), 0).xzy;
 
   float height = 0;
 
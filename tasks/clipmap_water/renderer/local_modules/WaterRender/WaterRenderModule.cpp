@@ -83,7 +83,8 @@ void WaterRenderModule::allocateResources()
 
   meshesParams = {
     .instancesCount = shader_uint(terrainMgr->getInstanceMeshes().size()),
-    .relemsCount = shader_uint(terrainMgr->getRenderElements().size())};
+    .relemsCount = shader_uint(terrainMgr->getRenderElements().size()),
+    .pairsCount = terrainMgr->getCullingPairsCount()};
 
   paramsBuffer.map();
   std::memcpy(paramsBuffer.data(), &params, sizeof(WaterParams));
@@ -100,6 +101,8 @@ void WaterRenderModule::allocateResources()
 
 void WaterRenderModule::loadShaders()
 {
+  terrainMgr->loadShaders();
+
   etna::create_program("culling_meshes", {WATER_RENDER_MODULE_SHADERS_ROOT "culling.comp.spv"});
 
   etna::create_program(
@@ -112,16 +115,9 @@ void WaterRenderModule::setupPipelines(bool wireframe_enabled, vk::Format render
 {
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = terrainMgr->getVertexFormatDescription(),
-    }},
-  };
-
   waterRenderPipeline = pipelineManager.createGraphicsPipeline(
     "water_render",
     etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
           .polygonMode = (wireframe_enabled ? vk::PolygonMode::eLine : vk::PolygonMode::eFill),
@@ -147,11 +143,19 @@ void WaterRenderModule::setupPipelines(bool wireframe_enabled, vk::Format render
     });
 
   cullingPipeline = pipelineManager.createComputePipeline("culling_meshes", {});
+
+  terrainMgr->setupPipelines();
 }
 
 void WaterRenderModule::update(const RenderPacket& packet)
 {
-  terrainMgr->moveClipmap(packet.cameraWorldPosition);
+  // update is skipped while the clipmap is frozen, so placement uses the position stored here
+  clipmapCameraPosition = packet.cameraWorldPosition;
+
+  if (!terrainMgr->isGpuPlacementEnabled())
+  {
+    terrainMgr->moveClipmap(packet.cameraWorldPosition);
+  }
 
   auto projView = packet.projView;
 
@@ -187,12 +191,23 @@ void WaterRenderModule::execute(
   const etna::Buffer& directional_lights_buffer,
   const etna::Image& cubemap)
 {
+  if (terrainMgr->isGpuPlacementEnabled())
+  {
+    ETNA_PROFILE_GPU(cmd_buf, placeClipmap);
+    terrainMgr->placeClipmap(cmd_buf, clipmapCameraPosition);
+  }
+
   {
     ETNA_PROFILE_GPU(cmd_buf, cullWaterMeshes);
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cullingPipeline.getVkPipeline());
     cullWater(cmd_buf, cullingPipeline.getVkPipelineLayout(), packet);
   }
 
+  {
+    ETNA_PROFILE_GPU(cmd_buf, compactDraws);
+    terrainMgr->compactDraws(cmd_buf);
+  }
+
   {
     ETNA_PROFILE_GPU(cmd_buf, renderWater);
     etna::RenderTargetState renderTargets(
@@ -219,6 +234,12 @@ void WaterRenderModule::drawGui()
 
   if (ImGui::CollapsingHeader("Water Render"))
   {
+    bool gpuPlacement = terrainMgr->isGpuPlacementEnabled();
+    if (ImGui::Checkbox("GPU clipmap placement", &gpuPlacement))
+    {
+      terrainMgr->setGpuPlacement(gpuPlacement);
+    }
+
     ImGui::SeparatorText("Render parameters");
 
     ImGuiColorEditFlags colorFlags =
@@ -294,21 +315,14 @@ void WaterRenderModule::cullWater(
 {
   ZoneScoped;
   {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
-        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .buffer = terrainMgr->getDrawInstanceIndicesBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .srcAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .buffer = terrainMgr->getDrawCommandsBuffer().get(),
-        .size = vk::WholeSize}};
+    // compaction of the previous frame could still read visibility flags
+    std::array bufferBarriers = {vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderWrite,
+      .buffer = terrainMgr->getVisibilityBuffer().get(),
+      .size = vk::WholeSize}};
 
     vk::DependencyInfo dependencyInfo = {
       .dependencyFlags = vk::DependencyFlagBits::eByRegion,
@@ -322,16 +336,12 @@ void WaterRenderModule::cullWater(
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
-    {etna::Binding{0, terrainMgr->getRelemsBuffer().genBinding()},
+    {etna::Binding{0, terrainMgr->getCullingPairsBuffer().genBinding()},
      etna::Binding{1, terrainMgr->getBoundsBuffer().genBinding()},
-     etna::Binding{2, terrainMgr->getMeshesBuffer().genBinding()},
-     etna::Binding{3, terrainMgr->getInstanceMeshesBuffer().genBinding()},
-     etna::Binding{4, terrainMgr->getInstanceMatricesBuffer().genBinding()},
-     etna::Binding{5, terrainMgr->getRelemInstanceOffsetsBuffer().genBinding()},
-     etna::Binding{6, terrainMgr->getDrawInstanceIndicesBuffer().genBinding()},
-     etna::Binding{7, terrainMgr->getDrawCommandsBuffer().genBinding()},
-     etna::Binding{8, meshesParamsBuffer.genBinding()},
-     etna::Binding{9, frustumPlanesBuffer.genBinding()}});
+     etna::Binding{2, terrainMgr->getInstancesBuffer().genBinding()},
+     etna::Binding{3, terrainMgr->getVisibilityBuffer().genBinding()},
+     etna::Binding{4, meshesParamsBuffer.genBinding()},
+     etna::Binding{5, frustumPlanesBuffer.genBinding()}});
   auto vkSet = set.getVkSet();
 
   cmd_buf.bindDescriptorSets(
@@ -341,33 +351,7 @@ void WaterRenderModule::cullWater(
     pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, {packet.projView});
 
 
-  cmd_buf.dispatch(
-    (static_cast<uint32_t>(terrainMgr->getInstanceMeshes().size()) + 127) / 128, 1, 1);
-
-  {
-    std::array bufferBarriers = {
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
-        .buffer = terrainMgr->getDrawInstanceIndicesBuffer().get(),
-        .size = vk::WholeSize},
-      vk::BufferMemoryBarrier2{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
-        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead,
-        .buffer = terrainMgr->getDrawCommandsBuffer().get(),
-        .size = vk::WholeSize}};
-
-    vk::DependencyInfo dependencyInfo = {
-      .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-      .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
-      .pBufferMemoryBarriers = bufferBarriers.data()};
-
-    cmd_buf.pipelineBarrier2(dependencyInfo);
-  }
+  cmd_buf.dispatch((terrainMgr->getCullingPairsCount() + 127) / 128, 1, 1);
 }
 
 void WaterRenderModule::renderWater(
@@ -381,19 +365,18 @@ void WaterRenderModule::renderWater(
   const etna::Image& cubemap)
 {
   ZoneScoped;
-  if (!terrainMgr->getVertexBuffer())
+  if (!terrainMgr->getIndexBuffer())
   {
     return;
   }
 
-  cmd_buf.bindVertexBuffers(0, {terrainMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(terrainMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  cmd_buf.bindIndexBuffer(terrainMgr->getIndexBuffer(), 0, terrainMgr->getIndexType());
 
   auto shaderInfo = etna::get_shader_program("water_render");
   auto set = etna::create_descriptor_set(
     shaderInfo.getDescriptorLayoutId(0),
     cmd_buf,
-    {etna::Binding{0, terrainMgr->getInstanceMatricesBuffer().genBinding()},
+    {etna::Binding{0, terrainMgr->getInstancesBuffer().genBinding()},
      etna::Binding{1, terrainMgr->getDrawInstanceIndicesBuffer().genBinding()},
      etna::Binding{2, paramsBuffer.genBinding()},
      etna::Binding{3, renderParamsBuffer.genBinding()},
@@ -408,7 +391,9 @@ void WaterRenderModule::renderWater(
          water_sampler.get(),
          vk::ImageLayout::eShaderReadOnlyOptimal,
          {.type = vk::ImageViewType::eCube})},
-     etna::Binding{7, directional_lights_buffer.genBinding()}});
+     etna::Binding{7, directional_lights_buffer.genBinding()},
+     etna::Binding{8, terrainMgr->getRelemLayoutsBuffer().genBinding()},
+     etna::Binding{9, terrainMgr->getDrawRelemsBuffer().genBinding()}});
 
   auto vkSet = set.getVkSet();
 
@@ -421,9 +406,12 @@ void WaterRenderModule::renderWater(
     0,
     {packet});
 
-  cmd_buf.drawIndexedIndirect(
+  // relems without visible instances are compacted away, so only the draw count is read
+  cmd_buf.drawIndexedIndirectCountKHR(
     terrainMgr->getDrawCommandsBuffer().get(),
     0,
+    terrainMgr->getDrawCountBuffer().get(),
+    0,
     static_cast<uint32_t>(terrainMgr->getRenderElements().size()),
     sizeof(vk::DrawIndexedIndirectCommand));
 }
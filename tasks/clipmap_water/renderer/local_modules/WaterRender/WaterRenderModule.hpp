@@ -56,6 +56,7 @@ private:
 
 private:
   std::unique_ptr<TerrainManager> terrainMgr;
+  glm::vec3 clipmapCameraPosition = {};
 
   WaterParams params;
   etna::Buffer paramsBuffer;
@@ -3,12 +3,12 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "WaterParams.h"
+#include "/clipmap/clipmap_instance.glsl"
+#include "/clipmap/clipmap_vertex.glsl"
 
-layout(location = 0) in vec2 vPos;
-
-layout(std140, binding = 0) readonly buffer instance_matrices_t
+layout(binding = 0) readonly buffer instances_t
 {
-  mat4 instanceMatrices[];
+  ClipmapInstance instances[];
 };
 
 layout(binding = 1) readonly buffer draw_relems_instance_indices_t
@@ -23,6 +23,16 @@ layout(binding = 2) uniform terrain_params_t
 
 layout(binding = 4) uniform sampler2D heightMap;
 
+layout(binding = 8) readonly buffer relem_layouts_t
+{
+  ClipmapRelemLayout relemLayouts[];
+};
+
+layout(binding = 9) readonly buffer draw_relems_t
+{
+  uint drawRelems[];
+};
+
 layout(push_constant) uniform push_constant_t
 {
   mat4 projView;
@@ -47,9 +57,13 @@ out gl_PerVertex
 
 void main(void)
 {
-  mat4 currentModelMatrix = instanceMatrices[drawRelemsInstanceIndices[gl_InstanceIndex]];
+  // draws are compacted on GPU, so draw index goes through the visible relems list
+  ClipmapRelemLayout currentLayout = relemLayouts[drawRelems[gl_DrawID]];
+  vec2 vPos = pullClipmapVertex(currentLayout, uint(gl_VertexIndex) - currentLayout.vertexOffset);
+
+  ClipmapInstance currentInstance = instances[drawRelemsInstanceIndices[gl_InstanceIndex]];
 
-  vec3 pos = (currentModelMatrix * vec4(vPos.x, 0, vPos.y, 1.0)).xyz;
+  vec3 pos = vec3(toWorldPosition(currentInstance, vPos), 0).xzy;
 
   vOut.texCoord = 0.5 * (pos.xz / params.extent) + 0.5;
   float height = texture(heightMap, vOut.texCoord).x;